@@ -13,6 +13,21 @@
 
 namespace cs350
 {
+    namespace
+    {
+        /**
+        * @brief Computes the surface area of a bounding volume (0 for an empty one).
+        * @param bv         The bounding volume.
+        * @return float     The area of its six faces.
+        */
+        float surface_area(const aabb & bv)
+        {
+            const glm::vec3 & sizeVec = glm::max(bv.mMaxPos - bv.mMinPos, glm::vec3(0.0f));
+            return (sizeVec.x * sizeVec.y + sizeVec.x * sizeVec.z + sizeVec.y * sizeVec.z) * 2.0f;
+        }
+    }
+
+
     /**
     * @brief Default constructs all the elements of the node.
     */
@@ -72,6 +87,10 @@ namespace cs350
         case bvh_construction_method::insertion:
 
             break;
+
+        case bvh_construction_method::sah_binned:
+            sah_binned_bvh(&mRoot, vert_data.positions, vert_data.mPosIndices);
+            break;
         
         default:
             std::cout<<"DEBUG : BVH : UNKNOWN BVH CONSTRUCTION METHOD\n";
@@ -180,7 +199,7 @@ namespace cs350
         if (outLeftIndices.size() == 0 || outRightIndices.size() == 0)
         {
             nodeToDiv->mNodeType = tree_node_type::leaf;
-            //nodeToDiv->mIndices = outLeftIndices.size() == 0 ? outRightIndices : outLeftIndices;
+            nodeToDiv->mIndices = inIndices;
             return false;
         }
         
@@ -227,6 +246,194 @@ namespace cs350
     }
 
 
+    /**
+    * @brief Sets the parameters of the binned sah construction. If the current tree was built
+    *        with it, the next call to construct_bvh rebuilds it.
+    * @param bin_count              The candidate split planes per axis (clamped to [2, 64]).
+    * @param max_leaf_triangles     Nodes with more triangles are always split.
+    */
+    void bvh_tree::set_sah_binned_parameters(unsigned bin_count, unsigned max_leaf_triangles)
+    {
+        mBinCount = glm::clamp(bin_count, 2u, 64u);
+        mMaxLeafTriangles = glm::max(max_leaf_triangles, 1u);
+
+        if (mBuildMethod == bvh_construction_method::sah_binned)
+            mBuildMethod = bvh_construction_method::not_constructed;
+    }
+
+
+    /**
+    * @brief Partitions the triangles with the surface area heuristic. The centroids are binned along
+    *        each axis of their bv, and the plane between two bins that minimizes the expected cost of
+    *        a query (traversal + area weighted triangle tests of both children) is chosen. If splitting
+    *        is not cheaper than testing every triangle and there are few enough of them, or if every
+    *        centroid is the same point, the node becomes a leaf instead.
+    * @param nodeToDiv          The node to partition (its bv already computed).
+    * @param inPositions        The positions of the triangles vertices to index from.
+    * @param inIndices          The indices of the triangles of the node.
+    * @param outLeftIndices     Output, the indices of the triangles of the left child.
+    * @param outRightIndices    Output, the indices of the triangles of the right child.
+    * @return bool              False if the node became a leaf.
+    */
+    bool bvh_tree::sah_binned_partition(bvh_node * nodeToDiv,
+                                        const std::vector<glm::vec3> & inPositions,
+                                        const std::vector<unsigned> & inIndices,
+                                        std::vector<unsigned> & outLeftIndices,
+                                        std::vector<unsigned> & outRightIndices)
+    {
+        assert(nodeToDiv != nullptr);
+
+        struct bin
+        {
+            aabb mBV;
+            unsigned mCount = 0;
+        };
+
+        const float traversalCost = 1.0f;
+        const float intersectionCost = 1.0f;
+        size_t numberOfTriangles = inIndices.size() / 3;
+
+        // Bv of each triangle and of the triangles centroids, the bins divide the latter
+        std::vector<aabb> triangleBVs(numberOfTriangles);
+        std::vector<glm::vec3> centroids(numberOfTriangles);
+        glm::vec3 centroidMin = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 centroidMax = glm::vec3(std::numeric_limits<float>::lowest());
+        for (size_t i = 0; i < numberOfTriangles; ++i)
+        {
+            const glm::vec3 & p0 = inPositions[inIndices[i * 3]];
+            const glm::vec3 & p1 = inPositions[inIndices[i * 3 + 1]];
+            const glm::vec3 & p2 = inPositions[inIndices[i * 3 + 2]];
+            triangleBVs[i].mMinPos = glm::min(p0, glm::min(p1, p2));
+            triangleBVs[i].mMaxPos = glm::max(p0, glm::max(p1, p2));
+            centroids[i] = (p0 + p1 + p2) / 3.0f;
+            centroidMin = glm::min(centroidMin, centroids[i]);
+            centroidMax = glm::max(centroidMax, centroids[i]);
+        }
+
+        float nodeArea = surface_area(nodeToDiv->mBV);
+        float bestCost = std::numeric_limits<float>::max();
+        int bestAxis = -1;
+        unsigned bestSplit = 0;     // The left child gets the bins before it
+
+        // Small nodes don't need more bins than triangles, most would be empty
+        unsigned binCount = glm::min(mBinCount, glm::max(static_cast<unsigned>(numberOfTriangles), 4u));
+        std::vector<bin> bins(binCount);
+        std::vector<float> rightCosts(binCount);
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float extent = centroidMax[axis] - centroidMin[axis];
+            if (extent <= 0.0f)
+                continue;
+
+            // Fill the bins with the bv and count of their triangles
+            for (bin & currBin : bins)
+            {
+                currBin.mBV.mMinPos = glm::vec3(std::numeric_limits<float>::max());
+                currBin.mBV.mMaxPos = glm::vec3(std::numeric_limits<float>::lowest());
+                currBin.mCount = 0;
+            }
+            float binsPerUnit = static_cast<float>(binCount) / extent;
+            for (size_t i = 0; i < numberOfTriangles; ++i)
+            {
+                unsigned binIndex = glm::min(static_cast<unsigned>((centroids[i][axis] - centroidMin[axis]) * binsPerUnit), binCount - 1);
+                bin & currBin = bins[binIndex];
+                currBin.mBV.mMinPos = glm::min(currBin.mBV.mMinPos, triangleBVs[i].mMinPos);
+                currBin.mBV.mMaxPos = glm::max(currBin.mBV.mMaxPos, triangleBVs[i].mMaxPos);
+                ++currBin.mCount;
+            }
+
+            // Sweep from the right to get the area weighted cost of each right child, then from the left
+            aabb sweptBV = bins[binCount - 1].mBV;
+            unsigned sweptCount = 0;
+            for (unsigned split = binCount - 1; split > 0; --split)
+            {
+                sweptBV.mMinPos = glm::min(sweptBV.mMinPos, bins[split].mBV.mMinPos);
+                sweptBV.mMaxPos = glm::max(sweptBV.mMaxPos, bins[split].mBV.mMaxPos);
+                sweptCount += bins[split].mCount;
+                rightCosts[split] = surface_area(sweptBV) * sweptCount;
+            }
+            sweptBV = bins[0].mBV;
+            sweptCount = 0;
+            for (unsigned split = 1; split < binCount; ++split)
+            {
+                sweptBV.mMinPos = glm::min(sweptBV.mMinPos, bins[split - 1].mBV.mMinPos);
+                sweptBV.mMaxPos = glm::max(sweptBV.mMaxPos, bins[split - 1].mBV.mMaxPos);
+                sweptCount += bins[split - 1].mCount;
+
+                // Both children must get some triangle
+                if (sweptCount == 0 || sweptCount == numberOfTriangles)
+                    continue;
+
+                float cost = traversalCost + intersectionCost * (surface_area(sweptBV) * sweptCount + rightCosts[split]) / nodeArea;
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = split;
+                }
+            }
+        }
+
+        // Leaf if there is no split (all the centroids are the same point) or it isn't worth it
+        float leafCost = intersectionCost * numberOfTriangles;
+        if (bestAxis < 0 || (numberOfTriangles <= mMaxLeafTriangles && leafCost <= bestCost))
+        {
+            nodeToDiv->mNodeType = tree_node_type::leaf;
+            nodeToDiv->mIndices = inIndices;
+            return false;
+        }
+
+        outLeftIndices.clear();
+        outRightIndices.clear();
+        float binsPerUnit = static_cast<float>(binCount) / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+        for (size_t i = 0; i < numberOfTriangles; ++i)
+        {
+            unsigned binIndex = glm::min(static_cast<unsigned>((centroids[i][bestAxis] - centroidMin[bestAxis]) * binsPerUnit), binCount - 1);
+            std::vector<unsigned> & outIndices = binIndex < bestSplit ? outLeftIndices : outRightIndices;
+            outIndices.push_back(inIndices[i * 3]);
+            outIndices.push_back(inIndices[i * 3 + 1]);
+            outIndices.push_back(inIndices[i * 3 + 2]);
+        }
+
+        return true;
+    }
+
+
+    /**
+    * @brief Constructs the bounding volume hierarchy tree top-down, partitioning with the binned
+    *        surface area heuristic. Leaves hold up to mMaxLeafTriangles triangles.
+    * @param tree                The tree we want to fill.
+    * @param positions           The positions whose bv we are to compute.
+    * @param posIndices          The indices to the positions vector, to form each triangle.
+    */
+    void bvh_tree::sah_binned_bvh(bvh_node ** tree, const std::vector<glm::vec3> & positions, const std::vector<unsigned> & posIndices)
+    {
+        // Nothing to do if there are no triangles to be added to this node
+        if (posIndices.size() / 3 == 0)
+            return;
+
+        bvh_node * newNode = create_node(compute_bv(positions, posIndices), tree_node_type::internal);
+        *tree = newNode;
+
+        // If it's a single triangle, end recursion
+        if (posIndices.size() / 3 == 1)
+        {
+            newNode->mNodeType = tree_node_type::leaf;
+            newNode->mIndices = posIndices;
+            return;
+        }
+
+        std::vector<unsigned> leftIndices;
+        std::vector<unsigned> rightIndices;
+        if (!sah_binned_partition(newNode, positions, posIndices, leftIndices, rightIndices))
+            return;
+
+        // Recursively make more nodes for each partition
+        sah_binned_bvh(&(newNode->mLeft), positions, leftIndices);
+        sah_binned_bvh(&(newNode->mRight), positions, rightIndices);
+    }
+
+
     /**
     * @brief Finds two candidate nodes to merge from nodes. Returns their indexes in
     *        dest and src. Uses the minimum surface area heuristic. Also, returns
@@ -331,6 +538,358 @@ namespace cs350
     }
 
 
+    /**
+    * @brief Finds the closest triangle hit by a ray. The children are visited nearest first, and
+    *        the nodes entered further than the closest hit so far are skipped.
+    * @param positions      The positions the tree was built from.
+    * @param r              The ray.
+    * @return float         The t of the closest hit, -1 if no triangle is hit.
+    */
+    float bvh_tree::raycast(const std::vector<glm::vec3> & positions, const ray & r) const
+    {
+        float closest = -1.0f;
+        if (mRoot == nullptr)
+            return closest;
+
+        // Nodes to visit, with the t at which the ray enters their bv
+        std::vector<std::pair<const bvh_node *, float>> stack;
+        float rootT = intersection_ray_aabb(r, mRoot->mBV);
+        if (rootT >= 0.0f)
+            stack.emplace_back(mRoot, rootT);
+
+        while (!stack.empty())
+        {
+            auto [node, enterT] = stack.back();
+            stack.pop_back();
+            if (closest >= 0.0f && enterT > closest)
+                continue;
+
+            if (node->mNodeType == tree_node_type::leaf)
+            {
+                for (size_t i = 0; i < node->mIndices.size(); i += 3)
+                {
+                    triangle tri(positions[node->mIndices[i]], positions[node->mIndices[i + 1]], positions[node->mIndices[i + 2]]);
+                    float t = intersection_ray_triangle(r, tri);
+                    if (t >= 0.0f && (closest < 0.0f || t < closest))
+                        closest = t;
+                }
+                continue;
+            }
+
+            float leftT = node->mLeft != nullptr ? intersection_ray_aabb(r, node->mLeft->mBV) : -1.0f;
+            float rightT = node->mRight != nullptr ? intersection_ray_aabb(r, node->mRight->mBV) : -1.0f;
+
+            // Push the farthest first so that the nearest is popped first
+            if (leftT >= 0.0f && rightT >= 0.0f && leftT < rightT)
+            {
+                stack.emplace_back(node->mRight, rightT);
+                stack.emplace_back(node->mLeft, leftT);
+            }
+            else
+            {
+                if (leftT >= 0.0f)
+                    stack.emplace_back(node->mLeft, leftT);
+                if (rightT >= 0.0f)
+                    stack.emplace_back(node->mRight, rightT);
+            }
+        }
+
+        return closest;
+    }
+
+
+    /**
+    * @brief Finds the triangles that intersect bv (with the separating axis test).
+    * @param positions      The positions the tree was built from.
+    * @param bv             The bounding volume to query.
+    * @param result         Output, the position indices of the triangles (3 per triangle, in no particular order).
+    */
+    void bvh_tree::query(const std::vector<glm::vec3> & positions, const aabb & bv, std::vector<unsigned> & result) const
+    {
+        result.clear();
+        if (mRoot == nullptr)
+            return;
+
+        std::vector<const bvh_node *> stack{mRoot};
+        while (!stack.empty())
+        {
+            const bvh_node * node = stack.back();
+            stack.pop_back();
+            if (node == nullptr || !intersection_aabb_aabb(node->mBV, bv))
+                continue;
+
+            if (node->mNodeType == tree_node_type::leaf)
+            {
+                for (size_t i = 0; i < node->mIndices.size(); i += 3)
+                {
+                    triangle tri(positions[node->mIndices[i]], positions[node->mIndices[i + 1]], positions[node->mIndices[i + 2]]);
+                    if (intersection_triangle_aabb(tri, bv))
+                        result.insert(result.end(), node->mIndices.begin() + i, node->mIndices.begin() + i + 3);
+                }
+                continue;
+            }
+
+            stack.push_back(node->mLeft);
+            stack.push_back(node->mRight);
+        }
+    }
+
+
+    /**
+    * @brief Computes the surface area heuristic cost of the tree: the expected cost of a query whose
+    *        chance to visit each node is the ratio of its surface area to the one of the root.
+    * @param traversal_cost     The cost of visiting an internal node.
+    * @param intersection_cost  The cost of testing a triangle.
+    * @return float             The cost, 0 for an empty tree.
+    */
+    float bvh_tree::sah_cost(float traversal_cost, float intersection_cost) const
+    {
+        if (mRoot == nullptr)
+            return 0.0f;
+
+        float rootArea = surface_area(mRoot->mBV);
+        if (rootArea <= 0.0f)
+            return intersection_cost * (mRoot->mIndices.size() / 3);
+
+        float cost = 0.0f;
+        std::vector<const bvh_node *> stack{mRoot};
+        while (!stack.empty())
+        {
+            const bvh_node * node = stack.back();
+            stack.pop_back();
+            if (node == nullptr)
+                continue;
+
+            float areaRatio = surface_area(node->mBV) / rootArea;
+            if (node->mNodeType == tree_node_type::leaf)
+                cost += areaRatio * intersection_cost * (node->mIndices.size() / 3);
+            else
+            {
+                cost += areaRatio * traversal_cost;
+                stack.push_back(node->mLeft);
+                stack.push_back(node->mRight);
+            }
+        }
+
+        return cost;
+    }
+
+
+    /**
+    * @brief Flattens the current tree (built with any method) into a single array of nodes in
+    *        depth first order, with the triangles of the leaves contiguous. The tree is kept.
+    */
+    void bvh_tree::flatten()
+    {
+        mLinearNodes.clear();
+        mLinearIndices.clear();
+        if (mRoot == nullptr)
+            return;
+
+        mLinearNodes.reserve(nodeCounter);
+        flatten_node(mRoot);
+    }
+
+
+    /**
+    * @brief Appends a node (and its subtree) to the flattened tree.
+    * @param node           The node to append.
+    * @return unsigned      Its index in the flattened tree.
+    */
+    unsigned bvh_tree::flatten_node(const bvh_node * node)
+    {
+        unsigned nodeIndex = static_cast<unsigned>(mLinearNodes.size());
+        mLinearNodes.emplace_back();
+        mLinearNodes[nodeIndex].mMin = node->mBV.mMinPos;
+        mLinearNodes[nodeIndex].mMax = node->mBV.mMaxPos;
+
+        if (node->mNodeType == tree_node_type::leaf)
+        {
+            add_linear_leaf(nodeIndex, node->mIndices);
+            return nodeIndex;
+        }
+
+        // The left child follows its parent, only the right one needs an index
+        assert(node->mLeft != nullptr && node->mRight != nullptr);
+        flatten_node(node->mLeft);
+        unsigned rightIndex = flatten_node(node->mRight);
+        mLinearNodes[nodeIndex].mOffset = rightIndex;
+        mLinearNodes[nodeIndex].mCount = 0;
+        return nodeIndex;
+    }
+
+
+    /**
+    * @brief Makes a node of the flattened tree a leaf, with the triangles passed as parameter.
+    * @param nodeIndex      The index of the node.
+    * @param posIndices     The indices to the positions vector, to form each triangle.
+    */
+    void bvh_tree::add_linear_leaf(unsigned nodeIndex, const std::vector<unsigned> & posIndices)
+    {
+        assert(posIndices.size() >= 3);
+        mLinearNodes[nodeIndex].mOffset = static_cast<unsigned>(mLinearIndices.size() / 3);
+        mLinearNodes[nodeIndex].mCount = static_cast<unsigned>(posIndices.size() / 3);
+        mLinearIndices.insert(mLinearIndices.end(), posIndices.begin(), posIndices.end());
+    }
+
+
+    /**
+    * @brief Constructs the flattened tree directly with the binned sah method, without allocating
+    *        the nodes of the tree. The current tree is cleared, and the build method becomes
+    *        not_constructed, since there is no tree for construct_bvh to skip rebuilding.
+    * @param vert_data      The mesh whose triangles are added.
+    */
+    void bvh_tree::construct_linear_bvh(const mesh_data & vert_data)
+    {
+        clear();
+        mBuildMethod = bvh_construction_method::not_constructed;
+
+        if (vert_data.mPosIndices.size() / 3 == 0)
+            return;
+
+        mLinearNodes.reserve(vert_data.mPosIndices.size() / 3);
+        linear_sah_binned_bvh(vert_data.positions, vert_data.mPosIndices);
+    }
+
+
+    /**
+    * @brief Appends a node (and its subtree) to the flattened tree, partitioning like sah_binned_bvh.
+    * @param positions           The positions whose bv we are to compute.
+    * @param posIndices          The indices to the positions vector, to form each triangle.
+    * @return unsigned           The index of the node in the flattened tree.
+    */
+    unsigned bvh_tree::linear_sah_binned_bvh(const std::vector<glm::vec3> & positions, const std::vector<unsigned> & posIndices)
+    {
+        // The partition only needs the bv, the node isn't kept
+        bvh_node node;
+        node.mBV = compute_bv(positions, posIndices);
+
+        unsigned nodeIndex = static_cast<unsigned>(mLinearNodes.size());
+        mLinearNodes.emplace_back();
+        mLinearNodes[nodeIndex].mMin = node.mBV.mMinPos;
+        mLinearNodes[nodeIndex].mMax = node.mBV.mMaxPos;
+
+        std::vector<unsigned> leftIndices;
+        std::vector<unsigned> rightIndices;
+        if (posIndices.size() / 3 == 1 || !sah_binned_partition(&node, positions, posIndices, leftIndices, rightIndices))
+        {
+            add_linear_leaf(nodeIndex, posIndices);
+            return nodeIndex;
+        }
+
+        linear_sah_binned_bvh(positions, leftIndices);
+        unsigned rightIndex = linear_sah_binned_bvh(positions, rightIndices);
+        mLinearNodes[nodeIndex].mOffset = rightIndex;
+        mLinearNodes[nodeIndex].mCount = 0;
+        return nodeIndex;
+    }
+
+
+    /**
+    * @brief Same as raycast, on the flattened tree.
+    * @param positions      The positions the tree was built from.
+    * @param r              The ray.
+    * @return float         The t of the closest hit, -1 if no triangle is hit.
+    */
+    float bvh_tree::linear_raycast(const std::vector<glm::vec3> & positions, const ray & r) const
+    {
+        float closest = -1.0f;
+        if (mLinearNodes.empty())
+            return closest;
+
+        // Nodes to visit, with the t at which the ray enters their bv
+        std::vector<std::pair<unsigned, float>> stack;
+        stack.reserve(64);
+        float rootT = intersection_ray_aabb(r, aabb(mLinearNodes[0].mMin, mLinearNodes[0].mMax));
+        if (rootT >= 0.0f)
+            stack.emplace_back(0u, rootT);
+
+        while (!stack.empty())
+        {
+            auto [nodeIndex, enterT] = stack.back();
+            stack.pop_back();
+            if (closest >= 0.0f && enterT > closest)
+                continue;
+
+            const linear_bvh_node & node = mLinearNodes[nodeIndex];
+            if (node.mCount != 0)
+            {
+                const unsigned * indices = mLinearIndices.data() + node.mOffset * 3;
+                for (unsigned i = 0; i < node.mCount * 3; i += 3)
+                {
+                    triangle tri(positions[indices[i]], positions[indices[i + 1]], positions[indices[i + 2]]);
+                    float t = intersection_ray_triangle(r, tri);
+                    if (t >= 0.0f && (closest < 0.0f || t < closest))
+                        closest = t;
+                }
+                continue;
+            }
+
+            unsigned leftIndex = nodeIndex + 1;
+            unsigned rightIndex = node.mOffset;
+            float leftT = intersection_ray_aabb(r, aabb(mLinearNodes[leftIndex].mMin, mLinearNodes[leftIndex].mMax));
+            float rightT = intersection_ray_aabb(r, aabb(mLinearNodes[rightIndex].mMin, mLinearNodes[rightIndex].mMax));
+
+            // Push the farthest first so that the nearest is popped first
+            if (leftT >= 0.0f && rightT >= 0.0f && leftT < rightT)
+            {
+                stack.emplace_back(rightIndex, rightT);
+                stack.emplace_back(leftIndex, leftT);
+            }
+            else
+            {
+                if (leftT >= 0.0f)
+                    stack.emplace_back(leftIndex, leftT);
+                if (rightT >= 0.0f)
+                    stack.emplace_back(rightIndex, rightT);
+            }
+        }
+
+        return closest;
+    }
+
+
+    /**
+    * @brief Same as query, on the flattened tree.
+    * @param positions      The positions the tree was built from.
+    * @param bv             The bounding volume to query.
+    * @param result         Output, the position indices of the triangles (3 per triangle, in no particular order).
+    */
+    void bvh_tree::linear_query(const std::vector<glm::vec3> & positions, const aabb & bv, std::vector<unsigned> & result) const
+    {
+        result.clear();
+        if (mLinearNodes.empty())
+            return;
+
+        std::vector<unsigned> stack;
+        stack.reserve(64);
+        stack.push_back(0u);
+        while (!stack.empty())
+        {
+            unsigned nodeIndex = stack.back();
+            stack.pop_back();
+            const linear_bvh_node & node = mLinearNodes[nodeIndex];
+            if (!intersection_aabb_aabb(aabb(node.mMin, node.mMax), bv))
+                continue;
+
+            if (node.mCount != 0)
+            {
+                const unsigned * indices = mLinearIndices.data() + node.mOffset * 3;
+                for (unsigned i = 0; i < node.mCount * 3; i += 3)
+                {
+                    triangle tri(positions[indices[i]], positions[indices[i + 1]], positions[indices[i + 2]]);
+                    if (intersection_triangle_aabb(tri, bv))
+                        result.insert(result.end(), indices + i, indices + i + 3);
+                }
+                continue;
+            }
+
+            stack.push_back(node.mOffset);
+            stack.push_back(nodeIndex + 1);
+        }
+    }
+
+
     /**
     * @brief Returns the information of what method was used to construct the tree.
     */
@@ -349,6 +908,24 @@ namespace cs350
     }
 
 
+    /**
+    * @brief Returns the nodes of the flattened tree (empty if it wasn't flattened).
+    */
+    const std::vector<linear_bvh_node> & bvh_tree::get_linear_nodes() const
+    {
+        return mLinearNodes;
+    }
+
+
+    /**
+    * @brief Returns the position indices of the triangles of the flattened tree, in leaf order.
+    */
+    const std::vector<unsigned> & bvh_tree::get_linear_indices() const
+    {
+        return mLinearIndices;
+    }
+
+
     /**
     * @brief Returns false if the tree has at least one node, true otherwise.
     */
@@ -377,12 +954,15 @@ namespace cs350
 
 
     /**
-    * @brief Recursively frees all the nodes of the tree.
+    * @brief Recursively frees all the nodes of the tree, and the flattened tree.
     */
     void bvh_tree::clear()
     {
         destroy_tree(mRoot);
+        mRoot = nullptr;
         nodeCounter = 0;
+        mLinearNodes.clear();
+        mLinearIndices.clear();
     }
 
 
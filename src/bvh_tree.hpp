@@ -37,11 +37,24 @@ namespace cs350
     };
 
 
+    // Node of the flattened bvh. The nodes are in depth first order, so the left child of an
+    // internal node is the one after it. Two nodes per cache line.
+    struct alignas(32) linear_bvh_node
+    {
+        glm::vec3 mMin;
+        unsigned mOffset;       // Internal: index of the right child. Leaf: first triangle in the linear indices
+        glm::vec3 mMax;
+        unsigned mCount;        // Triangles of a leaf, 0 for internal nodes
+    };
+    static_assert(sizeof(linear_bvh_node) == 32, "linear_bvh_node must fill half a cache line");
+
+
     enum class bvh_construction_method
     {
         top_down,
         bottom_up,
         insertion,
+        sah_binned,
         not_constructed
     };
 
@@ -54,6 +67,18 @@ namespace cs350
         ~bvh_tree();
 
         void construct_bvh(const mesh_data & vert_data, bvh_construction_method building_method);
+        void set_sah_binned_parameters(unsigned bin_count, unsigned max_leaf_triangles);
+
+        float raycast(const std::vector<glm::vec3> & positions, const ray & r) const;
+        void query(const std::vector<glm::vec3> & positions, const aabb & bv, std::vector<unsigned> & result) const;
+        float sah_cost(float traversal_cost = 1.0f, float intersection_cost = 1.0f) const;
+
+        void flatten();
+        void construct_linear_bvh(const mesh_data & vert_data);
+        float linear_raycast(const std::vector<glm::vec3> & positions, const ray & r) const;
+        void linear_query(const std::vector<glm::vec3> & positions, const aabb & bv, std::vector<unsigned> & result) const;
+        const std::vector<linear_bvh_node> & get_linear_nodes() const;
+        const std::vector<unsigned> & get_linear_indices() const;
 
         bvh_construction_method get_build_method() const;
         bvh_node * get_root() const;
@@ -67,6 +92,11 @@ namespace cs350
         bvh_construction_method mBuildMethod;
 
         int nodeCounter = 0;
+        unsigned mBinCount = 16;            // Candidate split planes per axis of the binned sah build
+        unsigned mMaxLeafTriangles = 4;     // Nodes with more triangles are always split by the binned sah build
+
+        std::vector<linear_bvh_node> mLinearNodes;  // The flattened tree, empty until flatten or construct_linear_bvh
+        std::vector<unsigned> mLinearIndices;       // The position indices of the triangles of the leaves, in leaf order
 
         aabb compute_bv(const std::vector<glm::vec3> & positions, const std::vector<unsigned> & posIndices) const;
 
@@ -77,6 +107,16 @@ namespace cs350
                                 std::vector<unsigned> & outLeftIndices,
                                 std::vector<unsigned> & outRightIndices);
 
+        void sah_binned_bvh(bvh_node ** tree, const std::vector<glm::vec3> & positions, const std::vector<unsigned> & posIndices);
+        bool sah_binned_partition(bvh_node * nodeToDiv,
+                                  const std::vector<glm::vec3> & inPositions,
+                                  const std::vector<unsigned> & inIndices,
+                                  std::vector<unsigned> & outLeftIndices,
+                                  std::vector<unsigned> & outRightIndices);
+
+        unsigned flatten_node(const bvh_node * node);
+        unsigned linear_sah_binned_bvh(const std::vector<glm::vec3> & positions, const std::vector<unsigned> & posIndices);
+        void add_linear_leaf(unsigned nodeIndex, const std::vector<unsigned> & posIndices);
 
         void bottom_up_bvh(const std::vector<glm::vec3> & positions, const std::vector<unsigned> & posIndices);
         aabb find_merge_candidates(const std::vector<glm::vec3> & positions, 
@@ -0,0 +1,84 @@
+/**
+* @file compressed_octree.hpp
+* @author Miguel Echeverria , 540000918 , miguel.echeverria@digipen.edu
+* @date 2020/11/07
+* @brief Contains the declaration of the compressed (path compressed) linear octree, which only
+*        keeps the nodes that hold objects or branch.
+*
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+
+#pragma once
+#include "octree.hpp"
+
+namespace cs350 {
+
+    /**
+     * @brief
+     * 	Linear octree where chains of nodes with a single child and no objects are skipped (PATRICIA style).
+     *  Only the root, the nodes with objects and the nodes where the paths of two octants split exist, and each
+     *  node links to the nearest existing node of each octant, whose locational code holds the skipped prefix.
+     *  Objects go to the same locational codes as in octree<T>, and find_node looks them up the same way.
+     * @tparam T
+     *  Same requirements as octree<T> (its octree_node points to the node of the compressed octree)
+     */
+    template <typename T>
+    class compressed_octree
+    {
+      public:
+        struct node : octree<T>::node
+        {
+            node* parent{nullptr};
+            node* children[8]{};    // Nearest node of each octant (possibly several levels below), children_active mirrors it
+
+            // Number of levels between this node and its parent that have no node
+            [[nodiscard]] uint32_t skipped_levels() const { return parent != nullptr ? this->depth - parent->depth - 1 : 0u; }
+        };
+
+      private:
+        std::unordered_map<uint32_t, node*> m_nodes;
+        node*                               m_root;
+        uint32_t                            m_root_size;
+        uint32_t                            m_levels;
+        cell_interval                       m_interval;
+
+        node*           create_node(uint32_t locational_code);
+        void            delete_node(node* to_delete);
+        void            link(node* parent, node* child);
+        void            compact(node* current);
+        std::vector<T*> take_objects();
+
+      public:
+        compressed_octree();
+        ~compressed_octree();
+        compressed_octree(compressed_octree const&) = delete;
+        compressed_octree& operator=(compressed_octree const&) = delete;
+
+        void        destroy();
+        node*       find_node(uint32_t locational_code);
+        node const* find_node(uint32_t locational_code) const;
+        node const* find_deepest(uint32_t locational_code) const;
+        uint32_t    locational_code(aabb const& bv) const;
+
+        void        insert(T* object);
+        void        relocate(T* object);
+        void        erase(T* object);
+
+        template <typename F>
+        void        query(aabb const& bv, F&& function) const;
+        template <typename F>
+        void        for_each_pair(F&& function) const;
+
+        const std::unordered_map<uint32_t, node*> & get_map() const { return m_nodes; }
+        [[nodiscard]] node const*   root() const { return m_root; }
+        [[nodiscard]] uint32_t      max_path_length() const;
+        [[nodiscard]] uint32_t      root_size() const { return m_root_size; }
+        [[nodiscard]] uint32_t      levels() const { return m_levels; }
+        [[nodiscard]] cell_interval interval() const { return m_interval; }
+        void                        set_root_size(uint32_t size);
+        void                        set_levels(uint32_t levels);
+        void                        set_interval(cell_interval interval);
+    };
+}
+
+#include "compressed_octree.inl"
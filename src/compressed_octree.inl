@@ -0,0 +1,466 @@
+/**
+* @file compressed_octree.inl
+* @author Miguel Echeverria , 540000918 , miguel.echeverria@digipen.edu
+* @date 2020/11/07
+* @brief Contains the implementation of the compressed octree.
+*
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+
+namespace cs350 {
+
+    /**
+    * @brief Default constructor, same defaults as octree<T>.
+    */
+    template<typename T>
+    compressed_octree<T>::compressed_octree()
+        :   m_root(nullptr)
+        ,   m_root_size(128u)
+        ,   m_levels(3u)
+        ,   m_interval(cell_interval::closed)
+    {
+    }
+
+
+    /**
+    * @brief Destroys all the existing nodes.
+    */
+    template<typename T>
+    compressed_octree<T>::~compressed_octree()
+    {
+      destroy();
+    }
+
+
+    /**
+    * @brief Deletes every node (the objects are not unlinked, as octree<T>::destroy).
+    */
+    template<typename T>
+    void compressed_octree<T>::destroy()
+    {
+      for (auto const& [code, current] : m_nodes)
+        delete current;
+      m_nodes.clear();
+      m_root = nullptr;
+    }
+
+
+    /**
+    * @brief Finds the node with a locational code.
+    * @param locational_code      The code of the node.
+    * @return node*               The node, or nullptr if it doesn't exist (or was skipped).
+    */
+    template<typename T>
+    typename compressed_octree<T>::node* compressed_octree<T>::find_node(uint32_t locational_code)
+    {
+      auto foundIt = m_nodes.find(locational_code);
+      return foundIt != m_nodes.end() ? foundIt->second : nullptr;
+    }
+
+
+    /**
+    * @brief Finds the node with a locational code.
+    * @param locational_code      The code of the node.
+    * @return node const*         The node, or nullptr if it doesn't exist (or was skipped).
+    */
+    template<typename T>
+    typename compressed_octree<T>::node const* compressed_octree<T>::find_node(uint32_t locational_code) const
+    {
+      auto foundIt = m_nodes.find(locational_code);
+      return foundIt != m_nodes.end() ? foundIt->second : nullptr;
+    }
+
+
+    /**
+    * @brief Finds the deepest existing node whose cell contains the one of a locational code.
+    * @param locational_code      The code to look for.
+    * @return node const*         The deepest node on the path to locational_code, or nullptr if the tree is empty.
+    */
+    template<typename T>
+    typename compressed_octree<T>::node const* compressed_octree<T>::find_deepest(uint32_t locational_code) const
+    {
+      node const* current = m_root;
+      while (current != nullptr && current->locational_code != locational_code)
+      {
+        node const* child = current->children[locational_code_octant(current->locational_code, locational_code)];
+        if (child == nullptr || !is_locational_code_prefix(child->locational_code, locational_code))
+          break;
+        current = child;
+      }
+      return current;
+    }
+
+
+    /**
+    * @brief Computes the locational code of a bv, as octree<T> would with the same parameters.
+    * @param bv           The bounding volume.
+    * @return uint32_t    Its locational code.
+    */
+    template<typename T>
+    uint32_t compressed_octree<T>::locational_code(aabb const& bv) const
+    {
+      return compute_locational_code(bv, m_root_size, m_levels, m_interval);
+    }
+
+
+    /**
+    * @brief Creates a node (not linked to any other) and adds it to the map.
+    * @param locational_code      The code of the node.
+    * @return node*               The new node.
+    */
+    template<typename T>
+    typename compressed_octree<T>::node* compressed_octree<T>::create_node(uint32_t locational_code)
+    {
+      assert(find_node(locational_code) == nullptr);
+
+      node* newNode = new node;
+      newNode->locational_code = locational_code;
+      newNode->depth = locational_code_depth(locational_code);
+      aabb cell = compute_bv(locational_code, m_root_size);
+      newNode->cell_min = glm::ivec3(static_cast<int>(cell.mMinPos.x), static_cast<int>(cell.mMinPos.y), static_cast<int>(cell.mMinPos.z));
+      newNode->cell_max = glm::ivec3(static_cast<int>(cell.mMaxPos.x), static_cast<int>(cell.mMaxPos.y), static_cast<int>(cell.mMaxPos.z));
+      m_nodes[locational_code] = newNode;
+      return newNode;
+    }
+
+
+    /**
+    * @brief Removes a node from the map and deletes it (it must be unlinked already).
+    * @param to_delete    The node to delete.
+    */
+    template<typename T>
+    void compressed_octree<T>::delete_node(node* to_delete)
+    {
+      m_nodes.erase(to_delete->locational_code);
+      if (to_delete == m_root)
+        m_root = nullptr;
+      delete to_delete;
+    }
+
+
+    /**
+    * @brief Makes child the node of its octant in parent.
+    * @param parent       The node above.
+    * @param child        A node whose code has the one of parent as prefix.
+    */
+    template<typename T>
+    void compressed_octree<T>::link(node* parent, node* child)
+    {
+      uint32_t octant = locational_code_octant(parent->locational_code, child->locational_code);
+      parent->children[octant] = child;
+      parent->children_active |= static_cast<uint8_t>(1u << octant);
+      child->parent = parent;
+    }
+
+
+    /**
+    * @brief Restores the invariant after current lost objects or children: nodes without objects are deleted
+    *        if they have no children, and skipped (their child takes their place) if they have a single one.
+    * @param current      The node to check.
+    */
+    template<typename T>
+    void compressed_octree<T>::compact(node* current)
+    {
+      const int dimension = 3;
+      const uint32_t maxChilds = 1u << dimension;
+
+      while (current != nullptr && current->first == nullptr)
+      {
+        uint32_t childCount = 0;
+        node* onlyChild = nullptr;
+        for (uint32_t i = 0; i < maxChilds; ++i)
+        {
+          if (current->children[i] != nullptr)
+          {
+            childCount++;
+            onlyChild = current->children[i];
+          }
+        }
+        if (childCount >= 2)
+          return;
+
+        // The root is only deleted once the tree is empty
+        node* parent = current->parent;
+        if (parent == nullptr)
+        {
+          if (childCount == 0)
+            delete_node(current);
+          return;
+        }
+
+        uint32_t octant = locational_code_octant(parent->locational_code, current->locational_code);
+        if (childCount == 1)
+        {
+          parent->children[octant] = onlyChild;
+          onlyChild->parent = parent;
+          delete_node(current);
+          return;
+        }
+
+        // Without children it goes away, and its parent may be left with a single one
+        parent->children[octant] = nullptr;
+        parent->children_active &= static_cast<uint8_t>(~(1u << octant));
+        delete_node(current);
+        current = parent;
+      }
+    }
+
+
+    /**
+    * @brief Adds object to the node of its bv. The node is created if needed, and so is the node where its
+    *        path splits from an existing one.
+    * @param object       A pointer to the object to add. It must not belong to any node.
+    */
+    template<typename T>
+    void compressed_octree<T>::insert(T* object)
+    {
+      assert(object != nullptr && object->octree_node == nullptr);
+
+      uint32_t code = locational_code(object->bv_world);
+      if (m_root == nullptr)
+        m_root = create_node(1u);
+
+      node* current = m_root;
+      while (current->locational_code != code)
+      {
+        uint32_t octant = locational_code_octant(current->locational_code, code);
+        node* child = current->children[octant];
+        if (child == nullptr)
+        {
+          child = create_node(code);
+          link(current, child);
+          current = child;
+          break;
+        }
+        if (is_locational_code_prefix(child->locational_code, code))
+        {
+          current = child;
+          continue;
+        }
+
+        // The child is below code or off its path, a node where both paths split takes its place
+        node* branch = create_node(common_locational_code(child->locational_code, code));
+        link(current, branch);
+        link(branch, child);
+        current = branch;
+      }
+
+      current->push_front(object);
+      object->octree_node = current;
+    }
+
+
+    /**
+    * @brief Moves an object to the node of its new bv (or inserts it if it isn't in the tree).
+    * @param object       The object to relocate.
+    */
+    template<typename T>
+    void compressed_octree<T>::relocate(T* object)
+    {
+      assert(object != nullptr);
+
+      if (object->octree_node != nullptr)
+      {
+        if (locational_code(object->bv_world) == object->octree_node->locational_code)
+          return;
+        erase(object);
+      }
+      insert(object);
+    }
+
+
+    /**
+    * @brief Removes an object from its node, compacting the tree around it.
+    * @param object       The object to remove.
+    */
+    template<typename T>
+    void compressed_octree<T>::erase(T* object)
+    {
+      assert(object != nullptr && object->octree_node != nullptr);
+
+      node* current = static_cast<node*>(object->octree_node);
+      current->remove(object);
+      compact(current);
+    }
+
+
+    /**
+    * @brief Removes every object from the tree.
+    * @return std::vector<T*>     The removed objects.
+    */
+    template<typename T>
+    std::vector<T*> compressed_octree<T>::take_objects()
+    {
+      std::vector<T*> objects;
+      for (auto const& [code, current] : m_nodes)
+      {
+        for (T* object = current->first; object != nullptr; object = object->octree_next_object)
+          objects.push_back(object);
+      }
+      for (T* object : objects)
+      {
+        object->octree_node = nullptr;
+        object->octree_next_object = nullptr;
+        object->octree_prev_object = nullptr;
+      }
+      destroy();
+      return objects;
+    }
+
+
+    /**
+    * @brief Sets the size of the root, inserting every object again.
+    * @param size         The size of one side of the root bv.
+    */
+    template<typename T>
+    void compressed_octree<T>::set_root_size(uint32_t size)
+    {
+      if (size == m_root_size)
+        return;
+
+      std::vector<T*> objects = take_objects();
+      m_root_size = size;
+      for (T* object : objects)
+        insert(object);
+    }
+
+
+    /**
+    * @brief Sets the maximum depth of the nodes, inserting every object again.
+    * @param levels       The levels.
+    */
+    template<typename T>
+    void compressed_octree<T>::set_levels(uint32_t levels)
+    {
+      if (levels == m_levels)
+        return;
+
+      std::vector<T*> objects = take_objects();
+      m_levels = glm::min(levels, octree<T>::max_depth);
+      for (T* object : objects)
+        insert(object);
+    }
+
+
+    /**
+    * @brief Sets how the cells treat the bvs touching their max faces, inserting every object again.
+    * @param interval     The interval of the cells.
+    */
+    template<typename T>
+    void compressed_octree<T>::set_interval(cell_interval interval)
+    {
+      if (interval == m_interval)
+        return;
+
+      std::vector<T*> objects = take_objects();
+      m_interval = interval;
+      for (T* object : objects)
+        insert(object);
+    }
+
+
+    /**
+    * @brief Computes the longest path from the root to a node, in nodes visited (the traversal depth).
+    * @return uint32_t    The number of links of the longest path.
+    */
+    template<typename T>
+    uint32_t compressed_octree<T>::max_path_length() const
+    {
+      uint32_t longest = 0;
+      for (auto const& [code, current] : m_nodes)
+      {
+        uint32_t length = 0;
+        for (node const* ancestor = current->parent; ancestor != nullptr; ancestor = ancestor->parent)
+          length++;
+        longest = glm::max(longest, length);
+      }
+      return longest;
+    }
+
+
+    /**
+    * @brief Range query: calls function once with every object whose bv intersects the given one. Only the
+    *        nodes whose cell intersects bv are visited (the root always is, it holds the objects outside it).
+    * @param bv           The bounding volume to query.
+    * @param function     Callable taking a T*.
+    */
+    template<typename T>
+    template<typename F>
+    void compressed_octree<T>::query(aabb const& bv, F&& function) const
+    {
+      const int dimension = 3;
+      const uint32_t maxChilds = 1u << dimension;
+
+      if (m_root == nullptr)
+        return;
+
+      std::vector<node const*> toVisit{m_root};
+      while (!toVisit.empty())
+      {
+        node const* current = toVisit.back();
+        toVisit.pop_back();
+
+        for (T* object = current->first; object != nullptr; object = object->octree_next_object)
+        {
+          if (intersection_aabb_aabb(object->bv_world, bv))
+            function(object);
+        }
+
+        for (uint32_t i = 0; i < maxChilds; ++i)
+        {
+          node const* child = current->children[i];
+          if (child != nullptr && intersection_aabb_aabb(aabb(glm::vec3(child->cell_min), glm::vec3(child->cell_max)), bv))
+            toVisit.push_back(child);
+        }
+      }
+    }
+
+
+    /**
+    * @brief Top-down broadphase, as octree<T>::for_each_pair: every pair of objects in the same node, and every
+    *        object of a node against the objects of the descendants whose cell its bv overlaps.
+    * @param function     Callable taking two T*.
+    */
+    template<typename T>
+    template<typename F>
+    void compressed_octree<T>::for_each_pair(F&& function) const
+    {
+      const int dimension = 3;
+      const uint32_t maxChilds = 1u << dimension;
+
+      std::vector<node const*> toVisit;
+      for (auto const& [code, current] : m_nodes)
+      {
+        if (current->first == nullptr)
+          continue;
+
+        // Every pair in the node
+        for (T* object = current->first; object != nullptr; object = object->octree_next_object)
+        {
+          for (T* other = object->octree_next_object; other != nullptr; other = other->octree_next_object)
+            function(object, other);
+        }
+
+        // Every object against the descendants its bv overlaps
+        toVisit.assign(std::begin(current->children), std::end(current->children));
+        while (!toVisit.empty())
+        {
+          node const* child = toVisit.back();
+          toVisit.pop_back();
+          if (child == nullptr)
+            continue;
+          for (uint32_t i = 0; i < maxChilds; ++i)
+            toVisit.push_back(child->children[i]);
+
+          aabb childBV(glm::vec3(child->cell_min), glm::vec3(child->cell_max));
+          for (T* object = current->first; object != nullptr; object = object->octree_next_object)
+          {
+            if (!intersection_aabb_aabb(object->bv_world, childBV))
+              continue;
+            for (T* other = child->first; other != nullptr; other = other->octree_next_object)
+              function(object, other);
+          }
+        }
+      }
+    }
+}
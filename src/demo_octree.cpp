@@ -133,6 +133,12 @@ namespace cs350 {
         // Set the initial root size and levels
         m_octree_dynamic.set_root_size(1u << m_options.octree_size_bit);
         m_octree_dynamic.set_levels(m_options.octree_levels);
+        m_octree_dynamic.set_interval(m_options.half_open_cells ? cell_interval::half_open : cell_interval::closed);
+        m_octree_dynamic.set_adaptive(m_options.adaptive_depth);
+        m_octree_dynamic.set_thresholds(m_options.split_threshold, m_options.split_threshold / 2);
+        m_octree_dynamic.set_node_retention(m_options.retention_frames, m_options.retention_budget_kb * 1024u);
+        m_octree_dynamic.set_multi_cell(m_options.multi_cell_level, m_options.multi_cell_max);
+        set_size_classes();
     }
 
     /**
@@ -198,38 +204,66 @@ namespace cs350 {
             glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
             debug_draw_aabb(obj->bv_world, {1,1,1,0.5f}, debug_draw_type::wireframe);
 
-            {   // OCTREE UPDATE
-
-                uint32_t currentCode = compute_locational_code(obj->bv_world, m_octree_dynamic.root_size(), m_octree_dynamic.levels());
-
-                // If the current object doesn't belong to any octree node, add it
-                if (obj->octree_node == nullptr)
-                {
-                    obj->octree_node = m_octree_dynamic.create_node(currentCode);
-                    obj->octree_node->push_front(obj);
-                }
-
-                // If the current object has a different locational code than the one it used to have (it moved), update it
-                if (obj->octree_node != nullptr &&
-                    obj->octree_node->locational_code != currentCode)
-                {
-                    // Save the node the current obj belongs to
-                    octree<physics_object>::node* oldNode = obj->octree_node;
+            // OCTREE UPDATE
+            // Moves the object to the node it belongs to now (or adds it if it doesn't belong to any)
+            if (m_options.size_classes) {
+                m_size_classes.relocate(obj);
+            } else if (!m_options.parallel_update) {
+                m_octree_dynamic.relocate(obj);
+            }
+        }
 
-                    // Remove it from the object linked list of the node it currently belongs to
-                    obj->octree_node->remove(obj);
+        // Parallel octree update, each worker relocates a contiguous range of the objects
+        if (m_options.parallel_update && !m_options.size_classes) {
+            size_t                   workers = static_cast<size_t>(glm::max(m_options.worker_count, 1));
+            std::vector<std::thread> threads;
+            m_octree_dynamic.set_concurrent(true);
+            for (size_t w = 0; w < workers; ++w) {
+                threads.emplace_back([this, w, workers]() {
+                    size_t begin = m_dynamic_objects.size() * w / workers;
+                    size_t end   = m_dynamic_objects.size() * (w + 1) / workers;
+                    for (size_t i = begin; i < end; ++i) {
+                        m_octree_dynamic.relocate(m_dynamic_objects[i]);
+                    }
+                });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+            // Safe point, the emptied nodes are deleted here
+            m_octree_dynamic.set_concurrent(false);
+        }
 
-                    // If the node obj used to belong to has now 0 objs, and 0 child nodes active, then we can delete it
-                    if (oldNode->first == nullptr && oldNode->children_active == 0)
-                        m_octree_dynamic.delete_node_rec(oldNode->locational_code);
+        // Spread the re-leveling after a change of levels across frames
+        if (m_octree_dynamic.relevel_pending()) {
+            m_octree_dynamic.relevel(static_cast<uint32_t>(m_options.relevel_budget_us));
+        }
 
-                    // Add it to the existing node it moved to, or to a newly created one if it doesn't exist
-                    obj->octree_node = m_octree_dynamic.create_node(currentCode);
-                    obj->octree_node->push_front(obj);
-                }
+        // Re-evaluate the octree parameters periodically, and re-level if they predict many fewer checks
+        if (m_options.auto_tune && !m_options.size_classes && ++m_options.frames_since_tune >= m_options.auto_tune_period) {
+            m_options.frames_since_tune = 0;
+            auto const& tuning          = m_octree_dynamic.auto_tune(m_dynamic_objects.begin(), m_dynamic_objects.end());
+            bool        changed         = tuning.root_size != m_octree_dynamic.root_size() || tuning.levels != m_octree_dynamic.levels();
+            if (changed && tuning.predicted_checks < tuning.current_checks * 9 / 10) {
+                m_options.octree_size_bit = static_cast<int>(glm::log2(tuning.root_size));
+                m_options.octree_levels   = static_cast<int>(tuning.levels);
+                // Lower the levels first, so that they are valid for the new root while its objects are relocated
+                m_octree_dynamic.set_levels(glm::min(tuning.levels, m_octree_dynamic.levels()));
+                m_octree_dynamic.set_root_size(tuning.root_size);
+                m_octree_dynamic.set_levels(tuning.levels);
             }
         }
 
+        // Lay the objects out again in the order of the curve, periodically or once they are scattered enough
+        bool reorderDue = m_options.reorder_period > 0 && ++m_options.frames_since_reorder >= m_options.reorder_period;
+        if (m_options.reorder_threshold > 0.0f) {
+            m_options.disorder = m_object_arena.disorder(m_dynamic_objects, [this](physics_object const* obj) { return curve_key(obj); });
+            reorderDue |= m_options.disorder >= m_options.reorder_threshold;
+        }
+        if (reorderDue) {
+            reorder_objects();
+        }
+
         // Render each object
         glEnable(GL_CULL_FACE);
         glCullFace(GL_BACK);
@@ -255,7 +289,13 @@ namespace cs350 {
 
         // DEBUG DRAW of the specified levels' nodes
         if (m_options.debug_octree) {
-            m_octree_dynamic.debug_draw_levels(m_options.highlight_level);
+            if (m_options.size_classes) {
+                for (size_t i = 0; i < m_size_classes.class_count(); ++i) {
+                    m_size_classes.tree(i).debug_draw_levels(m_options.highlight_level);
+                }
+            } else {
+                m_octree_dynamic.debug_draw_levels(m_options.highlight_level);
+            }
         }
 
         { // All pairs debug
@@ -265,41 +305,33 @@ namespace cs350 {
                         check_intersection(m_dynamic_objects[i], m_dynamic_objects[j]);
                     }
                 }
+            } else if (m_options.size_classes) {
+              // Pairs within each size class, and range queries of each object into the smaller classes
+              m_size_classes.for_each_pair([this](physics_object const* a, physics_object const* b) {
+                  check_intersection(a, b);
+              });
             } else {
-              // Octree all pairs (top-down or bottom up)
-
-              // TOP-DOWN
-
-              // Function to test all pairs collisions between the objects in nodeToTest
-              auto all_pairs_test = [this](octree<physics_object>::node * nodeToTest)
-              {
-                  physics_object * traverser = nodeToTest->first;
-                  // For each object in the current node
-                  while (traverser != nullptr)
-                  {
-                      // For every other object in the current node
-                      physics_object * traverserNext = traverser->octree_next_object;
-                      while (traverserNext != nullptr)
-                      {
-                          // Perform intersection test (debug)
-                          check_intersection(traverser, traverserNext);
-                          traverserNext = traverserNext->octree_next_object;
-                      }
-                      traverser = traverser->octree_next_object;
-                  }
-              };
-
-              const auto & map = m_octree_dynamic.get_map();
-
-              // For each existing node, do all pairs test and then check intersection with child nodes
-              for (auto it = map.begin(); it != map.end(); ++it)
-              {
-                all_pairs_test(it->second);
-                top_down_collision_testing(it->second, it->second);
-              }
+              // Octree all pairs (top-down): each node against itself and the descendants its objects overlap
+              m_octree_dynamic.for_each_pair([this](physics_object const* a, physics_object const* b) {
+                  check_intersection(a, b);
+              });
             }
         }
 
+        // Release the nodes that have been empty for too long
+        m_octree_dynamic.end_frame();
+        m_size_classes.end_frame();
+
+        // Sample the octree (the counters are per frame), and append it to the dump periodically
+        m_options.stats = m_octree_dynamic.stats();
+        m_octree_dynamic.reset_counters();
+        if (m_options.stats_dump_period > 0 && ++m_options.frames_since_dump >= m_options.stats_dump_period) {
+            m_options.frames_since_dump = 0;
+            std::ofstream dump("octree_stats.json", std::ios::app);
+            write_json(dump, m_options.stats);
+            dump << '\n';
+        }
+
         // Help
         if (ImGui::Begin("Help")) {
             ImGui::Text("Help: \n"
@@ -316,14 +348,9 @@ namespace cs350 {
                     m_octree_dynamic.set_levels(m_options.octree_levels);
                 }
 
-                // If octree size changes, orphan everything (forces reinsertion)
-                m_octree_dynamic.destroy();
+                // If octree size changes, every object is relocated into the new cells
                 m_octree_dynamic.set_root_size(1u << m_options.octree_size_bit);
-                for (auto obj : m_dynamic_objects) {
-                    obj->octree_node        = nullptr;
-                    obj->octree_next_object = nullptr;
-                    obj->octree_prev_object = nullptr;
-                }
+                set_size_classes();
             }
 
             if (m_options.octree_levels > m_options.octree_size_bit)
@@ -333,15 +360,63 @@ namespace cs350 {
             }
 
             if (ImGui::SliderInt("Octree levels", &m_options.octree_levels, 1, glm::min(10, m_options.octree_size_bit))) {
-                // If octree max levels changes, orphan everything (forces reinsertion)
-                m_octree_dynamic.destroy();
+                // If octree max levels changes, the nodes are re-leveled in place over the next frames
                 m_octree_dynamic.set_levels(m_options.octree_levels);
-                for (auto obj : m_dynamic_objects) {
-                    obj->octree_node        = nullptr;
-                    obj->octree_next_object = nullptr;
-                    obj->octree_prev_object = nullptr;
+            }
+            if (!m_options.adaptive_depth) {
+                bool multiCellChanged = ImGui::SliderInt("Multi-cell level", &m_options.multi_cell_level, 0, m_options.octree_levels);
+                multiCellChanged |= ImGui::SliderInt("Multi-cell max cells", &m_options.multi_cell_max, 2, 64);
+                if (multiCellChanged) {
+                    // Objects straddling cells above that level are referenced from each cell they overlap,
+                    // the parallel update would put them back in a single node
+                    m_options.parallel_update = m_options.parallel_update && m_options.multi_cell_level == 0;
+                    m_octree_dynamic.set_multi_cell(m_options.multi_cell_level, m_options.multi_cell_max);
                 }
             }
+            ImGui::SliderInt("Relevel budget (us)", &m_options.relevel_budget_us, 50, 5000);
+            bool retentionChanged = ImGui::SliderInt("Empty node frames", &m_options.retention_frames, 0, 240);
+            retentionChanged |= ImGui::SliderInt("Empty node budget (KB)", &m_options.retention_budget_kb, 0, 4096);
+            if (retentionChanged) {
+                m_octree_dynamic.set_node_retention(m_options.retention_frames, m_options.retention_budget_kb * 1024u);
+            }
+            if (m_octree_dynamic.relevel_pending()) {
+                ImGui::Text("Re-leveling...");
+            }
+
+            if (ImGui::Checkbox("Half open cells", &m_options.half_open_cells)) {
+                // If the cell interval changes, orphan everything (forces reinsertion)
+                m_octree_dynamic.set_interval(m_options.half_open_cells ? cell_interval::half_open : cell_interval::closed);
+                orphan_objects();
+            }
+
+            if (ImGui::Checkbox("Adaptive depth", &m_options.adaptive_depth)) {
+                // Nodes are split and merged on the fly, so start from an empty tree
+                m_options.parallel_update = m_options.parallel_update && !m_options.adaptive_depth;
+                m_octree_dynamic.set_adaptive(m_options.adaptive_depth);
+                orphan_objects();
+            }
+
+            // The concurrent mode doesn't split nor merge nodes, nor reference objects from several cells
+            if (!m_options.adaptive_depth && m_options.multi_cell_level == 0) {
+                ImGui::Checkbox("Parallel update", &m_options.parallel_update);
+                if (m_options.parallel_update) {
+                    ImGui::SliderInt("Workers", &m_options.worker_count, 1, 16);
+                }
+            }
+
+            if (m_options.adaptive_depth && ImGui::SliderInt("Split threshold", &m_options.split_threshold, 1, 64)) {
+                // Merge below half the split threshold so that nodes don't thrash between both
+                m_octree_dynamic.set_thresholds(m_options.split_threshold, m_options.split_threshold / 2);
+            }
+
+            ImGui::Checkbox("Auto tune", &m_options.auto_tune);
+            if (m_options.auto_tune) {
+                auto const& tuning = m_octree_dynamic.last_tuning();
+                ImGui::SliderInt("Tune period", &m_options.auto_tune_period, 1, 600);
+                ImGui::Text("Tuned size: %u levels: %u (%u samples)", tuning.root_size, tuning.levels, tuning.sampled_objects);
+                ImGui::Text("Predicted checks: %llu (current %llu)", static_cast<unsigned long long>(tuning.predicted_checks),
+                            static_cast<unsigned long long>(tuning.current_checks));
+            }
 
             ImGui::SliderInt("Highlight level", &m_options.highlight_level, -1, m_options.octree_levels);
 
@@ -349,6 +424,30 @@ namespace cs350 {
             ImGui::Checkbox("Pair debug render", &m_options.debug_intersections);
             ImGui::Checkbox("Physics enabled", &m_options.physics_enabled);
             ImGui::Checkbox("Brute force", &m_options.brute_force);
+            if (ImGui::Checkbox("Size classes", &m_options.size_classes)) {
+                // The objects are inserted in the other broadphase next frame
+                orphan_objects();
+            }
+            if (m_options.size_classes) {
+                bool classesChanged = ImGui::SliderFloat("Small objects", &m_options.size_class_small, 0.5f, 16.0f);
+                classesChanged |= ImGui::SliderFloat("Medium objects", &m_options.size_class_medium, 1.0f, 64.0f);
+                if (classesChanged) {
+                    set_size_classes();
+                }
+                for (size_t i = 0; i < m_size_classes.class_count(); ++i) {
+                    auto const& tree = m_size_classes.tree(i);
+                    ImGui::Text("Class %d: %d levels, %d nodes", int(i), int(tree.levels()), int(tree.get_map().size()));
+                }
+            }
+            ImGui::SliderInt("Stats dump period", &m_options.stats_dump_period, 0, 600);
+            ImGui::SliderInt("Reorder period", &m_options.reorder_period, 0, 600);
+            ImGui::SliderFloat("Reorder disorder", &m_options.reorder_threshold, 0.0f, 1.0f);
+            ImGui::Checkbox("Hilbert order", &m_options.hilbert_order);
+            ImGui::SameLine();
+            if (ImGui::Button("Reorder")) {
+                reorder_objects();
+            }
+            ImGui::Text("Disorder: %.2f (%d objects allocated since)", m_options.disorder, int(m_object_arena.spilled_count()));
             if (ImGui::Button("Random")) {
                 for (int i = 0; i < 10; ++i) {
                     float boundary = m_octree_dynamic.root_size();
@@ -358,13 +457,40 @@ namespace cs350 {
                     float r = glm::linearRand(0.5f, 2.0f);
 
                     // Create
-                    auto obj      = new physics_object;
+                    auto obj      = m_object_arena.create();
                     obj->position = p;
                     obj->velocity = v;
                     obj->radius   = r;
                     m_dynamic_objects.push_back(obj);
                 }
             }
+            ImGui::SameLine();
+            if (ImGui::Button("Large")) {
+                // A few big objects among the small ones, the case size classes are for
+                for (int i = 0; i < 3; ++i) {
+                    float boundary = m_octree_dynamic.root_size();
+                    boundary -= 5.0f;
+                    auto obj      = m_object_arena.create();
+                    obj->position = glm::linearRand(glm::vec3(boundary) * -0.5f, glm::vec3(boundary) * 0.5f);
+                    obj->velocity = glm::ballRand(glm::linearRand(1.0f, 5.0f));
+                    obj->radius   = glm::linearRand(4.0f, 12.0f);
+                    m_dynamic_objects.push_back(obj);
+                }
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Grid")) {
+                // Static floor of 2x2x2 tiles laid on the even integer grid, touching each other (grid-aligned level data)
+                int extent = glm::min(32, static_cast<int>(m_octree_dynamic.root_size() / 2) - 2);
+                for (int x = -extent; x < extent; x += 2) {
+                    for (int z = -extent; z < extent; z += 2) {
+                        auto obj      = m_object_arena.create();
+                        obj->position = glm::vec3(static_cast<float>(x + 1), 1.0f, static_cast<float>(z + 1));
+                        obj->velocity = glm::vec3(0.0f);
+                        obj->radius   = 1.0f;
+                        m_dynamic_objects.push_back(obj);
+                    }
+                }
+            }
 
             // Keep track of checks
             m_options.checks_history.push_back((float)m_options.checks_this_frame);
@@ -374,9 +500,25 @@ namespace cs350 {
             m_options.checks_this_frame = 0;
 
             ImGui::Text("Objects: %d", int(m_dynamic_objects.size()));
+            auto const& stats = m_options.stats;
+            ImGui::Text("Octree nodes: %d (+%d -%d)", int(stats.node_count), int(stats.counters.nodes_created), int(stats.counters.nodes_deleted));
+            ImGui::Text("Objects per node: %.2f mean, %d max", stats.mean_objects_per_node, int(stats.max_objects_per_node));
+            ImGui::Text("Map load: %.2f, probes %.2f mean, %d max", stats.load_factor, stats.mean_probe_length, int(stats.max_probe_length));
+            ImGui::Text("Octree memory: %.1f KB", stats.memory_bytes / 1024.0f);
+
+            // Fraction of the relocations that were skipped by the cell bounds test
+            auto const& counters = stats.counters;
+            float skipped = counters.relocations != 0 ? static_cast<float>(counters.skipped_relocations) / counters.relocations : 0.0f;
+            ImGui::Text("Skipped code updates: %.1f%%", skipped * 100.0f);
+            ImGui::Text("Reinsertions: %d", int(counters.reinsertions));
             ImGui::Text("Intersection checks: %d", int(m_options.checks_history.back()));
             ImGui::PlotLines("", m_options.checks_history.data(), m_options.checks_history.size(), 0, "", 0, FLT_MAX, ImVec2(0, 64));
             ImGui::Text("Max: %d", static_cast<int>(*std::max_element(m_options.checks_history.begin(), m_options.checks_history.end())));
+
+            // Distribution of the objects among the levels of the octree
+            for (size_t level = 0; level < stats.objects_per_level.size(); ++level) {
+                ImGui::Text("Level %d: %d objects, %d nodes", int(level), int(stats.objects_per_level[level]), int(stats.nodes_per_level[level]));
+            }
         }
         ImGui::End();
 
@@ -396,14 +538,62 @@ namespace cs350 {
     void demo_octree::destroy()
     {
         // Delete the memory of the created objects
-        for (auto it = m_dynamic_objects.begin(); it != m_dynamic_objects.end(); ++it)
-        {
-            delete *it;
-            *it = nullptr;
-        }
-
         m_dynamic_objects.clear();
         m_octree_dynamic.destroy();
+        m_size_classes.destroy();
+        m_object_arena.destroy();
+    }
+
+    /**
+	 * @brief
+	 *  Destroys the octree nodes and unlinks every object, so that all of them are reinserted next frame
+	 */
+    void demo_octree::orphan_objects()
+    {
+        m_octree_dynamic.destroy();
+        m_size_classes.destroy();
+        for (auto obj : m_dynamic_objects) {
+            obj->octree_node        = nullptr;
+            obj->octree_next_object = nullptr;
+            obj->octree_prev_object = nullptr;
+        }
+    }
+
+    /**
+	 * @brief
+	 *  Applies the size class options (and the root size) to the size class broadphase
+	 */
+    void demo_octree::set_size_classes()
+    {
+        float medium = glm::max(m_options.size_class_medium, m_options.size_class_small);
+        m_size_classes.set_classes(1u << m_options.octree_size_bit, {m_options.size_class_small, medium}, 10);
+    }
+
+    /**
+	 * @brief
+	 *  Moves the objects into a single block sorted along the curve (so that objects close in space are close
+	 *  in memory), and patches the links of the octrees to them
+	 */
+    void demo_octree::reorder_objects()
+    {
+        m_options.frames_since_reorder = 0;
+        m_object_arena.compact(m_dynamic_objects, [this](physics_object const* obj) { return curve_key(obj); }, [this](auto remap) {
+            m_octree_dynamic.remap_objects(remap);
+            m_size_classes.remap_objects(remap);
+        });
+        m_options.disorder = 0.0f;
+    }
+
+    /**
+	 * @brief
+	 *  Code of the position of an object along the curve used to reorder them, on the finest grid that fits
+	 * @param obj
+	 * @return uint32_t
+	 */
+    uint32_t demo_octree::curve_key(physics_object const* obj) const
+    {
+        auto curve = m_options.hilbert_order ? space_filling_curve::hilbert : space_filling_curve::morton;
+        return curve_code<3>(obj->position, m_octree_dynamic.root_size(), octree<physics_object>::max_depth, curve);
     }
 
     /**
@@ -415,7 +605,7 @@ namespace cs350 {
         auto        camera_dir      = camera.get_target() - camera.get_position();
         auto        camera_position = camera.get_position();
 
-        auto obj = new physics_object;
+        auto obj = m_object_arena.create();
 
         obj->position = camera_position;
         obj->velocity = camera_dir * v;
@@ -503,53 +693,4 @@ namespace cs350 {
             camera.update_all_mtx();
         }
     }
-
-    
-    /**
-    * @brief Recursive function to check collision between a node its children nodes it overlaps with.
-    * @param start      The pointer to the current node whose childs we are to test against (with original).
-    *                   (This goes down the hierarchy as recursion continues)
-    * @param original   The original node before starting recursion, to check with it against each sub-child.
-    */
-    void demo_octree::top_down_collision_testing(octree<physics_object>::node * start, octree<physics_object>::node * original)
-    {
-      const int dimension = 3;
-      uint32_t maxChilds = 1u << dimension;
-
-      // For each child node of start
-      for (uint32_t i = 0; i < maxChilds; ++i)
-      {
-        // If the current child node exists
-        uint8_t childExists = start->children_active & (1u << i);
-        if (childExists)
-        {
-          // Get the code, node and bounding volume of the current child
-          uint32_t childCode = (start->locational_code << dimension) + i;
-          octree<physics_object>::node * childNode = m_octree_dynamic.find_node(childCode);
-          const aabb & childBV = compute_bv(childCode, m_octree_dynamic.root_size());
-
-          // For each object in the original node
-          physics_object * traverser = original->first;
-          while (traverser != nullptr)
-          {
-            // If bv of the current object in start, intersects the bv of the current child node
-            if (intersection_aabb_aabb(traverser->bv_world, childBV))
-            {
-              // For each object in the current child node
-              physics_object * childTraverser = childNode->first;
-              while (childTraverser != nullptr)
-              {
-                check_intersection(traverser, childTraverser);
-                childTraverser = childTraverser->octree_next_object;
-              }
-            }
-
-            traverser = traverser->octree_next_object;
-          }
-
-          // Recurse into the current child
-          top_down_collision_testing(childNode, original);
-        }
-      }
-    }
 }
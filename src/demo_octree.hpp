@@ -3,6 +3,8 @@
 #include "camera.hpp"
 #include "window.hpp"
 #include "octree.hpp"
+#include "size_class_broadphase.hpp"
+#include "spatial_reorder.hpp"
 
 namespace cs350 {
     /**
@@ -36,6 +38,8 @@ namespace cs350 {
         //
         octree<physics_object>       m_octree_dynamic;
         std::vector<physics_object*> m_dynamic_objects;
+        object_arena<physics_object> m_object_arena;    // Owns the objects, see reorder_objects
+        size_class_broadphase<physics_object> m_size_classes;  // Used instead of m_octree_dynamic when enabled
 
         // Imgui options
         struct
@@ -46,11 +50,35 @@ namespace cs350 {
             int  octree_size_bit{7};
             int  octree_levels{3};
             bool brute_force{false};
+            bool half_open_cells{false};
+            bool adaptive_depth{false};
+            int  split_threshold{8};
+            bool auto_tune{false};
+            int  auto_tune_period{120}; // In frames
+            int  frames_since_tune{0};
+            int  relevel_budget_us{500};
             int  highlight_level{-1};
+            int  multi_cell_level{0};  // 0 disables it
+            int  multi_cell_max{8};
+            int  retention_frames{30};
+            int  retention_budget_kb{256};
+            bool parallel_update{false};
+            int  worker_count{4};
+            bool size_classes{false};
+            float size_class_small{4.0f};   // Largest side of the objects in the first class
+            float size_class_medium{16.0f}; // Same for the second class, the rest go to a third one
+            int  stats_dump_period{0}; // In frames, 0 disables it
+            int  frames_since_dump{0};
+            int  reorder_period{0};        // In frames, 0 disables it
+            float reorder_threshold{0.0f}; // Disorder of the objects that triggers a reorder, 0 disables it
+            bool hilbert_order{false};
+            int  frames_since_reorder{0};
+            float disorder{0.0f};
 
             // Performance counters
             int                checks_this_frame{};
             std::vector<float> checks_history;
+            octree_stats       stats;
         } m_options;
 
       public:
@@ -58,12 +86,13 @@ namespace cs350 {
         void create();
         bool update();
         void destroy();
+        void orphan_objects();
         void shoot(float v);
         void check_intersection(physics_object const* a, physics_object const* b);
         void update_camera(float dt);
-
-        // Recursive function to check collision between a node its children nodes it overlaps with
-        void top_down_collision_testing(octree<physics_object>::node * start, octree<physics_object>::node * original);
+        void set_size_classes();
+        void reorder_objects();
+        uint32_t curve_key(physics_object const* obj) const;
 
         decltype(m_options)& options() { return m_options; }
     };
@@ -757,6 +757,60 @@ namespace cs350
     }
 
 
+    /**
+    * @brief Returns true if the triangle and the aabb are intersecting, using the separating axis
+    *        theorem (Akenine-Moller): the 3 axes of the box, the normal of the triangle and the
+    *        9 cross products of their edges. Touching counts as intersecting.
+    * @param tri      The triangle to check intersection with.
+    * @param box      The aabb to check intersection with.
+    * @return bool    True if they intersect, false otherwise.
+    */
+    bool intersection_triangle_aabb(const triangle & tri, const aabb & box)
+    {
+        // Move everything so that the box is centered at the origin
+        const glm::vec3 center = (box.mMinPos + box.mMaxPos) * 0.5f;
+        const glm::vec3 halfExtents = (box.mMaxPos - box.mMinPos) * 0.5f;
+        const glm::vec3 vertices[3] = { tri.mPos1 - center, tri.mPos2 - center, tri.mPos3 - center };
+        const glm::vec3 edges[3] = { vertices[1] - vertices[0], vertices[2] - vertices[1], vertices[0] - vertices[2] };
+
+        // Whether the projections of the triangle and the box on axis don't overlap
+        auto separated = [&](const glm::vec3 & axis)
+        {
+            float p0 = glm::dot(vertices[0], axis);
+            float p1 = glm::dot(vertices[1], axis);
+            float p2 = glm::dot(vertices[2], axis);
+            float radius = halfExtents.x * glm::abs(axis.x) + halfExtents.y * glm::abs(axis.y) + halfExtents.z * glm::abs(axis.z);
+            return glm::min(p0, glm::min(p1, p2)) > radius || glm::max(p0, glm::max(p1, p2)) < -radius;
+        };
+
+        // The axes of the box, the same as comparing the bounds of the triangle with the box
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            glm::vec3 boxAxis(0.0f);
+            boxAxis[axis] = 1.0f;
+            if (separated(boxAxis))
+                return false;
+        }
+
+        // The normal of the triangle
+        if (separated(glm::cross(edges[0], edges[1])))
+            return false;
+
+        // The cross products of the edges with the axes of the box (a zero vector never separates)
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            glm::vec3 boxAxis(0.0f);
+            boxAxis[axis] = 1.0f;
+            for (const glm::vec3 & edge : edges)
+                if (separated(glm::cross(boxAxis, edge)))
+                    return false;
+        }
+
+        // At this point, we know they are intersecting
+        return true;
+    }
+
+
     /**
     * @brief Returns the t parameter of the equation O + tv, being O the origin
     *        of the ray, and v its direction. Returns -1 if the ray is parallel
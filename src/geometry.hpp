@@ -164,6 +164,7 @@ namespace cs350 {
     bool intersection_sphere_sphere(const sphere & sphere1, const sphere & sphere2);
     bool intersection_point_aabb(const glm::vec3 & point, const aabb & aabb_);
     bool intersection_aabb_aabb(const aabb & box1, const aabb & box2);
+    bool intersection_triangle_aabb(const triangle & tri, const aabb & box);
     float intersection_ray_plane(const ray & ray_, const plane & plane_);
     float intersection_ray_aabb(const ray & ray_, const aabb & box);
     float intersection_ray_sphere(const ray & ray_, const sphere & sphere_);
@@ -43,8 +43,9 @@ namespace cs350
     * @param  vertices_data      The data of the vertices and all their attributes.
     *                            IMPORTANT: This data should not be used after calling this
     *                            function, since it moves it to an internal mesh_data.
+    * @param  bvh_method         The method used to construct the bvh of the mesh (top down by default).
     */
-    void mesh::setup_mesh(const mesh_data & vertices_data)
+    void mesh::setup_mesh(const mesh_data & vertices_data, bvh_construction_method bvh_method)
     {
         // Generate a Vertex Array Object and bind it
         glGenVertexArrays(1, &mVAO);
@@ -79,7 +80,7 @@ namespace cs350
         mData = std::move(vertices_data);
 
         // Construct the bvh with the appropriate method
-        mBVH.construct_bvh(mData, bvh_construction_method::top_down);
+        mBVH.construct_bvh(mData, bvh_method);
     }
 
 
@@ -51,7 +51,7 @@ namespace cs350 {
 
         ~mesh();
 
-        void setup_mesh(const mesh_data & vertices_data);
+        void setup_mesh(const mesh_data & vertices_data, bvh_construction_method bvh_method = bvh_construction_method::top_down);
 
         void bind() const;
         void unbind() const;
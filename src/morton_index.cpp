@@ -0,0 +1,235 @@
+/**
+* @file morton_index.cpp
+* @author Miguel Echeverria , 540000918 , miguel.echeverria@digipen.edu
+* @date 2020/11/07
+* @brief Contains the BIGMIN/LITMAX computations and the construction of the morton index.
+*
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+
+#include "pch.hpp"
+#include "morton_index.hpp"
+
+namespace cs350 {
+
+    // Bits of the x axis in an interleaved code (bit i of axis a is bit 3i + a), for 10 bits per axis
+    static const uint32_t morton_axis_bits = 0x09249249u;
+
+
+    /**
+    * @brief Computes BIGMIN, the smallest code greater than code that is inside the box given by its min and
+    *        max codes. Goes from the highest bit down, comparing code with the min and max of the box on that
+    *        bit, and splitting the box in two at that bit when its min and max differ there (Tropf and Herzog).
+    * @param code             A code between min_code and max_code which is outside the box.
+    * @param min_code         The code of the min corner of the box.
+    * @param max_code         The code of the max corner of the box.
+    * @param bits             The number of bits of the codes (3 per level).
+    * @return uint32_t        The BIGMIN of code.
+    */
+    uint32_t morton_bigmin(uint32_t code, uint32_t min_code, uint32_t max_code, uint32_t bits)
+    {
+      const int dimension = 3;
+
+      uint32_t bigmin = min_code;
+      for (uint32_t i = bits; i-- > 0;)
+      {
+        uint32_t bit = 1u << i;
+        // The lower bits of the same axis as bit
+        uint32_t lowerAxisBits = (morton_axis_bits << (i % dimension)) & (bit - 1);
+
+        bool codeBit = code & bit;
+        bool minBit  = min_code & bit;
+        bool maxBit  = max_code & bit;
+
+        if (!codeBit && !minBit && maxBit)
+        {
+          // The upper half of the box is a candidate, code goes on into the lower half
+          bigmin   = (min_code & ~lowerAxisBits) | bit;
+          max_code = (max_code & ~bit) | lowerAxisBits;
+        }
+        else if (!codeBit && minBit && maxBit)
+          return min_code;
+        else if (codeBit && !minBit && !maxBit)
+          return bigmin;
+        else if (codeBit && !minBit && maxBit)
+          min_code = (min_code & ~lowerAxisBits) | bit;
+      }
+      return bigmin;
+    }
+
+
+    /**
+    * @brief Computes LITMAX, the largest code smaller than code that is inside the box given by its min and
+    *        max codes (the symmetric of BIGMIN).
+    * @param code             A code between min_code and max_code which is outside the box.
+    * @param min_code         The code of the min corner of the box.
+    * @param max_code         The code of the max corner of the box.
+    * @param bits             The number of bits of the codes (3 per level).
+    * @return uint32_t        The LITMAX of code.
+    */
+    uint32_t morton_litmax(uint32_t code, uint32_t min_code, uint32_t max_code, uint32_t bits)
+    {
+      const int dimension = 3;
+
+      uint32_t litmax = max_code;
+      for (uint32_t i = bits; i-- > 0;)
+      {
+        uint32_t bit = 1u << i;
+        uint32_t lowerAxisBits = (morton_axis_bits << (i % dimension)) & (bit - 1);
+
+        bool codeBit = code & bit;
+        bool minBit  = min_code & bit;
+        bool maxBit  = max_code & bit;
+
+        if (!codeBit && !minBit && maxBit)
+          max_code = (max_code & ~bit) | lowerAxisBits;
+        else if (!codeBit && minBit && maxBit)
+          return litmax;
+        else if (codeBit && !minBit && !maxBit)
+          return max_code;
+        else if (codeBit && !minBit && maxBit)
+        {
+          // The lower half of the box is a candidate, code goes on into the upper half
+          litmax   = (max_code & ~bit) | lowerAxisBits;
+          min_code = (min_code & ~lowerAxisBits) | bit;
+        }
+      }
+      return litmax;
+    }
+
+
+    /**
+    * @brief Checks whether a code is inside the box given by its min and max codes, comparing the bits of
+    *        each axis on their own (they keep their order when masked).
+    * @param code             The code to check.
+    * @param min_code         The code of the min corner of the box.
+    * @param max_code         The code of the max corner of the box.
+    * @return bool            Whether the cell of code is inside the box.
+    */
+    bool morton_in_box(uint32_t code, uint32_t min_code, uint32_t max_code)
+    {
+      const int dimension = 3;
+
+      for (int axis = 0; axis < dimension; ++axis)
+      {
+        uint32_t axisBits = morton_axis_bits << axis;
+        if ((code & axisBits) < (min_code & axisBits) || (code & axisBits) > (max_code & axisBits))
+          return false;
+      }
+      return true;
+    }
+
+
+    /**
+    * @brief Builds the index for the given bounding volumes, an object for each one whose index is its position.
+    * @param bvs          The bounding volumes of the objects.
+    * @param root_size    The size of one side of the root bv.
+    * @param levels       The number of levels of the tree.
+    * @param interval     How the max corner of the bvs is mapped onto the leaf grid.
+    */
+    void morton_index::build(std::vector<aabb> const& bvs, uint32_t root_size, uint32_t levels, cell_interval interval)
+    {
+      std::vector<entry> entries(bvs.size());
+      for (size_t i = 0; i < bvs.size(); ++i)
+        entries[i] = {compute_locational_code(bvs[i], root_size, levels, interval), static_cast<uint32_t>(i), bvs[i]};
+
+      build(entries, root_size, levels, interval);
+    }
+
+
+    /**
+    * @brief Splits the objects by the depth of their locational code and sorts each depth by code.
+    * @param entries      The objects with their locational codes (sorted in place).
+    * @param root_size    The size of one side of the root bv.
+    * @param levels       The number of levels of the tree.
+    * @param interval     How the max corner of the bvs is mapped onto the leaf grid.
+    */
+    void morton_index::build(std::vector<entry>& entries, uint32_t root_size, uint32_t levels, cell_interval interval)
+    {
+      const int dimension = 3;
+
+      clear();
+      m_root_size = root_size;
+      m_levels = levels;
+      m_interval = interval;
+
+      // The sentinel bit is higher for deeper codes, so sorting by code also groups them by depth
+      std::stable_sort(entries.begin(), entries.end(), [](entry const& lhs, entry const& rhs)
+      {
+        return lhs.locational_code < rhs.locational_code;
+      });
+
+      m_depths.resize(levels + 1);
+      for (entry const& current : entries)
+      {
+        uint32_t depth = (std::bit_width(current.locational_code) - 1) / dimension;
+        if (depth >= m_depths.size())
+          m_depths.resize(depth + 1);
+
+        depth_entries& target = m_depths[depth];
+        target.codes.push_back(current.locational_code ^ (1u << (depth * dimension)));
+        target.indices.push_back(current.index);
+        target.bvs.push_back(current.bv);
+      }
+    }
+
+
+    /**
+    * @brief Releases the objects, the index is left empty.
+    */
+    void morton_index::clear()
+    {
+      m_depths.clear();
+    }
+
+
+    /**
+    * @brief Number of objects in the index.
+    * @return size_t      The object count.
+    */
+    size_t morton_index::size() const
+    {
+      size_t count = 0;
+      for (depth_entries const& current : m_depths)
+        count += current.codes.size();
+      return count;
+    }
+
+
+    /**
+    * @brief Computes the box of cells (as the codes of its min and max corners) at some depth whose objects
+    *        may intersect bv. Objects may overhang their cell by less than a unit, so bv is grown by one.
+    * @param bv           The volume to query.
+    * @param depth        The depth of the cells, greater than 0.
+    * @param min_code     Output, the code (without sentinel) of the min corner.
+    * @param max_code     Output, the code (without sentinel) of the max corner.
+    * @return bool        False when bv does not reach the root, so there are no cells.
+    */
+    bool morton_index::cell_range(aabb const& bv, uint32_t depth, uint32_t& min_code, uint32_t& max_code) const
+    {
+      const int dimension = 3;
+
+      aabb grown = bv;
+      grown.mMinPos -= glm::vec3(1.0f);
+      grown.mMaxPos += glm::vec3(1.0f);
+
+      glm::ivec3 minCorner;
+      glm::ivec3 maxCorner;
+      compute_grid_corners(grown, cell_interval::closed, minCorner, maxCorner);
+
+      // Clamp to the root, where every position gives a code
+      int halfSize = static_cast<int>(m_root_size / 2);
+      for (int axis = 0; axis < dimension; ++axis)
+      {
+        if (minCorner[axis] >= halfSize || maxCorner[axis] < -halfSize)
+          return false;
+        minCorner[axis] = glm::max(minCorner[axis], -halfSize);
+        maxCorner[axis] = glm::min(maxCorner[axis], halfSize - 1);
+      }
+
+      uint32_t sentinel = 1u << (depth * dimension);
+      min_code = compute_locational_code<dimension>(minCorner, m_root_size, depth) ^ sentinel;
+      max_code = compute_locational_code<dimension>(maxCorner, m_root_size, depth) ^ sentinel;
+      return true;
+    }
+}
@@ -0,0 +1,71 @@
+/**
+* @file morton_index.hpp
+* @author Miguel Echeverria , 540000918 , miguel.echeverria@digipen.edu
+* @date 2020/11/07
+* @brief Contains the declaration of the morton index, which answers box queries over arrays
+*        of objects sorted by locational code with the BIGMIN/LITMAX algorithm.
+*
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+
+#pragma once
+#include "octree.hpp"
+
+namespace cs350 {
+
+    uint32_t morton_bigmin(uint32_t code, uint32_t min_code, uint32_t max_code, uint32_t bits);
+    uint32_t morton_litmax(uint32_t code, uint32_t min_code, uint32_t max_code, uint32_t bits);
+    bool     morton_in_box(uint32_t code, uint32_t min_code, uint32_t max_code);
+
+    /**
+     * @brief
+     * 	Objects sorted by the locational code (without sentinel, so the Morton code of their cell) of the node
+     *  they would be in, one array per depth. A box query covers a range of cells at each depth, that is a
+     *  range of codes [min, max] that also holds codes outside the box: it is answered by binary partition of
+     *  the array, where a code outside the box splits the range into [min, LITMAX] and [BIGMIN, max], the
+     *  largest and smallest codes inside the box before and after it. The objects in the root are tested always.
+     */
+    class morton_index
+    {
+      public:
+        void build(std::vector<aabb> const& bvs, uint32_t root_size, uint32_t levels, cell_interval interval = cell_interval::closed);
+        template <typename T, typename IndexOf>
+        void build(octree<T> const& tree, IndexOf index_of);
+        void clear();
+
+        template <typename F>
+        void query(aabb const& bv, F&& function) const;
+
+        [[nodiscard]] bool          empty() const { return m_depths.empty(); }
+        [[nodiscard]] size_t        size() const;
+        [[nodiscard]] uint32_t      root_size() const { return m_root_size; }
+        [[nodiscard]] uint32_t      levels() const { return m_levels; }
+        [[nodiscard]] cell_interval interval() const { return m_interval; }
+
+      private:
+        struct entry
+        {
+            uint32_t locational_code;
+            uint32_t index;
+            aabb     bv;
+        };
+
+        // The objects whose node is at one depth, sorted by code
+        struct depth_entries
+        {
+            std::vector<uint32_t> codes;
+            std::vector<uint32_t> indices;
+            std::vector<aabb>     bvs;
+        };
+
+        void build(std::vector<entry>& entries, uint32_t root_size, uint32_t levels, cell_interval interval);
+        bool cell_range(aabb const& bv, uint32_t depth, uint32_t& min_code, uint32_t& max_code) const;
+
+        std::vector<depth_entries> m_depths;     // One per depth, 0 to levels
+        uint32_t                   m_root_size{0};
+        uint32_t                   m_levels{0};
+        cell_interval              m_interval{cell_interval::closed};
+    };
+}
+
+#include "morton_index.inl"
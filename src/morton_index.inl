@@ -0,0 +1,118 @@
+/**
+* @file morton_index.inl
+* @author Miguel Echeverria , 540000918 , miguel.echeverria@digipen.edu
+* @date 2020/11/07
+* @brief Contains the template functions of the morton index.
+*
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+
+namespace cs350 {
+
+    /**
+    * @brief Builds the index from the current state of a dynamic octree, with the same root size, levels
+    *        and interval. Multi-cell objects are stored once, with the code of the node that contains their whole bv.
+    * @param tree          The octree to copy.
+    * @param index_of      Callable returning the uint32_t index of an object (given a T const*).
+    */
+    template<typename T, typename IndexOf>
+    void morton_index::build(octree<T> const& tree, IndexOf index_of)
+    {
+      std::vector<entry> entries;
+      for (auto const& [code, current] : tree.get_map())
+      {
+        for (T const* object = current->first; object != nullptr; object = object->octree_next_object)
+        {
+          uint32_t objectCode = tree.multi_cell_objects() != 0 ? common_locational_code(code, tree.locational_code(object->bv_world)) : code;
+          entries.push_back({objectCode, static_cast<uint32_t>(index_of(object)), object->bv_world});
+        }
+      }
+
+      build(entries, tree.root_size(), tree.levels(), tree.interval());
+    }
+
+
+    /**
+    * @brief Calls function with the index of every object whose bv intersects bv. At each depth the codes of
+    *        the cells bv covers are a range [min, max] of the sorted codes, searched by halving: the middle
+    *        entry of a range is either inside the box, or splits the range into [min, LITMAX] and [BIGMIN, max]
+    *        so the codes between LITMAX and BIGMIN are skipped. Short ranges are scanned instead.
+    * @param bv            The volume to query.
+    * @param function      Callable taking the uint32_t index of an object.
+    */
+    template<typename F>
+    void morton_index::query(aabb const& bv, F&& function) const
+    {
+      const int dimension = 3;
+      const uint32_t scanLength = 8;
+
+      struct code_range
+      {
+        uint32_t first;
+        uint32_t last;
+        uint32_t min_code;
+        uint32_t max_code;
+      };
+      std::vector<code_range> toVisit;
+
+      for (uint32_t depth = 0; depth < m_depths.size(); ++depth)
+      {
+        depth_entries const& entries = m_depths[depth];
+        auto testEntry = [&](uint32_t i)
+        {
+          if (intersection_aabb_aabb(bv, entries.bvs[i]))
+            function(entries.indices[i]);
+        };
+
+        // The root holds the objects outside of it as well
+        if (depth == 0)
+        {
+          for (uint32_t i = 0; i < entries.codes.size(); ++i)
+            testEntry(i);
+          continue;
+        }
+
+        uint32_t minCode;
+        uint32_t maxCode;
+        if (entries.codes.empty() || !cell_range(bv, depth, minCode, maxCode))
+          continue;
+
+        uint32_t bits = depth * dimension;
+        toVisit.push_back({0u, static_cast<uint32_t>(entries.codes.size()), minCode, maxCode});
+        while (!toVisit.empty())
+        {
+          code_range current = toVisit.back();
+          toVisit.pop_back();
+
+          // Only the entries with codes in [min, max] are left
+          uint32_t const* codes = entries.codes.data();
+          uint32_t first = static_cast<uint32_t>(std::lower_bound(codes + current.first, codes + current.last, current.min_code) - codes);
+          uint32_t last  = static_cast<uint32_t>(std::upper_bound(codes + first, codes + current.last, current.max_code) - codes);
+          if (first >= last)
+            continue;
+
+          if (last - first <= scanLength)
+          {
+            for (uint32_t i = first; i < last; ++i)
+              if (morton_in_box(codes[i], minCode, maxCode))
+                testEntry(i);
+            continue;
+          }
+
+          uint32_t middle = first + (last - first) / 2;
+          uint32_t code = codes[middle];
+          if (morton_in_box(code, minCode, maxCode))
+          {
+            testEntry(middle);
+            toVisit.push_back({first, middle, current.min_code, current.max_code});
+            toVisit.push_back({middle + 1, last, current.min_code, current.max_code});
+          }
+          else
+          {
+            toVisit.push_back({first, middle, current.min_code, morton_litmax(code, minCode, maxCode, bits)});
+            toVisit.push_back({middle + 1, last, morton_bigmin(code, minCode, maxCode, bits), current.max_code});
+          }
+        }
+      }
+    }
+}
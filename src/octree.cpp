@@ -40,6 +40,7 @@ namespace cs350 {
     * @param lc2          The second locational code.
     * @return uint32_t    The common locational code.
     */
+    template <int dimension>
     uint32_t common_locational_code(uint32_t lc1, uint32_t lc2)
     {
       // Optimization: return one of them right away if they are identical
@@ -50,7 +51,6 @@ namespace cs350 {
       uint32_t commonCode = 0;                      // The common locational code that we will return
       int sentinel1Index = -1;                      // The index of the sentinel bit of lc1
       int sentinel2Index = -1;                      // The index of the sentinel bit of lc2
-      const int dimension = 3;                      // Assume the dimension is 3 (only valid for octrees)
       
       // Find the index of the sentinel bit in each of the codes
       for (int i = totalBits - 1; i >= 0; --i)
@@ -125,11 +125,13 @@ namespace cs350 {
 
 
     /**
-    * @brief Computes the bounding volume of the node corresponding to locational_code.
+    * @brief Computes the bounding volume of the node corresponding to locational_code. The axes the
+    *        codes don't use (z for quadtrees) span the whole root.
     * @param locational_node    The locational code of node whose bounding volume we have to compute.
     * @param root_size          The size of the side of the root's bounding volume.
     * @return aabb              The bounding volume of the of node with code locational_code.
     */
+    template <int dimension>
     aabb compute_bv(uint32_t locational_code, uint32_t root_size)
     {
       // Start with the bv as the bv of the root
@@ -137,8 +139,7 @@ namespace cs350 {
       aabb result(glm::vec3(static_cast<float>(-halfSize)), glm::vec3(static_cast<float>(halfSize)));
 
       // Compute the necessary variables for the loop (namely the index of the sentinel bit)
-      const int dimension = 3;
-      uint32_t depth = locational_code_depth(locational_code);
+      uint32_t depth = locational_code_depth<dimension>(locational_code);
       uint32_t sentinelIndex = depth * dimension;
 
       // From the sentinel bit, until the end of the bit string
@@ -151,10 +152,10 @@ namespace cs350 {
 
           // Handle case in which it is 1
           if (isBitOne)
-            result.mMinPos[axis] += root_size >> ((sentinelIndex - 1 - i) / 3 + 1);
+            result.mMinPos[axis] += root_size >> ((sentinelIndex - 1 - i) / dimension + 1);
           // Handle case in which it is 0
           else
-            result.mMaxPos[axis] -= root_size >> ((sentinelIndex - 1 - i) / 3 + 1);
+            result.mMaxPos[axis] -= root_size >> ((sentinelIndex - 1 - i) / dimension + 1);
         }
       }
 
@@ -167,10 +168,10 @@ namespace cs350 {
     * @param lc               The locational code from which we will read the number of levels.
     * @return uint32_t        The depth indicated by lc.
     */
+    template <int dimension>
     uint32_t locational_code_depth(uint32_t lc)
     {
       uint32_t totalBits = sizeof(uint32_t) * 8;    // The total number of bits that the code can have
-      const int dimension = 3;                      // The dimension, in case we decide to use a quadtree or something else
 
       // Find the index of the sentinel bit in the code
       for (int i = totalBits - 1; i >= 0; --i)
@@ -188,30 +189,249 @@ namespace cs350 {
     }
 
 
+    /**
+    * @brief Checks whether a locational code is a prefix of (or equal to) another one.
+    * @param ancestor     The possible ancestor.
+    * @param lc           The code to check.
+    * @return bool        True if the node of ancestor contains the one of lc.
+    */
+    template <int dimension>
+    bool is_locational_code_prefix(uint32_t ancestor, uint32_t lc)
+    {
+      uint32_t ancestorDepth = locational_code_depth<dimension>(ancestor);
+      uint32_t depth = locational_code_depth<dimension>(lc);
+      return ancestorDepth <= depth && (lc >> (dimension * (depth - ancestorDepth))) == ancestor;
+    }
+
+
+    /**
+    * @brief Computes the child of ancestor that is on the path to lc.
+    * @param ancestor     The ancestor code.
+    * @param lc           A strictly deeper code with ancestor as prefix.
+    * @return uint32_t    The index of the child of ancestor on the path to lc.
+    */
+    template <int dimension>
+    uint32_t locational_code_octant(uint32_t ancestor, uint32_t lc)
+    {
+      uint32_t levelsBelow = locational_code_depth<dimension>(lc) - locational_code_depth<dimension>(ancestor);
+      return (lc >> (dimension * (levelsBelow - 1))) & ((1u << dimension) - 1);
+    }
+
+
+    /**
+    * @brief Computes the integer positions of the corners of bv, which are the ones used to find its locational code.
+    * @param bv               The bounding volume whose corners we are to compute.
+    * @param interval         Whether the max corner is ceiled (closed) or taken at max - epsilon (half open).
+    * @param min_corner       Out-parameter for the min corner (floored).
+    * @param max_corner       Out-parameter for the max corner.
+    */
+    template <int dimension>
+    void compute_grid_corners(aabb const& bv, cell_interval interval, glm::vec<dimension, int>& min_corner, glm::vec<dimension, int>& max_corner)
+    {
+      // Get the minimum point of the bv floored, and the maximum point ceiled
+      for (int axis = 0; axis < dimension; ++axis)
+      {
+        min_corner[axis] = static_cast<int>(glm::floor(bv.mMinPos[axis]));
+        max_corner[axis] = static_cast<int>(glm::ceil(bv.mMaxPos[axis]));
+      }
+
+      // With half open cells, the max corner is the last integer position before max (max - epsilon on
+      // the leaf grid, whose cells are at least one unit wide), so touching a boundary doesn't cross it
+      if (interval == cell_interval::half_open)
+        for (int axis = 0; axis < dimension; ++axis)
+          max_corner[axis] = glm::max(max_corner[axis] - 1, min_corner[axis]);
+    }
+
+
     /**
     * @brief Computes the locational code for the given bounding volume bv.
     * @param bv               The bounding volume whose locational code we are to compute.
     * @param root_size        The size of one side of the root bv.
     * @param levels           The number of levels being used in the tree.
+    * @param interval         Whether the max corner is ceiled (closed) or taken at max - epsilon (half open).
     * @return uint32_t        The code for bv.
     */
-    uint32_t compute_locational_code(aabb const& bv, uint32_t root_size, uint32_t levels)
+    template <int dimension>
+    uint32_t compute_locational_code(aabb const& bv, uint32_t root_size, uint32_t levels, cell_interval interval)
     {
-      // Get the minimum point of the bv floored
-      glm::vec<3,int> minFloored{ static_cast<int>(glm::floor(bv.mMinPos.x)),
-                                  static_cast<int>(glm::floor(bv.mMinPos.y)),
-                                  static_cast<int>(glm::floor(bv.mMinPos.z)) };
-
-      // Get the maximum point of the bv ceiled
-      glm::vec<3,int> maxCeiled{ static_cast<int>(glm::ceil(bv.mMaxPos.x)),
-                                 static_cast<int>(glm::ceil(bv.mMaxPos.y)),
-                                 static_cast<int>(glm::ceil(bv.mMaxPos.z)) };
+      glm::vec<dimension,int> minFloored;
+      glm::vec<dimension,int> maxCeiled;
+      compute_grid_corners<dimension>(bv, interval, minFloored, maxCeiled);
 
       // Compute the locational code of min and max floored and ceiled respectively
-      uint32_t minCode = compute_locational_code<3>(minFloored, root_size, levels);
-      uint32_t maxCode = compute_locational_code<3>(maxCeiled, root_size, levels);
+      uint32_t minCode = compute_locational_code<dimension>(minFloored, root_size, levels);
+      uint32_t maxCode = compute_locational_code<dimension>(maxCeiled, root_size, levels);
 
       // The code of bv is the code that minCode and maxCode have in common
-      return common_locational_code(minCode, maxCode);
+      return common_locational_code<dimension>(minCode, maxCode);
     }
-}
\ No newline at end of file
+
+
+    /**
+    * @brief Predicts the number of pair checks of the top-down broadphase for the given bvs: every pair
+    *        of objects sharing a node, plus every object against the objects of its ancestors.
+    * @param samples          The bounding volumes of the objects.
+    * @param root_size        The size of one side of the root bv.
+    * @param levels           The number of levels being used in the tree.
+    * @param interval         How the max corner of the bvs is mapped onto the leaf grid.
+    * @return uint64_t        The predicted checks.
+    */
+    template <int dimension>
+    uint64_t estimate_octree_checks(std::vector<aabb> const& samples, uint32_t root_size, uint32_t levels, cell_interval interval)
+    {
+      // Number of objects in each node
+      std::unordered_map<uint32_t, uint64_t> counts;
+      for (auto const& bv : samples)
+        counts[compute_locational_code<dimension>(bv, root_size, levels, interval)]++;
+
+      uint64_t checks = 0;
+      for (auto const& [code, count] : counts)
+      {
+        // All pairs inside the node
+        checks += count * (count - 1) / 2;
+
+        // Each object against the objects of every ancestor
+        for (uint32_t ancestor = code >> dimension; ancestor >= 1; ancestor >>= dimension)
+        {
+          auto foundIt = counts.find(ancestor);
+          if (foundIt != counts.end())
+            checks += count * foundIt->second;
+        }
+      }
+
+      return checks;
+    }
+
+
+    /**
+    * @brief Picks the root size and levels of an octree for a set of objects. The root is the smallest power
+    *        of two containing extent, and the levels the fewest whose predicted checks are within 5% of the
+    *        best (deeper trees never predict more checks, but cost more nodes and traversal).
+    * @param samples            A sample of the bounding volumes of the objects.
+    * @param object_count       The total number of objects, to scale the prediction of the sample.
+    * @param extent             The maximum absolute coordinate of the objects on each axis.
+    * @param current_root_size  The root size in use, to also predict the current checks.
+    * @param current_levels     The levels in use, to also predict the current checks.
+    * @param interval           How the max corner of the bvs is mapped onto the leaf grid.
+    * @return octree_tuning     The chosen parameters and predictions.
+    */
+    template <int dimension>
+    octree_tuning tune_octree_parameters(std::vector<aabb> const& samples, uint64_t object_count, glm::vec3 const& extent,
+                                         uint32_t current_root_size, uint32_t current_levels, cell_interval interval)
+    {
+      const uint32_t maxLevels = (sizeof(uint32_t) * 8 - 1) / dimension;
+
+      octree_tuning result;
+      result.sampled_objects = static_cast<uint32_t>(samples.size());
+
+      // Pairs grow quadratically, so scale the sample prediction accordingly
+      double sampleCount = static_cast<double>(samples.size());
+      double objectCount = static_cast<double>(object_count);
+      double scale = sampleCount > 1.0 ? (objectCount * (objectCount - 1.0)) / (sampleCount * (sampleCount - 1.0)) : 0.0;
+      auto predict = [&](uint32_t root_size, uint32_t levels)
+      {
+        return static_cast<uint64_t>(static_cast<double>(estimate_octree_checks<dimension>(samples, root_size, levels, interval)) * scale);
+      };
+
+      // Smallest power of two root (at least 2) containing every object
+      float maxCoordinate = 0.0f;
+      for (int axis = 0; axis < dimension; ++axis)
+        maxCoordinate = glm::max(maxCoordinate, extent[axis]);
+      uint32_t sizeBit = 1;
+      while (sizeBit < 31 && static_cast<float>(1u << (sizeBit - 1)) <= maxCoordinate)
+        ++sizeBit;
+      result.root_size = 1u << sizeBit;
+
+      // Leaves can't be smaller than one unit, nor codes wider than 32 bits
+      uint32_t levelCount = glm::min(maxLevels, sizeBit);
+      result.predicted_checks_per_level.resize(levelCount);
+      for (uint32_t levels = 1; levels <= levelCount; ++levels)
+        result.predicted_checks_per_level[levels - 1] = predict(result.root_size, levels);
+
+      uint64_t best = *std::min_element(result.predicted_checks_per_level.begin(), result.predicted_checks_per_level.end());
+      for (uint32_t levels = 1; levels <= levelCount; ++levels)
+      {
+        uint64_t checks = result.predicted_checks_per_level[levels - 1];
+        if (static_cast<double>(checks) <= static_cast<double>(best) * 1.05)
+        {
+          result.levels = levels;
+          result.predicted_checks = checks;
+          break;
+        }
+      }
+
+      result.current_checks = predict(current_root_size, current_levels);
+      return result;
+    }
+
+
+    /**
+    * @brief Writes the statistics of an octree as a single line JSON object.
+    * @param os          The stream to write to.
+    * @param stats       The statistics to write.
+    */
+    void write_json(std::ostream& os, octree_stats const& stats)
+    {
+      auto writeArray = [&os](std::vector<uint32_t> const& values)
+      {
+        os << '[';
+        for (size_t i = 0; i < values.size(); ++i)
+          os << (i != 0 ? "," : "") << values[i];
+        os << ']';
+      };
+
+      os << "{\"nodes_per_level\":";
+      writeArray(stats.nodes_per_level);
+      os << ",\"objects_per_level\":";
+      writeArray(stats.objects_per_level);
+      os << ",\"node_count\":" << stats.node_count
+         << ",\"object_count\":" << stats.object_count
+         << ",\"max_objects_per_node\":" << stats.max_objects_per_node
+         << ",\"mean_objects_per_node\":" << stats.mean_objects_per_node
+         << ",\"bucket_count\":" << stats.bucket_count
+         << ",\"load_factor\":" << stats.load_factor
+         << ",\"max_probe_length\":" << stats.max_probe_length
+         << ",\"mean_probe_length\":" << stats.mean_probe_length
+         << ",\"memory_bytes\":" << stats.memory_bytes
+         << ",\"relocations\":" << stats.counters.relocations
+         << ",\"skipped_relocations\":" << stats.counters.skipped_relocations
+         << ",\"reinsertions\":" << stats.counters.reinsertions
+         << ",\"nodes_created\":" << stats.counters.nodes_created
+         << ",\"nodes_deleted\":" << stats.counters.nodes_deleted
+         << '}';
+    }
+
+
+    /**
+    * @brief Returns the statistics of an octree as a single line JSON object.
+    * @param stats       The statistics to convert.
+    * @return std::string     The JSON text.
+    */
+    std::string to_json(octree_stats const& stats)
+    {
+      std::ostringstream os;
+      write_json(os, stats);
+      return os.str();
+    }
+
+
+    // Instantiations for octrees and quadtrees
+    template uint32_t common_locational_code<2>(uint32_t, uint32_t);
+    template uint32_t common_locational_code<3>(uint32_t, uint32_t);
+    template aabb     compute_bv<2>(uint32_t, uint32_t);
+    template aabb     compute_bv<3>(uint32_t, uint32_t);
+    template uint32_t locational_code_depth<2>(uint32_t);
+    template uint32_t locational_code_depth<3>(uint32_t);
+    template bool     is_locational_code_prefix<2>(uint32_t, uint32_t);
+    template bool     is_locational_code_prefix<3>(uint32_t, uint32_t);
+    template uint32_t locational_code_octant<2>(uint32_t, uint32_t);
+    template uint32_t locational_code_octant<3>(uint32_t, uint32_t);
+    template void     compute_grid_corners<2>(aabb const&, cell_interval, glm::ivec2&, glm::ivec2&);
+    template void     compute_grid_corners<3>(aabb const&, cell_interval, glm::ivec3&, glm::ivec3&);
+    template uint32_t compute_locational_code<2>(aabb const&, uint32_t, uint32_t, cell_interval);
+    template uint32_t compute_locational_code<3>(aabb const&, uint32_t, uint32_t, cell_interval);
+    template uint64_t estimate_octree_checks<2>(std::vector<aabb> const&, uint32_t, uint32_t, cell_interval);
+    template uint64_t estimate_octree_checks<3>(std::vector<aabb> const&, uint32_t, uint32_t, cell_interval);
+    template octree_tuning tune_octree_parameters<2>(std::vector<aabb> const&, uint64_t, glm::vec3 const&, uint32_t, uint32_t, cell_interval);
+    template octree_tuning tune_octree_parameters<3>(std::vector<aabb> const&, uint64_t, glm::vec3 const&, uint32_t, uint32_t, cell_interval);
+}
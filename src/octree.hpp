@@ -3,22 +3,103 @@
 
 namespace cs350 {
 
+    /**
+     * @brief
+     *  How the max corner of a bv is mapped onto the leaf grid
+     */
+    enum class cell_interval
+    {
+        closed,     // Cells are [min, max], the max corner is ceiled (an object touching a boundary crosses it)
+        half_open   // Cells are [min, max), the max corner is taken at max - epsilon on the leaf grid
+    };
+
+    /**
+     * @brief
+     *  Root size and levels chosen by the auto-tuning of an octree, with the predicted pair checks
+     */
+    struct octree_tuning
+    {
+        uint32_t              root_size{0};
+        uint32_t              levels{0};
+        uint64_t              predicted_checks{0};        // With the chosen root size and levels
+        uint64_t              current_checks{0};          // With the root size and levels in use when tuning
+        uint32_t              sampled_objects{0};
+        std::vector<uint64_t> predicted_checks_per_level; // Index i holds the prediction for i + 1 levels
+    };
+
+    /**
+     * @brief
+     *  Instrumentation of the work done by an octree since the counters were last reset
+     */
+    struct octree_counters
+    {
+        uint32_t relocations{0};            // Calls to relocate on objects already in the tree
+        uint32_t skipped_relocations{0};    // Of those, the ones that didn't need a new locational code
+        uint32_t reinsertions{0};           // Of those, the ones that moved the object to another node
+        uint32_t nodes_created{0};
+        uint32_t nodes_deleted{0};
+    };
+
+    /**
+     * @brief
+     *  Snapshot of the shape of an octree, see octree::stats
+     */
+    struct octree_stats
+    {
+        std::vector<uint32_t> nodes_per_level;
+        std::vector<uint32_t> objects_per_level;
+        uint32_t              node_count{0};
+        uint32_t              object_count{0};
+        uint32_t              max_objects_per_node{0};
+        float                 mean_objects_per_node{0.0f};   // Over all the nodes, including the empty ones
+        size_t                bucket_count{0};
+        float                 load_factor{0.0f};
+        uint32_t              max_probe_length{0};           // Nodes in the most crowded bucket
+        float                 mean_probe_length{0.0f};       // Nodes visited by a successful find, on average
+        size_t                memory_bytes{0};               // Approximation of the nodes, the map and the bookkeeping
+        octree_counters       counters;                      // Since the counters were last reset
+    };
+
+    void        write_json(std::ostream& os, octree_stats const& stats);
+    std::string to_json(octree_stats const& stats);
+
     // Helper function to print number in binary
     void print_binary(uint32_t number);
 
+    // The dimension of the codes is 3 for octrees and 2 for quadtrees (z is then ignored), the
+    // functions not defined in the header are instantiated for both in octree.cpp
     template <int dimension = 3>
     uint32_t compute_locational_code(glm::vec<dimension, int> world_position, uint32_t root_size, uint32_t levels);
-    uint32_t compute_locational_code(aabb const& bv, uint32_t root_size, uint32_t levels);
+    template <int dimension = 3>
+    uint32_t compute_locational_code(aabb const& bv, uint32_t root_size, uint32_t levels, cell_interval interval = cell_interval::closed);
+    template <int dimension = 3>
+    void     compute_grid_corners(aabb const& bv, cell_interval interval, glm::vec<dimension, int>& min_corner, glm::vec<dimension, int>& max_corner);
+    template <int dimension = 3>
     aabb     compute_bv(uint32_t locational_code, uint32_t root_size);
+    template <int dimension = 3>
     uint32_t locational_code_depth(uint32_t lc);
+    template <int dimension = 3>
     uint32_t common_locational_code(uint32_t lc1, uint32_t lc2);
+    template <int dimension = 3>
+    bool     is_locational_code_prefix(uint32_t ancestor, uint32_t lc);
+    template <int dimension = 3>
+    uint32_t locational_code_octant(uint32_t ancestor, uint32_t lc);
+    template <int dimension = 3>
+    uint64_t estimate_octree_checks(std::vector<aabb> const& samples, uint32_t root_size, uint32_t levels, cell_interval interval);
+    template <int dimension = 3>
+    octree_tuning tune_octree_parameters(std::vector<aabb> const& samples, uint64_t object_count, glm::vec3 const& extent,
+                                         uint32_t current_root_size, uint32_t current_levels, cell_interval interval);
 
     /**
      * @brief
      * 	Linear octree, each node stores a head for a linked list of T
      * @tparam T
+     *  Must expose bv_world, octree_node, octree_next_object and octree_prev_object
+     * @tparam Dim
+     *  3 for an octree, 2 for a quadtree on x and y (z of the bvs is ignored, nodes have 4 children
+     *  and codes use 2 bits per level)
      */
-    template <typename T>
+    template <typename T, int Dim = 3>
     class octree
     {
       public:
@@ -26,16 +107,106 @@ namespace cs350 {
         {
             uint32_t locational_code{0}; 
             uint8_t  children_active{0};
+            uint32_t object_count{0};
+            uint32_t relevel_levels{0};     // While waiting to be re-leveled, the levels its objects were placed with
+            uint32_t depth{0};              // Cached locational_code_depth(locational_code)
+            uint32_t empty_since{0};        // While kept empty for reuse, the frame it was emptied on plus one
+            glm::vec<Dim, int> cell_min{0}; // The integer bounds of its cell, [cell_min, cell_max)
+            glm::vec<Dim, int> cell_max{0};
             T*       first{nullptr};
+            node*    level_prev{nullptr};   // Intrusive list of the nodes at the same depth
+            node*    level_next{nullptr};
+            std::atomic_flag spinlock;      // Guards the object list in concurrent mode
+            std::unique_ptr<std::vector<T*>> references; // Multi-cell objects whose home is another cell
 
             void push_front(T * object);
             void remove(T * object);
+            void lock();
+            void unlock();
+            [[nodiscard]] bool has_objects() const { return first != nullptr || (references && !references->empty()); }
         };
 
+        // Aggregates of the objects in the subtree of a node, see compute_aggregates
+        struct mass_aggregate
+        {
+            glm::vec3 center_of_mass{0.0f};
+            float     mass{0.0f};
+            bool      dirty{false};         // Changed since compute_aggregates (so did the ones of its ancestors)
+        };
+
+        // Deepest level that fits in a 32 bit code (with its sentinel)
+        static constexpr uint32_t max_depth = (sizeof(uint32_t) * 8 - 1) / Dim;
+
       private:
         std::unordered_map<uint32_t, node*> m_nodes;
+        std::array<node*, max_depth + 1>    m_level_heads;
+        std::array<uint32_t, max_depth + 1> m_level_counts;
         uint32_t                            m_root_size;
         uint32_t                            m_levels;
+        cell_interval                       m_interval;
+        bool                                m_adaptive;
+        uint32_t                            m_split_threshold;
+        uint32_t                            m_merge_threshold;
+        octree_tuning                       m_last_tuning;
+        std::vector<uint32_t>               m_relevel_queue;
+        octree_counters                     m_counters;
+        bool                                m_concurrent;
+        std::shared_mutex                   m_nodes_mutex;      // Guards m_nodes and the level lists in concurrent mode
+        std::mutex                          m_deferred_mutex;
+        std::vector<uint32_t>               m_deferred_deletes; // Nodes that were emptied in concurrent mode
+        uint32_t                            m_frame;
+        uint32_t                            m_retention_frames; // 0 deletes empty nodes right away
+        size_t                              m_retention_budget; // In bytes
+        std::vector<uint32_t>               m_retained;         // Empty nodes kept for reuse, oldest first
+
+        // Range of cells (at a single depth) that a multi-cell object is referenced from
+        struct multi_cell_span
+        {
+            glm::vec<Dim, int> min{0};
+            glm::vec<Dim, int> max{0};
+        };
+        // A node in the depth first layout used by for_each_mass, skip is the next node outside its subtree
+        struct mass_node
+        {
+            glm::vec3   center_of_mass{0.0f};
+            float       mass{0.0f};
+            float       size{0.0f};
+            uint32_t    skip{0};
+            node const* source{nullptr};
+        };
+        std::unordered_map<uint32_t, mass_aggregate>    m_mass;             // By locational code, kept out of the nodes
+        std::vector<uint32_t>                           m_mass_changed;     // Codes marked dirty since compute_aggregates
+        std::vector<mass_node>                          m_mass_nodes;       // Filled by compute_aggregates
+        bool                                            m_mass_fresh;       // Whether the aggregates and m_mass_nodes match the tree
+        bool                                            m_mass_all_dirty;   // Until the first compute_aggregates, and after concurrent mode (which doesn't mark)
+
+        uint32_t                                        m_multi_cell_level; // 0 disables multi-cell insertion
+        uint32_t                                        m_multi_cell_max;
+        std::unordered_map<T const*, multi_cell_span>   m_multi_cells;      // Spans of the objects inserted that way
+
+        uint32_t locational_code(aabb const& bv, uint32_t levels) const;
+        void     queue_relevel(uint32_t previous_levels);
+        void     compute_cell_bounds(node* to_compute) const;
+        bool     stays_in_node(node const* current, aabb const& bv) const;
+
+        uint32_t adaptive_locational_code(uint32_t locational_code) const;
+        void     split_node(node* to_split);
+        void     merge_children(uint32_t locational_code);
+        void     count(uint32_t& counter);
+        void     defer_delete(uint32_t locational_code);
+        void     retain(uint32_t locational_code);
+        void     invalidate_mass(uint32_t locational_code);
+
+        uint32_t multi_cell_depth() const { return glm::min(m_multi_cell_level, m_levels); }
+        bool     compute_cell_span(aabb const& bv, multi_cell_span& span) const;
+        uint32_t cell_code(glm::vec<Dim, int> const& cell) const;
+        template <typename F>
+        void     for_each_span_cell(multi_cell_span const& span, F&& function) const;
+        multi_cell_span const* find_multi_cell(T const* object, node const* in) const;
+        void     insert_multi_cell(T* object, multi_cell_span const& span);
+        void     erase_multi_cell(T* object, multi_cell_span span);
+        std::vector<T*> take_multi_cell_objects();
+        bool     owns_pair(T const* a, node const* a_node, T const* b, node const* b_node) const;
 
       public:
         octree();
@@ -51,13 +222,83 @@ namespace cs350 {
         void        delete_node(uint32_t locational_code);
         void        delete_node_rec(uint32_t locational_code);
         void        debug_draw_levels(int highlight_level);
+        uint32_t    locational_code(aabb const& bv) const;
+
+        template <typename F>
+        void        for_each_node_at_level(uint32_t level, F&& function);
+        template <typename F>
+        void        for_each_node_at_level(uint32_t level, F&& function) const;
+        [[nodiscard]] uint32_t node_count_at_level(uint32_t level) const { return level <= max_depth ? m_level_counts[level] : 0u; }
+
+        void        insert(T* object);
+        void        relocate(T* object);
+        void        erase(T* object);
+        bool        relevel(uint32_t budget_us);
+        [[nodiscard]] bool relevel_pending() const { return !m_relevel_queue.empty(); }
+
+        template <typename It>
+        octree_tuning const& auto_tune(It first, It last, uint32_t max_samples = 1024u);
 
         const std::unordered_map<uint32_t, node*> & get_map() const { return m_nodes; }
         [[nodiscard]] uint32_t root_size() const { return m_root_size; }
         [[nodiscard]] uint32_t levels() const { return m_levels; }
-        void                   set_root_size(uint32_t size) { m_root_size = size; }
-        void                   set_levels(uint32_t levels) { m_levels = levels; }
+        void                   set_root_size(uint32_t size);
+        void                   set_levels(uint32_t levels);
+        [[nodiscard]] cell_interval interval() const { return m_interval; }
+        void                   set_interval(cell_interval interval) { m_interval = interval; }
+        [[nodiscard]] bool     adaptive() const { return m_adaptive; }
+        void                   set_adaptive(bool adaptive) { m_adaptive = adaptive; }
+        [[nodiscard]] uint32_t split_threshold() const { return m_split_threshold; }
+        [[nodiscard]] uint32_t merge_threshold() const { return m_merge_threshold; }
+        void                   set_thresholds(uint32_t split, uint32_t merge) { m_split_threshold = split; m_merge_threshold = merge; }
+        [[nodiscard]] octree_tuning const& last_tuning() const { return m_last_tuning; }
+        [[nodiscard]] octree_counters const& counters() const { return m_counters; }
+        [[nodiscard]] octree_stats stats() const;
+        void                   reset_counters() { m_counters = octree_counters{}; }
+        [[nodiscard]] bool     concurrent() const { return m_concurrent; }
+        void                   set_concurrent(bool concurrent);
+        void                   flush_deletes();
+        [[nodiscard]] bool     deletes_pending() const { return !m_deferred_deletes.empty(); }
+        void                   set_node_retention(uint32_t frames, size_t budget_bytes);
+        [[nodiscard]] uint32_t retention_frames() const { return m_retention_frames; }
+        [[nodiscard]] size_t   retention_budget() const { return m_retention_budget; }
+        [[nodiscard]] size_t   retained_nodes() const { return m_retained.size(); }
+        void                   end_frame();
+        void                   set_multi_cell(uint32_t level, uint32_t max_cells);
+        [[nodiscard]] uint32_t multi_cell_level() const { return m_multi_cell_level; }
+        [[nodiscard]] uint32_t multi_cell_max() const { return m_multi_cell_max; }
+        [[nodiscard]] size_t   multi_cell_objects() const { return m_multi_cells.size(); }
+        template <typename Remap>
+        void                   remap_objects(Remap remap);
+
+        template <typename F>
+        void        for_each_pair(F&& function) const;
+        template <typename F>
+        void        for_each_object(F&& function) const;
+        template <typename F>
+        void        for_each_object_in(node const* in, F&& function) const;
+        bool        reports_from(T const* object, node const* in, aabb const& other) const;
+        template <typename F>
+        void        query(aabb const& bv, F&& function) const;
+        template <typename F>
+        void        query_cells(aabb const& bv, F&& function) const;
+        template <typename MassOf>
+        void        compute_aggregates(MassOf mass_of);
+        void        invalidate_aggregates();
+        [[nodiscard]] bool aggregates_fresh() const { return m_mass_fresh; }
+        [[nodiscard]] mass_aggregate const* find_aggregate(uint32_t locational_code) const;
+        template <typename MassOf, typename F>
+        void        for_each_mass(T const* object, glm::vec3 const& position, float theta, MassOf mass_of, F&& function) const;
+
+        static bool overlaps(aabb const& a, aabb const& b);
+        static bool overlaps(node const* cell, aabb const& bv);
     };
+
+    template <typename A, typename B, int Dim, typename F>
+    bool spatial_join(octree<A, Dim> const& tree_a, octree<B, Dim> const& tree_b, F&& function);
+    template <typename T, int Dim, typename MassOf>
+    void compute_gravity(octree<T, Dim>& tree, std::vector<T*> const& objects, MassOf mass_of, std::vector<glm::vec3>& accelerations,
+                         float theta = 0.5f, float gravity = 1.0f, float softening = 0.1f, uint32_t thread_count = 1);
 }
 
 #include "octree.inl" 
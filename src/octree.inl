@@ -79,18 +79,32 @@ namespace cs350 {
     /**
     * @brief Default constructs the root size and levels.
     */
-    template<typename T>
-    octree<T>::octree()
+    template<typename T, int Dim>
+    octree<T, Dim>::octree()
         :   m_root_size(128u)
         ,   m_levels(3u)
+        ,   m_interval(cell_interval::closed)
+        ,   m_adaptive(false)
+        ,   m_split_threshold(8u)
+        ,   m_merge_threshold(4u)
+        ,   m_concurrent(false)
+        ,   m_frame(0u)
+        ,   m_retention_frames(0u)
+        ,   m_retention_budget(std::numeric_limits<size_t>::max())
+        ,   m_mass_fresh(false)
+        ,   m_mass_all_dirty(true)
+        ,   m_multi_cell_level(0u)
+        ,   m_multi_cell_max(8u)
     {
+      m_level_heads.fill(nullptr);
+      m_level_counts.fill(0u);
     }
 
     /**
     * @brief Destroy all the existing nodes.
     */
-    template<typename T>
-    octree<T>::~octree()
+    template<typename T, int Dim>
+    octree<T, Dim>::~octree()
     {
       destroy();
     }
@@ -99,8 +113,8 @@ namespace cs350 {
     /**
     * @brief Deletes the memory of all the existing nodes and removes them from the container.
     */
-    template<typename T>
-    void octree<T>::destroy()
+    template<typename T, int Dim>
+    void octree<T, Dim>::destroy()
     {
       while (!m_nodes.empty())
       {
@@ -108,6 +122,17 @@ namespace cs350 {
         delete beginIt->second;
         m_nodes.erase(beginIt);
       }
+      m_level_heads.fill(nullptr);
+      m_level_counts.fill(0u);
+      m_relevel_queue.clear();
+      m_deferred_deletes.clear();
+      m_retained.clear();
+      m_multi_cells.clear();
+      m_mass.clear();
+      m_mass_changed.clear();
+      m_mass_nodes.clear();
+      m_mass_fresh = false;
+      m_mass_all_dirty = true;
     }
 
 
@@ -116,10 +141,10 @@ namespace cs350 {
     * @param bv       The bounding volume whose node we are to find.
     * @return node *  The found node.
     */
-    template<typename T>
-    typename octree<T>::node* octree<T>::find_create_node(aabb const& bv)
+    template<typename T, int Dim>
+    typename octree<T, Dim>::node* octree<T, Dim>::find_create_node(aabb const& bv)
     {
-      return find_create_node<T>(compute_locational_code(bv, m_root_size, m_levels));
+      return find_create_node(locational_code(bv));
     }
 
 
@@ -128,10 +153,10 @@ namespace cs350 {
     * @param bv       The bounding volume whose node we are to find.
     * @return node *  The found node. Nullptr if it wasn't found.
     */
-    template<typename T>
-    typename octree<T>::node* octree<T>::find_node(aabb const& bv)
+    template<typename T, int Dim>
+    typename octree<T, Dim>::node* octree<T, Dim>::find_node(aabb const& bv)
     {
-      return find_node<T>(compute_locational_code(bv, m_root_size, m_levels));
+      return find_node(locational_code(bv));
     }
 
 
@@ -140,10 +165,10 @@ namespace cs350 {
     * @param bv       The bounding volume whose node we are to find.
     * @return node *  The found node. Nullptr if it wasn't found.
     */
-    template<typename T>
-    typename octree<T>::node const* octree<T>::find_node(aabb const& bv) const
+    template<typename T, int Dim>
+    typename octree<T, Dim>::node const* octree<T, Dim>::find_node(aabb const& bv) const
     {
-      return find_node<T>(bv);
+      return const_cast<octree<T, Dim>*>(this)->find_node(bv);
     }
 
 
@@ -153,8 +178,8 @@ namespace cs350 {
     * @param locational_code       The code of the node we want to find.
     * @return node *               The found node, or the newly created one.
     */
-    template<typename T>
-    typename octree<T>::node* octree<T>::find_create_node(uint32_t locational_code)
+    template<typename T, int Dim>
+    typename octree<T, Dim>::node* octree<T, Dim>::find_create_node(uint32_t locational_code)
     {
       // Find the node
       auto foundIt = m_nodes.find(locational_code);
@@ -164,8 +189,18 @@ namespace cs350 {
       {
         node * newNode = new node;
         newNode->locational_code = locational_code;
+        newNode->depth = locational_code_depth<Dim>(locational_code);
         newNode->first = nullptr;
+        compute_cell_bounds(newNode);
         m_nodes[locational_code] = newNode;
+
+        // Link it at the front of the list of its level
+        newNode->level_next = m_level_heads[newNode->depth];
+        if (newNode->level_next != nullptr)
+          newNode->level_next->level_prev = newNode;
+        m_level_heads[newNode->depth] = newNode;
+        m_level_counts[newNode->depth]++;
+        count(m_counters.nodes_created);
         return newNode;
       }
 
@@ -178,8 +213,8 @@ namespace cs350 {
     * @param locational_code       The code of the node we want to find.
     * @return node *               The found node, or nullptr if it wasn't found.
     */
-    template<typename T>
-    typename octree<T>::node* octree<T>::find_node(uint32_t locational_code)
+    template<typename T, int Dim>
+    typename octree<T, Dim>::node* octree<T, Dim>::find_node(uint32_t locational_code)
     {
       auto foundIt = m_nodes.find(locational_code);
       if (foundIt == m_nodes.end())
@@ -195,10 +230,10 @@ namespace cs350 {
     * @param locational_code       The code of the node we want to find.
     * @return node *               The found node, or nullptr if it wasn't found.
     */
-    template<typename T>
-    typename octree<T>::node const* octree<T>::find_node(uint32_t locational_code) const
+    template<typename T, int Dim>
+    typename octree<T, Dim>::node const* octree<T, Dim>::find_node(uint32_t locational_code) const
     {
-      return find_node<T>(locational_code);
+      return const_cast<octree<T, Dim>*>(this)->find_node(locational_code);
     }
 
 
@@ -207,42 +242,71 @@ namespace cs350 {
     *        Note that it only deletes the node corresponding to locational_code, and not its children or parents.
     * @param locational_code       The code of the node we want to delete.
     */
-    template<typename T>
-    void octree<T>::delete_node(uint32_t locational_code)
+    template<typename T, int Dim>
+    void octree<T, Dim>::delete_node(uint32_t locational_code)
     {
       // Find it and check if it was found
       auto foundIt = m_nodes.find(locational_code);
       if (foundIt == m_nodes.end())
         return;
       
+      // Unlink it from the list of its level
+      node * toDelete = foundIt->second;
+      if (toDelete->level_prev != nullptr)
+        toDelete->level_prev->level_next = toDelete->level_next;
+      else
+        m_level_heads[toDelete->depth] = toDelete->level_next;
+      if (toDelete->level_next != nullptr)
+        toDelete->level_next->level_prev = toDelete->level_prev;
+      m_level_counts[toDelete->depth]--;
+      count(m_counters.nodes_deleted);
+      invalidate_mass(toDelete->locational_code);
+
       // Delete the memory and remove it from the map
-      delete foundIt->second;
+      delete toDelete;
       m_nodes.erase(foundIt);
     }
 
 
     /**
     * @brief Deletes the memory of the node corresponding to 'locational_code' and removes it from the container.
-    *        Sets the bit of its parent to 0, and if the parent no longer has child nodes active, it is deleted.
-    *        This is repeated recursively until the root node.
+    *        Sets the bit of its parent to 0, and if the parent no longer has child nodes active (nor objects),
+    *        it is deleted. This is repeated recursively until the root node. Nodes with objects or active
+    *        children are kept.
     * @param locational_code       The code of the node we want to delete.
     */
-    template <typename T>
-    void octree<T>::delete_node_rec(uint32_t locational_code)
+    template<typename T, int Dim>
+    void octree<T, Dim>::delete_node_rec(uint32_t locational_code)
     {
-      const int dimension = 3;
+      const int dimension = Dim;
       uint32_t maxValue = (1u << dimension) - 1;
 
       node * childNode = nullptr;
       node * parentNode = nullptr;
 
+      // Other threads may still be using the nodes, wait for flush_deletes
+      if (m_concurrent)
+      {
+        defer_delete(locational_code);
+        return;
+      }
+
+      // Keep it in case it is needed again soon, end_frame deletes it later on
+      if (m_retention_frames != 0)
+      {
+        retain(locational_code);
+        return;
+      }
+
       // Find the child node and delete it
       childNode = find_node(locational_code);
       assert(childNode != nullptr);
 
-      // If it doesn't have active children, delete it
-      if (childNode->children_active == 0)
+      // If it doesn't have active children nor objects, delete it
+      if (childNode->children_active == 0 && !childNode->has_objects())
         delete_node(locational_code);
+      else
+        return;
 
       // Until we reach the sentinel bit
       while (locational_code > 1)
@@ -257,10 +321,10 @@ namespace cs350 {
         // Update the child node
         childNode = parentNode;
 
-        // If the parent has no children active, delete it, otherwise, the rest of the parents won't be deleted either
+        // If the parent has no children active (nor objects), delete it, otherwise, the rest of the parents won't be deleted either
         if (parentNode != nullptr)
         {
-          if (parentNode->children_active == 0)
+          if (parentNode->children_active == 0 && !parentNode->has_objects())
             delete_node(locational_code >> dimension);
           else
             return;
@@ -278,18 +342,32 @@ namespace cs350 {
     * @param locational_code       The code of the node we want to create.
     * @return node *               The node we created.
     */
-    template<typename T>
-    typename octree<T>::node* octree<T>::create_node(uint32_t locational_code)
+    template<typename T, int Dim>
+    typename octree<T, Dim>::node* octree<T, Dim>::create_node(uint32_t locational_code)
     {
         // Get the maximum value that the last dimension digits of the code can have
-        const int dimension = 3;
+        const int dimension = Dim;
         uint32_t maxValue = (1u << dimension) - 1;
 
         node * childNode = nullptr;
         node * parentNode = nullptr;
         node * toReturn = nullptr;
 
-        // Create the node
+        // In concurrent mode, an existing node only needs a shared lock (its parents are never deleted
+        // before flush_deletes), the ones to create are created under an exclusive lock
+        std::unique_lock<std::shared_mutex> exclusiveLock(m_nodes_mutex, std::defer_lock);
+        if (m_concurrent)
+        {
+          {
+            std::shared_lock<std::shared_mutex> sharedLock(m_nodes_mutex);
+            toReturn = find_node(locational_code);
+          }
+          if (toReturn != nullptr)
+            return toReturn;
+          exclusiveLock.lock();
+        }
+
+        // Create the node (under the exclusive lock in concurrent mode)
         childNode = find_create_node(locational_code);
         toReturn = childNode;
 
@@ -297,11 +375,16 @@ namespace cs350 {
         while (locational_code > 1)
         {
           parentNode = find_create_node(locational_code >> dimension);
-          parentNode->children_active |= (1u << (locational_code & maxValue));
+          if (m_concurrent)
+            std::atomic_ref<uint8_t>(parentNode->children_active).fetch_or(static_cast<uint8_t>(1u << (locational_code & maxValue)));
+          else
+            parentNode->children_active |= (1u << (locational_code & maxValue));
           childNode = parentNode;
           locational_code >>= dimension;
         }
 
+        // Whoever fills it doesn't have to mark it (concurrent mode doesn't read the aggregates)
+        invalidate_mass(toReturn->locational_code);
         return toReturn;
     }
 
@@ -310,81 +393,1805 @@ namespace cs350 {
     * @brief Debug draws the bvs of each node in the highlight_level specified. If -1 is specified, debug draw all.
     * @param highlight_level       The level of nodes we want to debug draw.
     */
-    template<typename T>
-    void octree<T>::debug_draw_levels(int highlight_level)
+    template<typename T, int Dim>
+    void octree<T, Dim>::debug_draw_levels(int highlight_level)
     {
       // Debug draw all the existing nodes if -1
       if (highlight_level == -1)
       {
         for (auto it = m_nodes.begin(); it != m_nodes.end(); ++it)
         {
-          debug_draw_aabb(compute_bv(it->first, m_root_size), {0.2f,0.6f,0.4f,0.5f}, debug_draw_type::wireframe);
+          debug_draw_aabb(compute_bv<Dim>(it->first, m_root_size), {0.2f,0.6f,0.4f,0.5f}, debug_draw_type::wireframe);
         }
       }
       // Else, debug draw only the ones in the level highlight_level
       else
       {
-        uint32_t exponent = 3 * highlight_level;
+        for_each_node_at_level(static_cast<uint32_t>(highlight_level), [this](node * currentNode)
+        {
+          debug_draw_aabb(compute_bv<Dim>(currentNode->locational_code, m_root_size), {0.2f,0.6f,0.4f,0.5f}, debug_draw_type::wireframe);
+        });
+      }
+    }
+
+
+    /**
+    * @brief Calls function with each existing node at the given depth, in O(nodes at that depth).
+    *        The function must not create nor delete nodes.
+    * @param level          The depth of the nodes to visit.
+    * @param function       Callable taking a node pointer.
+    */
+    template<typename T, int Dim>
+    template<typename F>
+    void octree<T, Dim>::for_each_node_at_level(uint32_t level, F&& function)
+    {
+      if (level > max_depth)
+        return;
+
+      for (node * current = m_level_heads[level]; current != nullptr; current = current->level_next)
+        function(current);
+    }
+
+
+    /**
+    * @brief Calls function with each existing node at the given depth, in O(nodes at that depth). (Const overload)
+    * @param level          The depth of the nodes to visit.
+    * @param function       Callable taking a const node pointer.
+    */
+    template<typename T, int Dim>
+    template<typename F>
+    void octree<T, Dim>::for_each_node_at_level(uint32_t level, F&& function) const
+    {
+      if (level > max_depth)
+        return;
+
+      for (node const* current = m_level_heads[level]; current != nullptr; current = current->level_next)
+        function(current);
+    }
+
+
+    /**
+    * @brief Computes the locational code of bv with the root size, levels and cell interval of this octree.
+    * @param bv               The bounding volume whose locational code we are to compute.
+    * @return uint32_t        The code for bv.
+    */
+    template<typename T, int Dim>
+    uint32_t octree<T, Dim>::locational_code(aabb const& bv) const
+    {
+      return compute_locational_code<Dim>(bv, m_root_size, m_levels, m_interval);
+    }
+
+
+    /**
+    * @brief Computes the locational code of bv with the given levels instead of the current ones.
+    * @param bv               The bounding volume whose locational code we are to compute.
+    * @param levels           The number of levels to use.
+    * @return uint32_t        The code for bv.
+    */
+    template<typename T, int Dim>
+    uint32_t octree<T, Dim>::locational_code(aabb const& bv, uint32_t levels) const
+    {
+      return compute_locational_code<Dim>(bv, m_root_size, levels, m_interval);
+    }
+
+    /**
+    * @brief Adds object to the node of its bv (creating it if needed). In adaptive mode, the node is
+    *        the deepest existing one on the path to the code of the bv, and it is split if it gets too full.
+    * @param object       A pointer to the object to add. It must not belong to any node.
+    */
+    template<typename T, int Dim>
+    void octree<T, Dim>::insert(T* object)
+    {
+      assert(object != nullptr && object->octree_node == nullptr);
+
+      uint32_t code = locational_code(object->bv_world);
+      if (m_adaptive)
+        code = adaptive_locational_code(code);
+
+      // Objects straddling the cells of the multi-cell depth are referenced from each of them instead
+      multi_cell_span span;
+      if (m_multi_cell_level != 0 && !m_adaptive && !m_concurrent && locational_code_depth<Dim>(code) < multi_cell_depth() &&
+          compute_cell_span(object->bv_world, span))
+      {
+        insert_multi_cell(object, span);
+        return;
+      }
+
+      node* target = create_node(code);
+      if (m_concurrent)
+        target->lock();
+      target->push_front(object);
+      if (m_concurrent)
+        target->unlock();
+      object->octree_node = target;
+      invalidate_mass(target->locational_code);
+
+      if (m_adaptive)
+        split_node(target);
+    }
+
+
+    /**
+    * @brief Moves object to the node its current bv belongs to, if it's not already there.
+    *        Objects that don't belong to any node are inserted.
+    * @param object       A pointer to the object to update.
+    */
+    template<typename T, int Dim>
+    void octree<T, Dim>::relocate(T* object)
+    {
+      assert(object != nullptr);
+
+      if (object->octree_node != nullptr)
+      {
+        count(m_counters.relocations);
+
+        // Its position changed even if it stays in its node
+        invalidate_mass(object->octree_node->locational_code);
 
-        uint32_t nodesInCurrentLevel = 1u << exponent;
+        // Multi-cell objects stay while they overlap the same cells
+        if (multi_cell_span const* current = find_multi_cell(object, object->octree_node))
+        {
+          multi_cell_span span;
+          if (compute_cell_span(object->bv_world, span) && span.min == current->min && span.max == current->max)
+          {
+            count(m_counters.skipped_relocations);
+            return;
+          }
+          count(m_counters.reinsertions);
+          erase(object);
+          insert(object);
+          return;
+        }
 
-        for (uint32_t i = 0; i < nodesInCurrentLevel; ++i)
+        // Cheap test on the cached cell bounds before computing the locational code
+        if (stays_in_node(object->octree_node, object->bv_world))
         {
-            uint32_t currentCode = nodesInCurrentLevel + i;
-            node * currentNode = find_node(currentCode);
-            if (currentNode != nullptr)
-                debug_draw_aabb(compute_bv(currentCode, m_root_size), {0.2f,0.6f,0.4f,0.5f}, debug_draw_type::wireframe);
+          count(m_counters.skipped_relocations);
+          return;
         }
+
+        // Objects waiting to be re-leveled stay where they are until they move or the re-leveling reaches them
+        uint32_t levels = object->octree_node->relevel_levels != 0 ? object->octree_node->relevel_levels : m_levels;
+        uint32_t code = locational_code(object->bv_world, levels);
+        if (m_adaptive)
+          code = adaptive_locational_code(code);
+
+        // Still in the same node, nothing to do
+        if (object->octree_node->locational_code == code)
+          return;
+
+        count(m_counters.reinsertions);
+        erase(object);
       }
+
+      insert(object);
     }
 
 
     /**
-    * @brief Adds an object of type T to the beginning of the linked list of this node.
-    * @param object       A pointer to the object to add.
+    * @brief Changes the size of the root. As the cells of the new root don't line up with the old ones,
+    *        every object is relocated right away (without destroying the nodes that are still valid).
+    * @param size       The new size of one side of the root bv.
     */
-    template<typename T>
-    void octree<T>::node::push_front(T * object)
+    template<typename T, int Dim>
+    void octree<T, Dim>::set_root_size(uint32_t size)
     {
-      assert(object != nullptr);
+      if (size == m_root_size)
+        return;
 
-      // Update object's connecting pointers
-      object->octree_prev_object = nullptr;
-      object->octree_next_object = first;
+      // A pending re-leveling was computed for the old cells
+      relevel(std::numeric_limits<uint32_t>::max());
+      m_root_size = size;
+      for (auto const& [code, current] : m_nodes)
+        compute_cell_bounds(current);
 
-      // Update the previous first pointer's (if valid) prev pointer to object
-      if (first != nullptr)
-        first->octree_prev_object = object;
+      std::vector<uint32_t> codes;
+      codes.reserve(m_nodes.size());
+      for (auto const& [code, current] : m_nodes)
+        codes.push_back(code);
 
-      // Set the first pointer to object
-      first = object;
+      // Relocate the objects of every node that existed before the change
+      for (uint32_t code : codes)
+      {
+        node* current = find_node(code);
+        T* object = current != nullptr ? current->first : nullptr;
+        while (object != nullptr)
+        {
+          T* next = object->octree_next_object;
+          relocate(object);
+          object = next;
+        }
+      }
     }
 
 
     /**
-    * @brief Removes object from the linked list of objects of type T of the node it belongs to.
+    * @brief Changes the number of levels. Existing nodes are not rebuilt, instead the affected ones
+    *        are queued and re-leveled in place by relevel(), which can be spread across frames.
+    * @param levels       The new number of levels.
+    */
+    template<typename T, int Dim>
+    void octree<T, Dim>::set_levels(uint32_t levels)
+    {
+      if (levels == m_levels)
+        return;
+
+      // The multi-cell depth may change, and the re-leveling only moves the home of those objects
+      std::vector<T*> multiCell = take_multi_cell_objects();
+
+      uint32_t previousLevels = m_levels;
+      m_levels = levels;
+      queue_relevel(previousLevels);
+
+      for (T* object : multiCell)
+        insert(object);
+    }
+
+
+    /**
+    * @brief Queues the nodes whose objects may belong to a different node after a change of levels,
+    *        deepest first. Nodes deeper than the new levels will be collapsed into their ancestor, and
+    *        objects in the previous leaves will be pushed down (unless adaptive, which splits on demand).
+    * @param previous_levels       The levels in use before the change.
+    */
+    template<typename T, int Dim>
+    void octree<T, Dim>::queue_relevel(uint32_t previous_levels)
+    {
+      const int dimension = Dim;
+      const uint32_t maxLevels = (sizeof(uint32_t) * 8 - 1) / dimension;
+
+      // Bucket the nodes by depth, the queue is consumed from the back so it goes from shallowest to deepest
+      std::vector<std::vector<uint32_t>> byDepth(maxLevels + 1);
+      for (auto const& [code, current] : m_nodes)
+      {
+        uint32_t depth = locational_code_depth<Dim>(code);
+        bool collapse = depth > m_levels;
+        bool pushDown = !m_adaptive && m_levels > previous_levels && depth == previous_levels;
+
+        // Nodes already waiting keep the levels their objects were placed with
+        if ((collapse || pushDown) && current->relevel_levels == 0)
+        {
+          current->relevel_levels = previous_levels;
+          byDepth[depth].push_back(code);
+        }
+      }
+
+      // Nodes still waiting from a previous change are processed first
+      std::vector<uint32_t> queue;
+      for (auto const& codes : byDepth)
+        queue.insert(queue.end(), codes.begin(), codes.end());
+      queue.insert(queue.end(), m_relevel_queue.begin(), m_relevel_queue.end());
+      m_relevel_queue.swap(queue);
+    }
+
+
+    /**
+    * @brief Processes the queued nodes of a change of levels until the time budget runs out (checked after
+    *        each node). Nodes deeper than the levels move their objects to the ancestor at the maximum depth
+    *        by shifting their code, the rest relocate their objects with the new levels.
+    * @param budget_us       The time budget in microseconds.
+    * @return bool           True if there is no re-leveling left to do.
+    */
+    template<typename T, int Dim>
+    bool octree<T, Dim>::relevel(uint32_t budget_us)
+    {
+      const int dimension = Dim;
+      auto start = std::chrono::steady_clock::now();
+
+      while (!m_relevel_queue.empty())
+      {
+        uint32_t code = m_relevel_queue.back();
+        m_relevel_queue.pop_back();
+
+        // The node may have been deleted or already left by its objects
+        node* current = find_node(code);
+        if (current == nullptr || current->relevel_levels == 0)
+          continue;
+        current->relevel_levels = 0;
+
+        uint32_t depth = locational_code_depth<Dim>(code);
+        if (depth > m_levels)
+        {
+          // Collapse into the ancestor at the maximum depth (which exists, as all ancestors do)
+          node* ancestor = find_node(code >> (dimension * (depth - m_levels)));
+          assert(ancestor != nullptr);
+          while (current->first != nullptr)
+          {
+            T* object = current->first;
+            current->remove(object);
+            ancestor->push_front(object);
+            object->octree_node = ancestor;
+          }
+          invalidate_mass(current->locational_code);
+
+          // Deeper nodes were processed before, so it is usually a leaf by now
+          if (current->children_active == 0)
+            delete_node_rec(code);
+        }
+        else
+        {
+          // The objects may fit in the newly allowed children
+          T* object = current->first;
+          while (object != nullptr)
+          {
+            T* next = object->octree_next_object;
+            relocate(object);
+            object = next;
+          }
+        }
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        if (static_cast<uint64_t>(elapsed.count()) >= budget_us)
+          break;
+      }
+
+      return m_relevel_queue.empty();
+    }
+
+
+    /**
+    * @brief Removes object from its node, deleting the nodes that end up empty. In adaptive mode,
+    *        the parent node gets its children merged back if their objects fell below the merge threshold.
     * @param object       A pointer to the object to remove.
     */
-    template<typename T>
-    void octree<T>::node::remove(T * object)
+    template<typename T, int Dim>
+    void octree<T, Dim>::erase(T* object)
     {
-      assert(object != nullptr);
+      assert(object != nullptr && object->octree_node != nullptr);
 
-      // If its the first, reset the first pointer
-      if (object == first)
-        first = object->octree_next_object;
+      node* oldNode = object->octree_node;
+      uint32_t oldCode = oldNode->locational_code;
+      invalidate_mass(oldNode->locational_code);
 
-      // If object's next pointer is valid, update next's prev pointer
-      if (object->octree_next_object != nullptr)
-        object->octree_next_object->octree_prev_object = object->octree_prev_object;
+      if (multi_cell_span const* span = find_multi_cell(object, oldNode))
+      {
+        erase_multi_cell(object, *span);
+        return;
+      }
 
-      // If object's prev pointer is valid, update prev's next pointer
-      if (object->octree_prev_object != nullptr)
-        object->octree_prev_object->octree_next_object = object->octree_next_object;
+      // In concurrent mode, its children are checked when the deletion is flushed
+      if (m_concurrent)
+      {
+        oldNode->lock();
+        oldNode->remove(object);
+        bool empty = oldNode->first == nullptr;
+        oldNode->unlock();
+        if (empty)
+          defer_delete(oldCode);
+        return;
+      }
 
-      // Reset all of its pointers to nullptr
-      object->octree_next_object = nullptr;
-      object->octree_prev_object = nullptr;
-      object->octree_node = nullptr;
+      oldNode->remove(object);
+
+      // If the node obj used to belong to has now 0 objs, and 0 child nodes active, then we can delete it
+      if (!oldNode->has_objects() && oldNode->children_active == 0)
+        delete_node_rec(oldCode);
+
+      if (m_adaptive)
+        merge_children(oldCode);
+    }
+
+
+    /**
+    * @brief Samples the bvs of the objects in [first, last) and picks the root size and number of levels
+    *        that minimize the predicted pair checks (see tune_octree_parameters). The octree is not
+    *        modified, the result is stored to be queried with last_tuning().
+    * @param first            Iterator to the first object pointer.
+    * @param last             Iterator past the last object pointer.
+    * @param max_samples      The maximum number of objects whose bv is used to predict the checks.
+    * @return octree_tuning   The chosen parameters and predictions.
+    */
+    template<typename T, int Dim>
+    template<typename It>
+    octree_tuning const& octree<T, Dim>::auto_tune(It first, It last, uint32_t max_samples)
+    {
+      uint64_t objectCount = static_cast<uint64_t>(std::distance(first, last));
+      uint64_t stride = glm::max<uint64_t>(1u, (objectCount + max_samples - 1) / glm::max(max_samples, 1u));
+
+      // The extent uses every object (no object may end up outside of the root), the checks only a sample
+      glm::vec3 extent(0.0f);
+      std::vector<aabb> samples;
+      samples.reserve(static_cast<size_t>(glm::min<uint64_t>(objectCount, max_samples)));
+      uint64_t index = 0;
+      for (It it = first; it != last; ++it, ++index)
+      {
+        aabb const& bv = (*it)->bv_world;
+        extent = glm::max(extent, glm::max(glm::abs(bv.mMinPos), glm::abs(bv.mMaxPos)));
+        if (index % stride == 0)
+          samples.push_back(bv);
+      }
+
+      m_last_tuning = tune_octree_parameters<Dim>(samples, objectCount, extent, m_root_size, m_levels, m_interval);
+      return m_last_tuning;
+    }
+
+
+    /**
+    * @brief Computes the code of the node an object whose full depth code is locational_code belongs to
+    *        in adaptive mode: the deepest existing node on its path, or a new child of it if that node is
+    *        already split.
+    * @param locational_code       The code of the object at the maximum depth (m_levels).
+    * @return uint32_t             The code of the node the object belongs to.
+    */
+    template<typename T, int Dim>
+    uint32_t octree<T, Dim>::adaptive_locational_code(uint32_t locational_code) const
+    {
+      const int dimension = Dim;
+
+      // Find the deepest existing node on the path from the root to locational_code
+      uint32_t ancestor = locational_code;
+      while (ancestor > 1 && find_node(ancestor) == nullptr)
+        ancestor >>= dimension;
+
+      if (ancestor == locational_code)
+        return locational_code;
+
+      // Empty tree, everything starts at the root
+      node const* existing = find_node(ancestor);
+      if (existing == nullptr)
+        return 1u;
+
+      // A split node hands the object down to its child on the path
+      if (existing->children_active != 0)
+      {
+        uint32_t depthOffset = locational_code_depth<Dim>(locational_code) - locational_code_depth<Dim>(ancestor);
+        return locational_code >> (dimension * (depthOffset - 1));
+      }
+
+      return ancestor;
+    }
+
+
+    /**
+    * @brief Pushes the objects of a leaf node down into its children if it holds more than the split
+    *        threshold and the maximum depth wasn't reached. Objects that straddle the children stay.
+    *        The children that end up too full are split recursively.
+    * @param to_split       The node to split.
+    */
+    template<typename T, int Dim>
+    void octree<T, Dim>::split_node(node* to_split)
+    {
+      const int dimension = Dim;
+      uint32_t depth = locational_code_depth<Dim>(to_split->locational_code);
+
+      if (to_split->children_active != 0 || to_split->object_count <= m_split_threshold || depth >= m_levels)
+        return;
+
+      // Move each object that fits in a child to it
+      T* object = to_split->first;
+      while (object != nullptr)
+      {
+        T* next = object->octree_next_object;
+
+        uint32_t code = locational_code(object->bv_world);
+        uint32_t codeDepth = locational_code_depth<Dim>(code);
+        if (codeDepth > depth)
+        {
+          uint32_t childCode = code >> (dimension * (codeDepth - depth - 1));
+          assert((childCode >> dimension) == to_split->locational_code);
+
+          to_split->remove(object);
+          node* child = create_node(childCode);
+          child->push_front(object);
+          object->octree_node = child;
+          invalidate_mass(child->locational_code);
+        }
+
+        object = next;
+      }
+
+      // The objects may have all gone to the same child
+      uint32_t maxChilds = 1u << dimension;
+      for (uint32_t i = 0; i < maxChilds; ++i)
+        if (to_split->children_active & (1u << i))
+          split_node(find_node((to_split->locational_code << dimension) + i));
+    }
+
+
+    /**
+    * @brief Moves the objects of the children of a node back into it and deletes them, if all of the
+    *        children are leaves and together with the node they hold less than the merge threshold.
+    *        Starting from locational_code (which may not exist anymore), this is repeated on the
+    *        ancestors until a node whose children can't be merged is found.
+    * @param locational_code       The code of the first node whose children we want to merge.
+    */
+    template<typename T, int Dim>
+    void octree<T, Dim>::merge_children(uint32_t locational_code)
+    {
+      const int dimension = Dim;
+      uint32_t maxChilds = 1u << dimension;
+
+      for (; locational_code >= 1; locational_code >>= dimension)
+      {
+        // Deleted nodes and leaves have nothing to merge, try with the parent
+        node* parentNode = find_node(locational_code);
+        if (parentNode == nullptr || parentNode->children_active == 0)
+          continue;
+
+        // Only leaf children are merged, and only if they are few enough
+        uint32_t total = parentNode->object_count;
+        for (uint32_t i = 0; i < maxChilds; ++i)
+        {
+          if (parentNode->children_active & (1u << i))
+          {
+            node const* child = find_node((locational_code << dimension) + i);
+            if (child->children_active != 0)
+              return;
+            total += child->object_count;
+          }
+        }
+
+        if (total >= m_merge_threshold)
+          return;
+
+        // Move the objects of each child into the parent and delete the child
+        for (uint32_t i = 0; i < maxChilds; ++i)
+        {
+          if (parentNode->children_active & (1u << i))
+          {
+            uint32_t childCode = (locational_code << dimension) + i;
+            node* child = find_node(childCode);
+            invalidate_mass(child->locational_code);
+            while (child->first != nullptr)
+            {
+              T* object = child->first;
+              child->remove(object);
+              parentNode->push_front(object);
+              object->octree_node = parentNode;
+            }
+            delete_node(childCode);
+          }
+        }
+        parentNode->children_active = 0;
+      }
+    }
+
+
+    /**
+    * @brief Caches the integer bounds of the cell of a node, which are used to skip the computation of
+    *        the locational code of objects that didn't leave it.
+    * @param to_compute       The node whose cell bounds we are to compute.
+    */
+    template<typename T, int Dim>
+    void octree<T, Dim>::compute_cell_bounds(node* to_compute) const
+    {
+      const int dimension = Dim;
+
+      aabb cell = compute_bv<Dim>(to_compute->locational_code, m_root_size);
+      for (int axis = 0; axis < dimension; ++axis)
+      {
+        to_compute->cell_min[axis] = static_cast<int>(cell.mMinPos[axis]);
+        to_compute->cell_max[axis] = static_cast<int>(cell.mMaxPos[axis]);
+      }
+    }
+
+
+    /**
+    * @brief Checks, without computing locational codes, whether an object with the given bv belongs to the
+    *        node it's in: its grid corners must be inside the cell, and unless the node can't have children
+    *        for it (maximum depth, or an adaptive leaf), they must straddle one of the planes splitting the cell.
+    * @param current          The node the object is in.
+    * @param bv               The current bv of the object.
+    * @return bool            True if the object belongs to current.
+    */
+    template<typename T, int Dim>
+    bool octree<T, Dim>::stays_in_node(node const* current, aabb const& bv) const
+    {
+      const int dimension = Dim;
+
+      // Nodes waiting to be re-leveled use other levels
+      if (current->relevel_levels != 0)
+        return false;
+
+      glm::vec<Dim, int> minCorner;
+      glm::vec<Dim, int> maxCorner;
+      compute_grid_corners<Dim>(bv, m_interval, minCorner, maxCorner);
+
+      // Must be inside the cell
+      for (int axis = 0; axis < dimension; ++axis)
+        if (minCorner[axis] < current->cell_min[axis] || maxCorner[axis] >= current->cell_max[axis])
+          return false;
+
+      // A leaf keeps anything inside it
+      if (current->depth >= m_levels || (m_adaptive && current->children_active == 0))
+        return true;
+
+      // Otherwise it must not fit in a single child
+      for (int axis = 0; axis < dimension; ++axis)
+      {
+        int center = (current->cell_min[axis] + current->cell_max[axis]) / 2;
+        if (minCorner[axis] < center && maxCorner[axis] >= center)
+          return true;
+      }
+
+      return false;
+    }
+
+
+    /**
+    * @brief Gathers the shape of the octree: the nodes and objects of each level, the occupancy of the
+    *        nodes, how crowded the hash map is and an approximation of the memory in use.
+    *        It visits every node and bucket, so it is meant to be sampled, not called for every query.
+    * @return octree_stats       The statistics, along with a copy of the current counters.
+    */
+    template<typename T, int Dim>
+    octree_stats octree<T, Dim>::stats() const
+    {
+      octree_stats result;
+      result.nodes_per_level.assign(m_levels + 1, 0u);
+      result.objects_per_level.assign(m_levels + 1, 0u);
+      result.node_count = static_cast<uint32_t>(m_nodes.size());
+      result.counters = m_counters;
+
+      for (uint32_t level = 0; level <= max_depth; ++level)
+      {
+        // Nodes waiting to be re-leveled may still be deeper than the levels in use
+        if (m_level_counts[level] != 0 && level >= result.nodes_per_level.size())
+        {
+          result.nodes_per_level.resize(level + 1, 0u);
+          result.objects_per_level.resize(level + 1, 0u);
+        }
+
+        for_each_node_at_level(level, [&result, level](node const* current)
+        {
+          result.nodes_per_level[level]++;
+          result.objects_per_level[level] += current->object_count;
+          result.object_count += current->object_count;
+          result.max_objects_per_node = std::max(result.max_objects_per_node, current->object_count);
+        });
+      }
+      if (result.node_count != 0)
+        result.mean_objects_per_node = static_cast<float>(result.object_count) / result.node_count;
+
+      // A find walks the chain of its bucket up to the node, half of it on average
+      uint64_t probeSum = 0;
+      result.bucket_count = m_nodes.bucket_count();
+      result.load_factor = m_nodes.load_factor();
+      for (size_t bucket = 0; bucket < result.bucket_count; ++bucket)
+      {
+        uint64_t size = m_nodes.bucket_size(bucket);
+        result.max_probe_length = std::max(result.max_probe_length, static_cast<uint32_t>(size));
+        probeSum += size * (size + 1) / 2;
+      }
+      if (result.node_count != 0)
+        result.mean_probe_length = static_cast<float>(probeSum) / result.node_count;
+
+      // Each map entry is a heap allocated list node holding the key, the value and the link (and usually the hash)
+      size_t entryBytes = sizeof(std::pair<const uint32_t, node*>) + 2 * sizeof(void*);
+      result.memory_bytes = sizeof(*this)
+                          + result.node_count * (sizeof(node) + entryBytes)
+                          + result.bucket_count * sizeof(void*)
+                          + m_relevel_queue.capacity() * sizeof(uint32_t)
+                          + m_mass.size() * (sizeof(std::pair<const uint32_t, mass_aggregate>) + 2 * sizeof(void*))
+                          + m_last_tuning.predicted_checks_per_level.capacity() * sizeof(uint64_t);
+
+      return result;
+    }
+
+
+    /**
+    * @brief Enables or disables the concurrent mode. In concurrent mode insert, relocate, erase, create_node
+    *        and delete_node_rec may be called from several threads (each object being updated by a single thread),
+    *        node deletions are deferred until flush_deletes, and nothing else may be called until then.
+    *        Adaptive depth and re-leveling are not supported while concurrent. Multi-cell objects share
+    *        their span and the references of several nodes, so enabling it reinserts them in a single node,
+    *        and no new ones are made while concurrent.
+    * @param concurrent       Whether to enable the concurrent mode.
+    */
+    template<typename T, int Dim>
+    void octree<T, Dim>::set_concurrent(bool concurrent)
+    {
+      assert(!concurrent || !m_adaptive);
+
+      if (m_concurrent && !concurrent)
+      {
+        m_concurrent = false;
+        flush_deletes();
+      }
+      else if (!m_concurrent && concurrent)
+      {
+        // The concurrent updates don't mark the nodes they change
+        m_mass_all_dirty = true;
+        m_mass_fresh = false;
+      }
+      if (!m_concurrent && concurrent && !m_multi_cells.empty())
+      {
+        std::vector<T*> objects = take_multi_cell_objects();
+        m_concurrent = true;
+        for (T* object : objects)
+          insert(object);
+      }
+      m_concurrent = concurrent;
+    }
+
+
+    /**
+    * @brief Deletes the nodes that were emptied in concurrent mode, if they are still empty. Must be called
+    *        from a single thread, once the concurrent updates of the frame are done.
+    */
+    template<typename T, int Dim>
+    void octree<T, Dim>::flush_deletes()
+    {
+      bool concurrent = m_concurrent;
+      m_concurrent = false;
+
+      // The same node may have been emptied more than once
+      std::sort(m_deferred_deletes.begin(), m_deferred_deletes.end(), std::greater<uint32_t>());
+      m_deferred_deletes.erase(std::unique(m_deferred_deletes.begin(), m_deferred_deletes.end()), m_deferred_deletes.end());
+      for (uint32_t code : m_deferred_deletes)
+      {
+        if (find_node(code) != nullptr)
+          delete_node_rec(code);
+      }
+      m_deferred_deletes.clear();
+
+      m_concurrent = concurrent;
+    }
+
+
+    /**
+    * @brief Queues the deletion of a node (from any thread) until flush_deletes.
+    * @param locational_code       The code of the node to delete.
+    */
+    template<typename T, int Dim>
+    void octree<T, Dim>::defer_delete(uint32_t locational_code)
+    {
+      std::lock_guard<std::mutex> lock(m_deferred_mutex);
+      m_deferred_deletes.push_back(locational_code);
+    }
+
+
+    /**
+    * @brief Sets how long empty nodes are kept before being deleted, so that objects moving back and forth
+    *        across a boundary don't delete and create the same nodes every frame. The empty nodes are deleted
+    *        by end_frame once they have been empty for 'frames' frames, or oldest first when they take more
+    *        than 'budget_bytes'.
+    * @param frames           The frames to keep an empty node for, 0 deletes them right away.
+    * @param budget_bytes     The maximum memory of the empty nodes kept.
+    */
+    template<typename T, int Dim>
+    void octree<T, Dim>::set_node_retention(uint32_t frames, size_t budget_bytes)
+    {
+      m_retention_frames = frames;
+      m_retention_budget = budget_bytes;
+
+      // Nothing will be retained anymore, release the ones being kept
+      if (frames == 0)
+        end_frame();
+    }
+
+
+    /**
+    * @brief Marks the frame boundary, and deletes the empty nodes that have been kept for long enough (or
+    *        exceed the budget). Nodes that got objects or children again are just unmarked.
+    */
+    template<typename T, int Dim>
+    void octree<T, Dim>::end_frame()
+    {
+      m_frame++;
+
+      // Unmark the reused nodes, drop the entries of nodes that were deleted some other way
+      size_t kept = 0;
+      for (uint32_t code : m_retained)
+      {
+        node* current = find_node(code);
+        if (current == nullptr || current->empty_since == 0)
+          continue;
+        if (current->has_objects() || current->children_active != 0)
+        {
+          current->empty_since = 0;
+          continue;
+        }
+        m_retained[kept++] = code;
+      }
+      m_retained.resize(kept);
+
+      // Delete the expired ones (they are oldest first), and then as many as needed to fit in the budget
+      size_t maxRetained = m_retention_budget / sizeof(node);
+      size_t toDelete = 0;
+      while (toDelete < m_retained.size())
+      {
+        node const* current = find_node(m_retained[toDelete]);
+        bool expired = m_frame - (current->empty_since - 1) >= m_retention_frames;
+        if (!expired && m_retained.size() - toDelete <= maxRetained)
+          break;
+        toDelete++;
+      }
+
+      uint32_t frames = m_retention_frames;
+      m_retention_frames = 0;
+      for (size_t i = 0; i < toDelete; ++i)
+      {
+        // A node deleted and created again some other way may be listed twice
+        node* current = find_node(m_retained[i]);
+        if (current == nullptr)
+          continue;
+        current->empty_since = 0;
+        delete_node_rec(m_retained[i]);
+      }
+      m_retention_frames = frames;
+      m_retained.erase(m_retained.begin(), m_retained.begin() + static_cast<std::ptrdiff_t>(toDelete));
+    }
+
+
+    /**
+    * @brief Marks an empty node (without objects nor children) to be kept until end_frame decides to delete it.
+    * @param locational_code       The code of the node.
+    */
+    template<typename T, int Dim>
+    void octree<T, Dim>::retain(uint32_t locational_code)
+    {
+      node* current = find_node(locational_code);
+      if (current == nullptr || current->has_objects() || current->children_active != 0 || current->empty_since != 0)
+        return;
+
+      current->empty_since = m_frame + 1;
+      m_retained.push_back(locational_code);
+    }
+
+
+    /**
+    * @brief Sets the multi-cell insertion policy: objects that would sit above the given depth (because they
+    *        straddle its cells) and overlap at most max_cells of its cells are referenced from each of those
+    *        cells, instead of being tested against everything below their common ancestor. Pairs are then
+    *        reported once by for_each_pair. Ignored in adaptive and concurrent modes.
+    *        The objects already in the tree above that depth are inserted again with the new policy.
+    * @param level          The depth of the cells to reference (clamped to the levels), 0 disables it.
+    * @param max_cells      The maximum cells an object may be referenced from.
+    */
+    template<typename T, int Dim>
+    void octree<T, Dim>::set_multi_cell(uint32_t level, uint32_t max_cells)
+    {
+      std::vector<T*> objects = take_multi_cell_objects();
+      for (uint32_t depth = 0; depth < glm::max(multi_cell_depth(), glm::min(level, m_levels)); ++depth)
+      {
+        for_each_node_at_level(depth, [&objects](node* current)
+        {
+          for (T* object = current->first; object != nullptr; object = object->octree_next_object)
+            objects.push_back(object);
+        });
+      }
+
+      for (T* object : objects)
+      {
+        if (object->octree_node != nullptr)
+          erase(object);
+      }
+
+      m_multi_cell_level = level;
+      m_multi_cell_max = max_cells;
+      for (T* object : objects)
+        insert(object);
+    }
+
+
+    /**
+    * @brief Patches the links to the objects after they were moved to other addresses (by copying them, so
+    *        their own links still hold the old addresses): the lists of the nodes, the multi-cell references
+    *        and spans. The nodes don't move, so octree_node stays valid.
+    * @param remap        Callable returning the new address of an object given its old one (nullptr for nullptr).
+    */
+    template<typename T, int Dim>
+    template<typename Remap>
+    void octree<T, Dim>::remap_objects(Remap remap)
+    {
+      for (auto const& [code, current] : m_nodes)
+      {
+        // The list is walked through the moved objects, patching each link before following it
+        current->first = remap(current->first);
+        for (T* object = current->first; object != nullptr; object = object->octree_next_object)
+        {
+          object->octree_next_object = remap(object->octree_next_object);
+          object->octree_prev_object = remap(object->octree_prev_object);
+        }
+
+        if (current->references)
+          for (T*& object : *current->references)
+            object = remap(object);
+      }
+
+      std::unordered_map<T const*, multi_cell_span> multiCells;
+      multiCells.reserve(m_multi_cells.size());
+      for (auto const& [object, span] : m_multi_cells)
+        multiCells.emplace(remap(const_cast<T*>(object)), span);  // They were inserted as T*
+      m_multi_cells.swap(multiCells);
+    }
+
+
+    /**
+    * @brief Computes the range of cells at the multi-cell depth that bv overlaps (with the same corners used
+    *        for its locational code).
+    * @param bv           The bounding volume.
+    * @param span         Out-parameter for the range of cells.
+    * @return bool        Whether the object should be inserted in multiple cells: it is inside the root and
+    *                     overlaps more than one and at most the maximum cells.
+    */
+    template<typename T, int Dim>
+    bool octree<T, Dim>::compute_cell_span(aabb const& bv, multi_cell_span& span) const
+    {
+      const int dimension = Dim;
+
+      uint32_t depth = multi_cell_depth();
+      int cellSize = static_cast<int>(m_root_size >> depth);
+      int halfSize = static_cast<int>(m_root_size / 2);
+      if (depth == 0 || cellSize == 0)
+        return false;
+
+      glm::vec<Dim, int> minCorner;
+      glm::vec<Dim, int> maxCorner;
+      compute_grid_corners<Dim>(bv, m_interval, minCorner, maxCorner);
+
+      uint32_t cells = 1;
+      for (int axis = 0; axis < dimension; ++axis)
+      {
+        if (minCorner[axis] < -halfSize || maxCorner[axis] >= halfSize)
+          return false;
+        span.min[axis] = (minCorner[axis] + halfSize) / cellSize;
+        span.max[axis] = (maxCorner[axis] + halfSize) / cellSize;
+        cells *= static_cast<uint32_t>(span.max[axis] - span.min[axis] + 1);
+      }
+
+      return cells > 1 && cells <= m_multi_cell_max;
+    }
+
+
+    /**
+    * @brief Computes the locational code of a cell at the multi-cell depth.
+    * @param cell         The integer coordinates of the cell, in [0, 2^depth) on each axis.
+    * @return uint32_t    The code of the cell.
+    */
+    template<typename T, int Dim>
+    uint32_t octree<T, Dim>::cell_code(glm::vec<Dim, int> const& cell) const
+    {
+      uint32_t depth = multi_cell_depth();
+      int cellSize = static_cast<int>(m_root_size >> depth);
+      int halfSize = static_cast<int>(m_root_size / 2);
+      return compute_locational_code<Dim>(cell * cellSize - halfSize, m_root_size, depth);
+    }
+
+
+    /**
+    * @brief Finds the span of an object if it was inserted in multiple cells.
+    * @param object                   The object.
+    * @param in                       The node the object was found in (only nodes at the multi-cell depth can hold them).
+    * @return multi_cell_span const*  Its span, or nullptr if it is in a single node.
+    */
+    template<typename T, int Dim>
+    typename octree<T, Dim>::multi_cell_span const* octree<T, Dim>::find_multi_cell(T const* object, node const* in) const
+    {
+      if (m_multi_cells.empty() || in == nullptr || in->depth != multi_cell_depth())
+        return nullptr;
+
+      auto foundIt = m_multi_cells.find(object);
+      return foundIt != m_multi_cells.end() ? &foundIt->second : nullptr;
+    }
+
+
+    /**
+    * @brief Calls function with every cell of a span but its first one (the home of the object), x first.
+    * @param span         The range of cells.
+    * @param function     Callable taking the integer coordinates of a cell.
+    */
+    template<typename T, int Dim>
+    template<typename F>
+    void octree<T, Dim>::for_each_span_cell(multi_cell_span const& span, F&& function) const
+    {
+      const int dimension = Dim;
+
+      glm::vec<Dim, int> cell = span.min;
+      while (true)
+      {
+        if (cell != span.min)
+          function(cell);
+
+        // Advance like an odometer, the axes past the last one wrap around
+        int axis = 0;
+        for (; axis < dimension; ++axis)
+        {
+          if (cell[axis] < span.max[axis])
+          {
+            cell[axis]++;
+            break;
+          }
+          cell[axis] = span.min[axis];
+        }
+        if (axis == dimension)
+          return;
+      }
+    }
+
+
+    /**
+    * @brief Links object in the first cell of its span (its home, which object->octree_node points to) and
+    *        references it from the rest of the cells.
+    * @param object       The object to insert.
+    * @param span         The cells it overlaps.
+    */
+    template<typename T, int Dim>
+    void octree<T, Dim>::insert_multi_cell(T* object, multi_cell_span const& span)
+    {
+      assert(!m_concurrent);
+      node* home = create_node(cell_code(span.min));
+      home->push_front(object);
+      object->octree_node = home;
+      invalidate_mass(home->locational_code);
+
+      for_each_span_cell(span, [this, object](glm::vec<Dim, int> const& cell)
+      {
+        node* other = create_node(cell_code(cell));
+        if (!other->references)
+          other->references = std::make_unique<std::vector<T*>>();
+        other->references->push_back(object);
+      });
+
+      m_multi_cells[object] = span;
+    }
+
+
+    /**
+    * @brief Removes a multi-cell object from its home and from every cell referencing it, deleting the
+    *        nodes that end up empty.
+    * @param object       The object to remove.
+    * @param span         The cells it was inserted in (a copy, its entry is erased).
+    */
+    template<typename T, int Dim>
+    void octree<T, Dim>::erase_multi_cell(T* object, multi_cell_span span)
+    {
+      node* home = object->octree_node;
+      uint32_t homeCode = home->locational_code;
+      home->remove(object);
+      m_multi_cells.erase(object);
+
+      for_each_span_cell(span, [this, object](glm::vec<Dim, int> const& cell)
+      {
+        uint32_t code = cell_code(cell);
+        node* other = find_node(code);
+        assert(other != nullptr && other->references);
+
+        std::vector<T*>& references = *other->references;
+        auto foundIt = std::find(references.begin(), references.end(), object);
+        assert(foundIt != references.end());
+        *foundIt = references.back();
+        references.pop_back();
+
+        if (!other->has_objects() && other->children_active == 0)
+          delete_node_rec(code);
+      });
+
+      if (!home->has_objects() && home->children_active == 0)
+        delete_node_rec(homeCode);
+    }
+
+
+    /**
+    * @brief Removes every multi-cell object from the tree.
+    * @return std::vector<T*>     The removed objects, to be inserted again.
+    */
+    template<typename T, int Dim>
+    std::vector<T*> octree<T, Dim>::take_multi_cell_objects()
+    {
+      std::vector<T*> objects;
+      objects.reserve(m_multi_cells.size());
+      for (auto const& [object, span] : m_multi_cells)
+        objects.push_back(const_cast<T*>(object));  // They were inserted as T*
+
+      for (T* object : objects)
+        erase(object);
+      return objects;
+    }
+
+
+    /**
+    * @brief Decides if a pair of object with another one (of this or another tree) is reported from the node it
+    *        was found in. Pairs with a multi-cell object can be found in several cells, they belong to the cell
+    *        (at the multi-cell depth) holding the min corner of the range of cells that both objects overlap.
+    * @param object       The object.
+    * @param in           The node object was found in.
+    * @param other        The bv of the other object of the pair.
+    * @return bool        Whether the pair is reported from in (always, for objects in a single node).
+    */
+    template<typename T, int Dim>
+    bool octree<T, Dim>::reports_from(T const* object, node const* in, aabb const& other) const
+    {
+      const int dimension = Dim;
+
+      multi_cell_span const* span = find_multi_cell(object, in);
+      if (span == nullptr)
+        return true;
+
+      int cellSize = static_cast<int>(m_root_size >> multi_cell_depth());
+      int halfSize = static_cast<int>(m_root_size / 2);
+      int lastCell = static_cast<int>(m_root_size) / cellSize - 1;
+
+      // The range of the other object starts at its min corner, clamped to the root
+      glm::vec<Dim, int> otherMin;
+      glm::vec<Dim, int> otherMax;
+      compute_grid_corners<Dim>(other, m_interval, otherMin, otherMax);
+      for (int axis = 0; axis < dimension; ++axis)
+      {
+        int owner = glm::max(span->min[axis], glm::clamp((otherMin[axis] + halfSize) / cellSize, 0, lastCell));
+        if ((in->cell_min[axis] + halfSize) / cellSize != owner)
+          return false;
+      }
+      return true;
+    }
+
+
+    /**
+    * @brief Decides if a pair found by for_each_pair is reported where it was found (see reports_from).
+    * @param a            The object of the shallower node.
+    * @param a_node       The node a was found in.
+    * @param b            The other object.
+    * @param b_node       The node b was found in (a_node or one of its descendants).
+    * @return bool        Whether the pair is reported here.
+    */
+    template<typename T, int Dim>
+    bool octree<T, Dim>::owns_pair(T const* a, node const* a_node, T const* b, node const* b_node) const
+    {
+      return reports_from(a, a_node, b->bv_world) && reports_from(b, b_node, a->bv_world);
+    }
+
+
+    /**
+    * @brief Calls function with every object of a node: its list and then the multi-cell objects it references.
+    * @param in           The node.
+    * @param function     Callable taking a T*.
+    */
+    template<typename T, int Dim>
+    template<typename F>
+    void octree<T, Dim>::for_each_object_in(node const* in, F&& function) const
+    {
+      for (T* object = in->first; object != nullptr; object = object->octree_next_object)
+        function(object);
+      if (in->references)
+        for (T* object : *in->references)
+          function(object);
+    }
+
+
+    /**
+    * @brief Top-down broadphase: calls function with every pair of objects in the same node, and with every
+    *        object of a node against the objects of the descendants whose cell its bv overlaps. Pairs with
+    *        multi-cell objects are reported once.
+    * @param function     Callable taking two T*.
+    */
+    template<typename T, int Dim>
+    template<typename F>
+    void octree<T, Dim>::for_each_pair(F&& function) const
+    {
+      const int dimension = Dim;
+      const uint32_t maxChilds = 1u << dimension;
+
+      std::vector<T*> objects;
+      std::vector<node const*> toVisit;
+      auto pushChildren = [this, &toVisit](node const* parent)
+      {
+        for (uint32_t i = 0; i < maxChilds; ++i)
+        {
+          if (parent->children_active & (1u << i))
+            toVisit.push_back(find_node((parent->locational_code << dimension) + i));
+        }
+      };
+
+      for (auto const& [code, current] : m_nodes)
+      {
+        objects.clear();
+        for_each_object_in(current, [&objects](T* object) { objects.push_back(object); });
+
+        // Every pair in the node
+        for (size_t i = 0; i < objects.size(); ++i)
+        {
+          for (size_t j = i + 1; j < objects.size(); ++j)
+          {
+            if (owns_pair(objects[i], current, objects[j], current))
+              function(objects[i], objects[j]);
+          }
+        }
+        if (objects.empty())
+          continue;
+
+        // Every object against the descendants its bv overlaps
+        toVisit.clear();
+        pushChildren(current);
+        while (!toVisit.empty())
+        {
+          node const* child = toVisit.back();
+          toVisit.pop_back();
+          pushChildren(child);
+
+          for (T* object : objects)
+          {
+            if (!overlaps(child, object->bv_world))
+              continue;
+            for_each_object_in(child, [&](T* other)
+            {
+              if (owns_pair(object, current, other, child))
+                function(object, other);
+            });
+          }
+        }
+      }
+    }
+
+
+    /**
+    * @brief Calls function once with every object in the tree (multi-cell objects from their home only).
+    * @param function     Callable taking a T*.
+    */
+    template<typename T, int Dim>
+    template<typename F>
+    void octree<T, Dim>::for_each_object(F&& function) const
+    {
+      for (auto const& [code, current] : m_nodes)
+      {
+        for (T* object = current->first; object != nullptr; object = object->octree_next_object)
+          function(object);
+      }
+    }
+
+
+    /**
+    * @brief Range query: calls function once with every object whose bv intersects the given one. Only the
+    *        nodes whose cell intersects bv are visited (the root always is, it holds the objects outside it).
+    * @param bv           The bounding volume to query.
+    * @param function     Callable taking a T*.
+    */
+    template<typename T, int Dim>
+    template<typename F>
+    void octree<T, Dim>::query(aabb const& bv, F&& function) const
+    {
+      query_cells(bv, [&](T* object)
+      {
+        if (overlaps(object->bv_world, bv))
+          function(object);
+      });
+    }
+
+
+    /**
+    * @brief Calls function once with every object of the nodes whose cell intersects bv, without testing the
+    *        bvs of the objects (the candidates of query, as for_each_pair gives candidate pairs).
+    * @param bv           The bounding volume to query.
+    * @param function     Callable taking a T*.
+    */
+    template<typename T, int Dim>
+    template<typename F>
+    void octree<T, Dim>::query_cells(aabb const& bv, F&& function) const
+    {
+      const int dimension = Dim;
+      const uint32_t maxChilds = 1u << dimension;
+
+      node const* root = find_node(1u);
+      if (root == nullptr)
+        return;
+
+      std::vector<node const*> toVisit{root};
+      while (!toVisit.empty())
+      {
+        node const* current = toVisit.back();
+        toVisit.pop_back();
+
+        // A multi-cell object is reported from the first cell of its range that the query range overlaps
+        for_each_object_in(current, [&](T* object)
+        {
+          if (reports_from(object, current, bv))
+            function(object);
+        });
+
+        for (uint32_t i = 0; i < maxChilds; ++i)
+        {
+          if ((current->children_active & (1u << i)) == 0)
+            continue;
+          node const* child = find_node((current->locational_code << dimension) + i);
+          if (overlaps(child, bv))
+            toVisit.push_back(child);
+        }
+      }
+    }
+
+
+    /**
+    * @brief Updates the mass and center of mass of the objects in the subtree of the nodes changed since the last
+    *        call (insert, erase and relocate mark the node and its ancestors), bottom-up: each dirty node adds the
+    *        objects in it (multi-cell objects from their home only) and the aggregates of its children, deepest
+    *        nodes first. The nodes are then laid out depth first for for_each_mass. Nothing is done if the tree
+    *        didn't change, so mass_of must keep returning the same masses (see invalidate_aggregates).
+    * @param mass_of      Callable returning the float mass of an object (given a T const*).
+    */
+    template<typename T, int Dim>
+    template<typename MassOf>
+    void octree<T, Dim>::compute_aggregates(MassOf mass_of)
+    {
+      const int dimension = Dim;
+      const uint32_t maxChilds = 1u << dimension;
+
+      assert(!m_concurrent);
+      if (m_mass_fresh)
+        return;
+
+      if (m_mass_all_dirty)
+      {
+        m_mass.clear();
+        m_mass_changed.clear();
+        for (auto const& [code, current] : m_nodes)
+        {
+          m_mass[code].dirty = true;
+          m_mass_changed.push_back(code);
+        }
+        m_mass_all_dirty = false;
+      }
+
+      // A deeper code has its sentinel bit higher, so decreasing codes give the children before their parent
+      std::sort(m_mass_changed.begin(), m_mass_changed.end(), std::greater<uint32_t>());
+      for (uint32_t code : m_mass_changed)
+      {
+        node const* current = find_node(code);
+        if (current == nullptr)
+        {
+          m_mass.erase(code);
+          continue;
+        }
+
+        float mass = 0.0f;
+        glm::vec3 weightedPosition(0.0f);
+        for (T const* object = current->first; object != nullptr; object = object->octree_next_object)
+        {
+          float objectMass = mass_of(object);
+          mass += objectMass;
+          weightedPosition += objectMass * (object->bv_world.mMinPos + object->bv_world.mMaxPos) * 0.5f;
+        }
+
+        for (uint32_t i = 0; i < maxChilds; ++i)
+        {
+          if ((current->children_active & (1u << i)) == 0)
+            continue;
+          mass_aggregate const& child = m_mass[(code << dimension) + i];
+          mass += child.mass;
+          weightedPosition += child.mass * child.center_of_mass;
+        }
+
+        mass_aggregate& aggregate = m_mass[code];
+        aggregate.mass = mass;
+        aggregate.center_of_mass = mass > 0.0f ? weightedPosition / mass : glm::vec3(0.0f);
+        aggregate.dirty = false;
+      }
+      m_mass_changed.clear();
+
+      // Depth first layout of the nodes with mass, the skip of a node is set once its subtree is laid out
+      m_mass_nodes.clear();
+      node const* root = find_node(1u);
+      m_mass_fresh = true;
+      if (root == nullptr)
+        return;
+
+      std::vector<std::pair<node const*, uint32_t>> toVisit{{root, 0u}};  // Node, and 1 + its index once laid out
+      while (!toVisit.empty())
+      {
+        auto& [current, index] = toVisit.back();
+        if (index != 0)
+        {
+          m_mass_nodes[index - 1].skip = static_cast<uint32_t>(m_mass_nodes.size());
+          toVisit.pop_back();
+          continue;
+        }
+
+        index = static_cast<uint32_t>(m_mass_nodes.size()) + 1;
+        uint32_t code = current->locational_code;
+        mass_aggregate const& aggregate = m_mass[code];
+        m_mass_nodes.push_back({aggregate.center_of_mass, aggregate.mass, static_cast<float>(current->cell_max.x - current->cell_min.x), 0u, current});
+        uint8_t children = current->children_active;
+        for (uint32_t i = maxChilds; i-- > 0;)
+        {
+          if ((children & (1u << i)) == 0)
+            continue;
+          uint32_t childCode = (code << dimension) + i;
+          if (m_mass[childCode].mass > 0.0f)
+            toVisit.emplace_back(find_node(childCode), 0u);
+        }
+      }
+    }
+
+
+    /**
+    * @brief Marks the aggregates of every node as outdated, for when the masses returned by mass_of change.
+    */
+    template<typename T, int Dim>
+    void octree<T, Dim>::invalidate_aggregates()
+    {
+      m_mass_all_dirty = true;
+      m_mass_fresh = false;
+    }
+
+
+    /**
+    * @brief Finds the aggregates of a node, as of the last compute_aggregates.
+    * @param locational_code       The code of the node.
+    * @return mass_aggregate const* Its aggregates, nullptr if they weren't computed.
+    */
+    template<typename T, int Dim>
+    typename octree<T, Dim>::mass_aggregate const* octree<T, Dim>::find_aggregate(uint32_t locational_code) const
+    {
+      auto foundIt = m_mass.find(locational_code);
+      return foundIt != m_mass.end() ? &foundIt->second : nullptr;
+    }
+
+
+    /**
+    * @brief Marks the aggregates of a node and its ancestors as outdated, up to the first one that already is
+    *        (whose ancestors are as well). Nothing is marked while every node will be recomputed anyway, so a
+    *        tree that never computes aggregates doesn't fill the table. Concurrent updates don't mark nodes
+    *        either, see set_concurrent.
+    * @param locational_code       The code of the node whose objects changed (or that was created or deleted).
+    */
+    template<typename T, int Dim>
+    void octree<T, Dim>::invalidate_mass(uint32_t locational_code)
+    {
+      const int dimension = Dim;
+
+      if (m_concurrent)
+        return;
+
+      m_mass_fresh = false;
+      if (m_mass_all_dirty)
+        return;
+      for (uint32_t code = locational_code; code != 0u; code >>= dimension)
+      {
+        mass_aggregate& aggregate = m_mass[code];
+        if (aggregate.dirty)
+          break;
+        aggregate.dirty = true;
+        m_mass_changed.push_back(code);
+      }
+    }
+
+
+    /**
+    * @brief Barnes-Hut traversal: calls function with the masses that act on a position, approximating far
+    *        nodes by their aggregates (see compute_aggregates). A node is approximated when its cell size is
+    *        less than theta times the distance to its center of mass and the object isn't in its subtree,
+    *        otherwise its objects are given one by one and its children are visited. Nothing is given if the
+    *        tree changed since compute_aggregates.
+    * @param object       The object the masses act on, which is skipped (may be nullptr).
+    * @param position     The position the masses act on.
+    * @param theta        The opening angle, 0 gives every object one by one.
+    * @param mass_of      Callable returning the float mass of an object (given a T const*).
+    * @param function     Callable taking a float mass and a glm::vec3 position.
+    */
+    template<typename T, int Dim>
+    template<typename MassOf, typename F>
+    void octree<T, Dim>::for_each_mass(T const* object, glm::vec3 const& position, float theta, MassOf mass_of, F&& function) const
+    {
+      // The layout points to the nodes, which insert, erase and relocate may have deleted
+      if (!m_mass_fresh)
+        return;
+
+      uint32_t objectCode = object != nullptr && object->octree_node != nullptr ? object->octree_node->locational_code : 0u;
+      float thetaSq = theta * theta;
+
+      // Stackless, an approximated node jumps over its subtree
+      for (uint32_t i = 0; i < m_mass_nodes.size();)
+      {
+        mass_node const& current = m_mass_nodes[i];
+        uint32_t code = current.source->locational_code;
+
+        // The root is never approximated, it also holds the objects outside of it
+        glm::vec3 toCenter = current.center_of_mass - position;
+        bool holdsObject = objectCode != 0u && is_locational_code_prefix<Dim>(code, objectCode);
+        if (code != 1u && !holdsObject && current.size * current.size < thetaSq * glm::dot(toCenter, toCenter))
+        {
+          function(current.mass, current.center_of_mass);
+          i = current.skip;
+          continue;
+        }
+
+        for (T const* other = current.source->first; other != nullptr; other = other->octree_next_object)
+        {
+          if (other != object)
+            function(mass_of(other), (other->bv_world.mMinPos + other->bv_world.mMaxPos) * 0.5f);
+        }
+        i++;
+      }
+    }
+
+
+    /**
+    * @brief Checks whether two bvs intersect on the axes of the tree (a quadtree ignores z).
+    * @param a            The first bounding volume.
+    * @param b            The second bounding volume.
+    * @return bool        True if they intersect (touching counts).
+    */
+    template<typename T, int Dim>
+    bool octree<T, Dim>::overlaps(aabb const& a, aabb const& b)
+    {
+      const int dimension = Dim;
+
+      for (int axis = 0; axis < dimension; ++axis)
+        if (b.mMinPos[axis] > a.mMaxPos[axis] || b.mMaxPos[axis] < a.mMinPos[axis])
+          return false;
+      return true;
+    }
+
+
+    /**
+    * @brief Checks whether a bv intersects the cell of a node on the axes of the tree.
+    * @param cell         The node.
+    * @param bv           The bounding volume.
+    * @return bool        True if they intersect (touching counts).
+    */
+    template<typename T, int Dim>
+    bool octree<T, Dim>::overlaps(node const* cell, aabb const& bv)
+    {
+      const int dimension = Dim;
+
+      for (int axis = 0; axis < dimension; ++axis)
+        if (bv.mMinPos[axis] > static_cast<float>(cell->cell_max[axis]) || bv.mMaxPos[axis] < static_cast<float>(cell->cell_min[axis]))
+          return false;
+      return true;
+    }
+
+
+    /**
+    * @brief Increments one of the counters, atomically in concurrent mode.
+    * @param counter       The counter to increment.
+    */
+    template<typename T, int Dim>
+    void octree<T, Dim>::count(uint32_t& counter)
+    {
+      if (m_concurrent)
+        std::atomic_ref<uint32_t>(counter).fetch_add(1u, std::memory_order_relaxed);
+      else
+        counter++;
+    }
+
+
+    /**
+    * @brief Adds an object of type T to the beginning of the linked list of this node.
+    * @param object       A pointer to the object to add.
+    */
+    template<typename T, int Dim>
+    void octree<T, Dim>::node::push_front(T * object)
+    {
+      assert(object != nullptr);
+
+      // Update object's connecting pointers
+      object->octree_prev_object = nullptr;
+      object->octree_next_object = first;
+
+      // Update the previous first pointer's (if valid) prev pointer to object
+      if (first != nullptr)
+        first->octree_prev_object = object;
+
+      // Set the first pointer to object
+      first = object;
+      ++object_count;
+    }
+
+
+    /**
+    * @brief Removes object from the linked list of objects of type T of the node it belongs to.
+    * @param object       A pointer to the object to remove.
+    */
+    template<typename T, int Dim>
+    void octree<T, Dim>::node::remove(T * object)
+    {
+      assert(object != nullptr);
+
+      // If its the first, reset the first pointer
+      if (object == first)
+        first = object->octree_next_object;
+
+      // If object's next pointer is valid, update next's prev pointer
+      if (object->octree_next_object != nullptr)
+        object->octree_next_object->octree_prev_object = object->octree_prev_object;
+
+      // If object's prev pointer is valid, update prev's next pointer
+      if (object->octree_prev_object != nullptr)
+        object->octree_prev_object->octree_next_object = object->octree_next_object;
+
+      assert(object_count > 0);
+      --object_count;
+
+      // Reset all of its pointers to nullptr
+      object->octree_next_object = nullptr;
+      object->octree_prev_object = nullptr;
+      object->octree_node = nullptr;
+    }
+
+
+    /**
+    * @brief Acquires the spinlock of the node, which guards its object list in concurrent mode.
+    */
+    template<typename T, int Dim>
+    void octree<T, Dim>::node::lock()
+    {
+      while (spinlock.test_and_set(std::memory_order_acquire))
+      {
+        // Wait without writing to the cache line
+        while (spinlock.test(std::memory_order_relaxed))
+          std::this_thread::yield();
+      }
+    }
+
+
+    /**
+    * @brief Releases the spinlock of the node.
+    */
+    template<typename T, int Dim>
+    void octree<T, Dim>::node::unlock()
+    {
+      spinlock.clear(std::memory_order_release);
+    }
+
+
+    /**
+    * @brief Recursive part of spatial_join. Visits a cell of both trees, pairing the objects of each tree in it
+    *        with the ones of the other tree in it and in its ancestors, and then the children of either tree.
+    * @param tree_a       The first octree.
+    * @param tree_b       The second octree.
+    * @param code         The locational code of the cell.
+    * @param active_a     Objects of tree_a in the ancestors that overlap the cell, from first_a on (and the nodes
+    *                     they were found in). The objects of this node are appended for the children.
+    * @param first_a      Start of the objects of this cell in active_a.
+    * @param active_b     Same for tree_b.
+    * @param first_b      Start of the objects of this cell in active_b.
+    * @param function     Callable taking an A* and a B*.
+    */
+    template <typename A, typename B, int Dim, typename F>
+    void spatial_join_rec(octree<A, Dim> const& tree_a, octree<B, Dim> const& tree_b, uint32_t code,
+                          std::vector<std::pair<A*, typename octree<A, Dim>::node const*>>& active_a, size_t first_a,
+                          std::vector<std::pair<B*, typename octree<B, Dim>::node const*>>& active_b, size_t first_b,
+                          F& function)
+    {
+      const int dimension = Dim;
+      const uint32_t maxChilds = 1u << dimension;
+
+      auto const* nodeA = tree_a.find_node(code);
+      auto const* nodeB = tree_b.find_node(code);
+      size_t ancestorsA = active_a.size();
+      size_t ancestorsB = active_b.size();
+
+      auto report = [&](A* a, typename octree<A, Dim>::node const* inA, B* b, typename octree<B, Dim>::node const* inB)
+      {
+        if (tree_a.reports_from(a, inA, b->bv_world) && tree_b.reports_from(b, inB, a->bv_world))
+          function(a, b);
+      };
+
+      // The objects of this cell against the ones of the other tree here and above
+      if (nodeA != nullptr)
+      {
+        tree_a.for_each_object_in(nodeA, [&](A* a)
+        {
+          for (size_t i = first_b; i < ancestorsB; ++i)
+            report(a, nodeA, active_b[i].first, active_b[i].second);
+          if (nodeB != nullptr)
+            tree_b.for_each_object_in(nodeB, [&](B* b) { report(a, nodeA, b, nodeB); });
+          active_a.emplace_back(a, nodeA);
+        });
+      }
+      if (nodeB != nullptr)
+      {
+        tree_b.for_each_object_in(nodeB, [&](B* b)
+        {
+          for (size_t i = first_a; i < ancestorsA; ++i)
+            report(active_a[i].first, active_a[i].second, b, nodeB);
+          active_b.emplace_back(b, nodeB);
+        });
+      }
+
+      // Only the children where some tree has nodes and the other has objects (in them or overlapping them)
+      uint8_t childrenA = nodeA != nullptr ? nodeA->children_active : 0u;
+      uint8_t childrenB = nodeB != nullptr ? nodeB->children_active : 0u;
+      size_t endA = active_a.size();
+      size_t endB = active_b.size();
+      for (uint32_t i = 0; i < maxChilds; ++i)
+      {
+        bool inA = childrenA & (1u << i);
+        bool inB = childrenB & (1u << i);
+        if (!inA && !inB)
+          continue;
+
+        uint32_t childCode = (code << dimension) + i;
+        auto const* childA = inA ? tree_a.find_node(childCode) : nullptr;
+        auto const* childB = inB ? tree_b.find_node(childCode) : nullptr;
+        auto overlapsChild = [childA, childB](aabb const& bv)
+        {
+          return childA != nullptr ? octree<A, Dim>::overlaps(childA, bv) : octree<B, Dim>::overlaps(childB, bv);
+        };
+
+        // The objects above that can't overlap anything in the child are dropped
+        for (size_t j = first_a; j < endA; ++j)
+        {
+          if (overlapsChild(active_a[j].first->bv_world))
+            active_a.push_back(active_a[j]);
+        }
+        for (size_t j = first_b; j < endB; ++j)
+        {
+          if (overlapsChild(active_b[j].first->bv_world))
+            active_b.push_back(active_b[j]);
+        }
+
+        // Nothing to pair below if only one tree has the child and nothing of the other overlaps it
+        if ((inA && inB) || (inA && active_b.size() > endB) || (inB && active_a.size() > endA))
+          spatial_join_rec(tree_a, tree_b, childCode, active_a, endA, active_b, endB, function);
+        active_a.resize(endA);
+        active_b.resize(endB);
+      }
+    }
+
+
+    /**
+    * @brief Dual-tree spatial join: calls function with every candidate pair made of an object of tree_a and an
+    *        object of tree_b. Both trees are walked at the same time from the root, each node against the nodes
+    *        of the other tree with the same code and their ancestors and descendants (pruned by the cells the
+    *        objects overlap). Pairs within one of the trees are not generated, and no pair is reported twice.
+    * @param tree_a       The first octree.
+    * @param tree_b       The second octree, with the same root size (its levels and object type may differ).
+    * @param function     Callable taking an A* and a B*.
+    * @return bool        False if the roots don't match (nothing is reported).
+    */
+    template <typename A, typename B, int Dim, typename F>
+    bool spatial_join(octree<A, Dim> const& tree_a, octree<B, Dim> const& tree_b, F&& function)
+    {
+      if (tree_a.root_size() != tree_b.root_size())
+      {
+        std::cout<<"DEBUG : OCTREE : SPATIAL JOIN OF TREES WITH DIFFERENT ROOT SIZES\n";
+        return false;
+      }
+
+      std::vector<std::pair<A*, typename octree<A, Dim>::node const*>> activeA;
+      std::vector<std::pair<B*, typename octree<B, Dim>::node const*>> activeB;
+      spatial_join_rec(tree_a, tree_b, 1u, activeA, 0, activeB, 0, function);
+      return true;
+    }
+
+
+    /**
+    * @brief Computes the gravitational acceleration of every object with Barnes-Hut, in O(n log n). The aggregates
+    *        of the tree are computed first, then the objects are split in contiguous ranges among the threads,
+    *        which only read the tree.
+    * @param tree            The octree holding the objects.
+    * @param objects         The objects to compute the accelerations of.
+    * @param mass_of         Callable returning the float mass of an object (given a T const*).
+    * @param accelerations   Output, the acceleration of each object (in the order of objects).
+    * @param theta           The opening angle, larger is faster and less accurate.
+    * @param gravity         The gravitational constant.
+    * @param softening       Added (squared) to the squared distances, so that close objects don't diverge.
+    * @param thread_count    The number of threads to use.
+    */
+    template <typename T, int Dim, typename MassOf>
+    void compute_gravity(octree<T, Dim>& tree, std::vector<T*> const& objects, MassOf mass_of, std::vector<glm::vec3>& accelerations,
+                         float theta, float gravity, float softening, uint32_t thread_count)
+    {
+      tree.compute_aggregates(mass_of);
+      accelerations.assign(objects.size(), glm::vec3(0.0f));
+
+      auto computeRange = [&](size_t begin, size_t end)
+      {
+        for (size_t i = begin; i < end; ++i)
+        {
+          glm::vec3 position = (objects[i]->bv_world.mMinPos + objects[i]->bv_world.mMaxPos) * 0.5f;
+          glm::vec3 acceleration(0.0f);
+          tree.for_each_mass(objects[i], position, theta, mass_of, [&](float mass, glm::vec3 const& center)
+          {
+            glm::vec3 toCenter = center - position;
+            float distanceSq = glm::dot(toCenter, toCenter) + softening * softening;
+            acceleration += toCenter * (gravity * mass / (distanceSq * glm::sqrt(distanceSq)));
+          });
+          accelerations[i] = acceleration;
+        }
+      };
+
+      size_t workers = glm::max(thread_count, 1u);
+      if (workers == 1)
+      {
+        computeRange(0, objects.size());
+        return;
+      }
+
+      std::vector<std::thread> threads;
+      for (size_t w = 0; w < workers; ++w)
+        threads.emplace_back(computeRange, objects.size() * w / workers, objects.size() * (w + 1) / workers);
+      for (auto& thread : threads)
+        thread.join();
     }
-}
\ No newline at end of file
+}
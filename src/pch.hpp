@@ -10,19 +10,31 @@
  */
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <bit>
 #include <cassert>
+#include <chrono>
+#include <cstring>
 #include <vector>
 #include <queue>
 #include <exception>
 #include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <iterator>
+#include <limits>
 #include <unordered_map>
 #include <array>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <type_traits>
+#include <utility>
 
 
 #include "fwd.hpp"
@@ -0,0 +1,42 @@
+/**
+* @file radix_sort.hpp
+* @author Miguel Echeverria , 540000918 , miguel.echeverria@digipen.edu
+* @date 2020/11/07
+* @brief Contains the declaration of the radix sorter, a parallel LSD radix sort of locational
+*        (or Morton) codes paired with the index of what they belong to.
+*
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+
+#pragma once
+
+namespace cs350 {
+
+    /**
+     * @brief
+     * 	Least significant digit first radix sort of (code, index) pairs, stable, so equal codes keep their order.
+     *  Each pass counts the digits of a contiguous range of the pairs per thread, turns the counts into the
+     *  position of each (digit, thread) in the output, and each thread scatters its range there. Only the digits
+     *  below the highest bit set in some code are sorted, and passes where every code has the same digit are
+     *  skipped. The scratch buffer and the counts are kept between calls.
+     * @tparam Key
+     *  uint32_t or uint64_t
+     */
+    template <typename Key>
+    class radix_sorter
+    {
+      public:
+        using entry = std::pair<Key, uint32_t>;
+
+        void sort(std::vector<entry>& entries, uint32_t digit_bits = 8, uint32_t thread_count = 1);
+        void clear();
+
+        [[nodiscard]] size_t scratch_capacity() const { return m_scratch.capacity(); }
+
+      private:
+        std::vector<entry>    m_scratch;
+        std::vector<uint32_t> m_counts;     // Per thread and digit, then the output position of each
+    };
+}
+
+#include "radix_sort.inl"
@@ -0,0 +1,122 @@
+/**
+* @file radix_sort.inl
+* @author Miguel Echeverria , 540000918 , miguel.echeverria@digipen.edu
+* @date 2020/11/07
+* @brief Contains the implementation of the radix sorter.
+*
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+
+namespace cs350 {
+
+    /**
+    * @brief Sorts the entries by code. The threads split the entries in contiguous ranges and sync on a barrier
+    *        twice per pass: once their digits are counted, and once they are scattered.
+    * @param entries        The (code, index) pairs to sort, in place.
+    * @param digit_bits     The bits sorted per pass (8 or 11 are the usual, 11 makes a 32 bit code 3 passes).
+    * @param thread_count   The number of threads to use.
+    */
+    template<typename Key>
+    void radix_sorter<Key>::sort(std::vector<entry>& entries, uint32_t digit_bits, uint32_t thread_count)
+    {
+      assert(digit_bits >= 1 && digit_bits <= 16);
+
+      size_t count = entries.size();
+      if (count < 2)
+        return;
+
+      // Only the digits up to the highest bit set in some code need sorting
+      Key usedBits = 0;
+      for (entry const& current : entries)
+        usedBits |= current.first;
+      uint32_t passes = (static_cast<uint32_t>(std::bit_width(usedBits)) + digit_bits - 1) / digit_bits;
+      if (passes == 0)
+        return;
+
+      const uint32_t digitCount = 1u << digit_bits;
+      const Key digitMask = static_cast<Key>(digitCount - 1);
+      size_t workers = glm::clamp<size_t>(thread_count, 1u, count);
+      m_scratch.resize(count);
+      m_counts.assign(workers * digitCount, 0u);
+
+      entry* source = entries.data();
+      entry* target = m_scratch.data();
+      uint32_t shift = 0;
+      bool counted = false;   // Which of the two syncs of the pass completes
+      bool skip = false;      // Every code has the same digit, the pass doesn't move anything
+
+      // Runs on the last thread to arrive, before any of them goes on
+      auto onSync = [&]() noexcept
+      {
+        counted = !counted;
+        if (counted)
+        {
+          // The counts become the position of the first entry of each (digit, thread), digit major
+          uint32_t position = 0;
+          skip = false;
+          for (uint32_t digit = 0; digit < digitCount; ++digit)
+          {
+            uint32_t digitStart = position;
+            for (size_t w = 0; w < workers; ++w)
+            {
+              uint32_t& current = m_counts[w * digitCount + digit];
+              uint32_t digitEntries = current;
+              current = position;
+              position += digitEntries;
+            }
+            skip = skip || position - digitStart == count;
+          }
+        }
+        else
+        {
+          if (!skip)
+            std::swap(source, target);
+          shift += digit_bits;
+          std::fill(m_counts.begin(), m_counts.end(), 0u);
+        }
+      };
+      std::barrier sync(static_cast<std::ptrdiff_t>(workers), onSync);
+
+      auto sortRange = [&](size_t w)
+      {
+        size_t begin = count * w / workers;
+        size_t end = count * (w + 1) / workers;
+        uint32_t* counts = m_counts.data() + w * digitCount;
+
+        for (uint32_t pass = 0; pass < passes; ++pass)
+        {
+          for (size_t i = begin; i < end; ++i)
+            counts[static_cast<uint32_t>((source[i].first >> shift) & digitMask)]++;
+          sync.arrive_and_wait();
+
+          // Each thread keeps the order of its range, and the ranges are in order, so the sort is stable
+          if (!skip)
+            for (size_t i = begin; i < end; ++i)
+              target[counts[static_cast<uint32_t>((source[i].first >> shift) & digitMask)]++] = source[i];
+          sync.arrive_and_wait();
+        }
+      };
+
+      std::vector<std::thread> threads;
+      for (size_t w = 1; w < workers; ++w)
+        threads.emplace_back(sortRange, w);
+      sortRange(0);
+      for (auto& thread : threads)
+        thread.join();
+
+      // The last pass may have left the result in the scratch buffer, trade the buffers instead of copying
+      if (source != entries.data())
+        entries.swap(m_scratch);
+    }
+
+
+    /**
+    * @brief Releases the scratch buffer and the counts.
+    */
+    template<typename Key>
+    void radix_sorter<Key>::clear()
+    {
+      m_scratch = std::vector<entry>();
+      m_counts = std::vector<uint32_t>();
+    }
+}
@@ -0,0 +1,64 @@
+/**
+* @file size_class_broadphase.hpp
+* @author Miguel Echeverria , 540000918 , miguel.echeverria@digipen.edu
+* @date 2020/11/07
+* @brief Contains the declaration of the size class broadphase, which keeps one octree per
+*        range of object sizes, each one with the levels that suit its objects.
+*
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+
+#pragma once
+#include "octree.hpp"
+
+namespace cs350 {
+
+    /**
+     * @brief
+     * 	Broadphase for populations that mix small and big objects. Objects are classified by the largest side
+     *  of their bv, and each class has its own octree (same root) whose deepest cells are about twice as big as
+     *  its largest objects. Pairs within a class come from that octree, pairs across classes from range queries
+     *  of each object against the octrees of the smaller classes, so big objects are never tested against
+     *  every descendant of the node they straddle.
+     * @tparam T
+     *  Same requirements as octree<T>, an object is in a single class at a time
+     */
+    template <typename T>
+    class size_class_broadphase
+    {
+      private:
+        std::vector<float>                      m_extents;  // Largest side of the objects of each class but the last
+        std::vector<std::unique_ptr<octree<T>>> m_trees;    // One per class, the last one for the biggest objects
+        std::unordered_map<T const*, uint32_t>  m_class_of; // The class each object was inserted in
+        uint32_t                                m_root_size;
+
+      public:
+        size_class_broadphase();
+        ~size_class_broadphase();
+        size_class_broadphase(size_class_broadphase const&) = delete;
+        size_class_broadphase& operator=(size_class_broadphase const&) = delete;
+
+        void        set_classes(uint32_t root_size, std::vector<float> const& extents, uint32_t max_levels);
+        void        destroy();
+        uint32_t    class_of(aabb const& bv) const;
+
+        void        insert(T* object);
+        void        relocate(T* object);
+        void        erase(T* object);
+        void        end_frame();
+        template <typename Remap>
+        void        remap_objects(Remap remap);
+
+        template <typename F>
+        void        for_each_pair(F&& function) const;
+
+        [[nodiscard]] uint32_t          root_size() const { return m_root_size; }
+        [[nodiscard]] size_t            class_count() const { return m_trees.size(); }
+        [[nodiscard]] size_t            object_count() const { return m_class_of.size(); }
+        [[nodiscard]] octree<T>&        tree(size_t size_class) { return *m_trees[size_class]; }
+        [[nodiscard]] octree<T> const&  tree(size_t size_class) const { return *m_trees[size_class]; }
+        [[nodiscard]] std::vector<float> const& extents() const { return m_extents; }
+    };
+}
+
+#include "size_class_broadphase.inl"
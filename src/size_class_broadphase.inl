@@ -0,0 +1,219 @@
+/**
+* @file size_class_broadphase.inl
+* @author Miguel Echeverria , 540000918 , miguel.echeverria@digipen.edu
+* @date 2020/11/07
+* @brief Contains the implementation of the size class broadphase.
+*
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+
+namespace cs350 {
+
+    /**
+    * @brief Default constructor, a single class (a plain octree) until set_classes is called.
+    */
+    template<typename T>
+    size_class_broadphase<T>::size_class_broadphase()
+      : m_root_size(0)
+    {
+      m_trees.push_back(std::make_unique<octree<T>>());
+    }
+
+
+    /**
+    * @brief Destructor, destroys the nodes of every class.
+    */
+    template<typename T>
+    size_class_broadphase<T>::~size_class_broadphase()
+    {
+      destroy();
+    }
+
+
+    /**
+    * @brief Sets the size classes, and inserts the current objects again with them.
+    * @param root_size    The size of one side of the root bv (shared by every class).
+    * @param extents      The largest side of the objects of each class, in increasing order. Objects bigger than
+    *                     the last one go to an extra class.
+    * @param max_levels   The maximum levels of any class.
+    */
+    template<typename T>
+    void size_class_broadphase<T>::set_classes(uint32_t root_size, std::vector<float> const& extents, uint32_t max_levels)
+    {
+      std::vector<T*> objects;
+      objects.reserve(m_class_of.size());
+      for (auto const& [object, sizeClass] : m_class_of)
+        objects.push_back(const_cast<T*>(object));  // They were inserted as T*
+      for (T* object : objects)
+        erase(object);
+
+      // The deepest cells of a class are at least twice as big as its largest objects
+      auto levelsFor = [root_size, max_levels](float extent)
+      {
+        uint32_t levels = 0;
+        while (levels < glm::min(max_levels, octree<T>::max_depth) && static_cast<float>(root_size >> (levels + 1)) >= 2.0f * extent)
+          levels++;
+        return levels;
+      };
+
+      m_root_size = root_size;
+      m_extents = extents;
+      m_trees.clear();
+      for (size_t i = 0; i <= m_extents.size(); ++i)
+      {
+        float extent = i < m_extents.size() ? m_extents[i] : 2.0f * (m_extents.empty() ? static_cast<float>(root_size) : m_extents.back());
+        auto tree = std::make_unique<octree<T>>();
+        tree->set_root_size(root_size);
+        tree->set_levels(levelsFor(extent));
+        m_trees.push_back(std::move(tree));
+      }
+
+      for (T* object : objects)
+        insert(object);
+    }
+
+
+    /**
+    * @brief Destroys the nodes of every class and forgets the objects (without unlinking them, as octree::destroy).
+    */
+    template<typename T>
+    void size_class_broadphase<T>::destroy()
+    {
+      for (auto& tree : m_trees)
+        tree->destroy();
+      m_class_of.clear();
+    }
+
+
+    /**
+    * @brief Finds the size class of a bounding volume.
+    * @param bv           The bounding volume.
+    * @return uint32_t    The first class whose extent fits the largest side of bv.
+    */
+    template<typename T>
+    uint32_t size_class_broadphase<T>::class_of(aabb const& bv) const
+    {
+      glm::vec3 size = bv.mMaxPos - bv.mMinPos;
+      float extent = glm::max(size.x, glm::max(size.y, size.z));
+      auto foundIt = std::lower_bound(m_extents.begin(), m_extents.end(), extent);
+      return static_cast<uint32_t>(foundIt - m_extents.begin());
+    }
+
+
+    /**
+    * @brief Inserts an object in the octree of its size class.
+    * @param object       The object to insert.
+    */
+    template<typename T>
+    void size_class_broadphase<T>::insert(T* object)
+    {
+      assert(object != nullptr);
+
+      uint32_t sizeClass = class_of(object->bv_world);
+      m_trees[sizeClass]->insert(object);
+      m_class_of[object] = sizeClass;
+    }
+
+
+    /**
+    * @brief Moves an object to its new node, or to the octree of another class if its size changed. Objects
+    *        that were not inserted yet are inserted.
+    * @param object       The object to relocate.
+    */
+    template<typename T>
+    void size_class_broadphase<T>::relocate(T* object)
+    {
+      assert(object != nullptr);
+
+      auto foundIt = m_class_of.find(object);
+      if (foundIt == m_class_of.end())
+      {
+        insert(object);
+        return;
+      }
+
+      uint32_t sizeClass = class_of(object->bv_world);
+      if (sizeClass == foundIt->second)
+      {
+        m_trees[sizeClass]->relocate(object);
+        return;
+      }
+
+      m_trees[foundIt->second]->erase(object);
+      m_trees[sizeClass]->insert(object);
+      foundIt->second = sizeClass;
+    }
+
+
+    /**
+    * @brief Removes an object from the octree of its class.
+    * @param object       The object to remove.
+    */
+    template<typename T>
+    void size_class_broadphase<T>::erase(T* object)
+    {
+      auto foundIt = m_class_of.find(object);
+      if (foundIt == m_class_of.end())
+        return;
+
+      m_trees[foundIt->second]->erase(object);
+      m_class_of.erase(foundIt);
+    }
+
+
+    /**
+    * @brief Marks the frame boundary in every octree.
+    */
+    template<typename T>
+    void size_class_broadphase<T>::end_frame()
+    {
+      for (auto& tree : m_trees)
+        tree->end_frame();
+    }
+
+
+    /**
+    * @brief Patches the links to the objects after they were moved to other addresses (see octree::remap_objects).
+    * @param remap        Callable returning the new address of an object given its old one (nullptr for nullptr).
+    */
+    template<typename T>
+    template<typename Remap>
+    void size_class_broadphase<T>::remap_objects(Remap remap)
+    {
+      for (auto& tree : m_trees)
+        tree->remap_objects(remap);
+
+      std::unordered_map<T const*, uint32_t> classOf;
+      classOf.reserve(m_class_of.size());
+      for (auto const& [object, sizeClass] : m_class_of)
+        classOf.emplace(remap(const_cast<T*>(object)), sizeClass);  // They were inserted as T*
+      m_class_of.swap(classOf);
+    }
+
+
+    /**
+    * @brief Calls function with the candidate pairs: the octree pairs of each class, and every object against the
+    *        objects in the cells of the smaller classes that its bv intersects (found with range queries). Like
+    *        the pairs of an octree, the bvs of the candidates aren't tested against each other.
+    * @param function     Callable taking two T*.
+    */
+    template<typename T>
+    template<typename F>
+    void size_class_broadphase<T>::for_each_pair(F&& function) const
+    {
+      for (size_t sizeClass = 0; sizeClass < m_trees.size(); ++sizeClass)
+      {
+        m_trees[sizeClass]->for_each_pair(function);
+
+        if (sizeClass == 0)
+          continue;
+        m_trees[sizeClass]->for_each_object([&](T* object)
+        {
+          for (size_t smaller = 0; smaller < sizeClass; ++smaller)
+          {
+            m_trees[smaller]->query_cells(object->bv_world, [&](T* other) { function(object, other); });
+          }
+        });
+      }
+    }
+}
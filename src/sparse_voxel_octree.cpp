@@ -0,0 +1,332 @@
+/**
+* @file sparse_voxel_octree.cpp
+* @author Miguel Echeverria , 540000918 , miguel.echeverria@digipen.edu
+* @date 2020/11/07
+* @brief Contains the voxelization and the occupancy queries of the sparse voxel octree.
+*
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+
+#include "pch.hpp"
+#include "sparse_voxel_octree.hpp"
+#include "mesh_data.hpp"
+
+namespace cs350 {
+
+    /**
+    * @brief Voxelizes the given triangles. The triangles are split in contiguous ranges among the threads,
+    *        each one finding the codes of the voxels its triangles touch and sorting them, then the sorted
+    *        codes are merged and the nodes above the voxels are built from the deepest depth up.
+    * @param triangles      The triangles to voxelize, in the coordinates of the octree.
+    * @param root_size      The size of one side of the root bv.
+    * @param levels         The depth of the voxels, their size is root_size >> levels.
+    * @param thread_count   The number of threads to use.
+    * @return bool          False if the levels don't fit the root (nothing is built).
+    */
+    bool sparse_voxel_octree::build(std::vector<triangle> const& triangles, uint32_t root_size, uint32_t levels, uint32_t thread_count)
+    {
+      const int dimension = 3;
+      const uint32_t childMask = (1u << dimension) - 1;
+      const uint32_t maxLevels = (sizeof(uint32_t) * 8 - 1) / dimension;
+
+      clear();
+      if (levels == 0 || levels > maxLevels || (root_size >> levels) == 0)
+      {
+        std::cout<<"DEBUG : SPARSE_VOXEL_OCTREE : INVALID LEVELS FOR THE ROOT SIZE\n";
+        return false;
+      }
+      m_root_size = root_size;
+      m_levels = levels;
+
+      size_t workers = glm::max(thread_count, 1u);
+      std::vector<std::vector<uint32_t>> workerCodes(workers);
+      if (workers == 1)
+        voxelize(triangles, 0, triangles.size(), workerCodes[0]);
+      else
+      {
+        std::vector<std::thread> threads;
+        for (size_t w = 0; w < workers; ++w)
+          threads.emplace_back([&, w]()
+          {
+            voxelize(triangles, triangles.size() * w / workers, triangles.size() * (w + 1) / workers, workerCodes[w]);
+          });
+        for (auto& thread : threads)
+          thread.join();
+      }
+
+      // Merge the sorted codes of the workers, and drop the voxels touched by several triangles
+      std::vector<uint32_t> codes = std::move(workerCodes[0]);
+      for (size_t w = 1; w < workers; ++w)
+      {
+        size_t middle = codes.size();
+        codes.insert(codes.end(), workerCodes[w].begin(), workerCodes[w].end());
+        std::inplace_merge(codes.begin(), codes.begin() + middle, codes.end());
+      }
+      codes.erase(std::unique(codes.begin(), codes.end()), codes.end());
+
+      // The parents of sorted codes are sorted as well, so each depth comes from a pass over the one below
+      m_codes.resize(levels);
+      m_masks.resize(levels);
+      for (uint32_t depth = levels; depth-- > 0;)
+      {
+        std::vector<uint32_t>& parents = m_codes[depth];
+        std::vector<uint8_t>& masks = m_masks[depth];
+        for (uint32_t code : codes)
+        {
+          if (parents.empty() || parents.back() != code >> dimension)
+          {
+            parents.push_back(code >> dimension);
+            masks.push_back(0u);
+          }
+          masks.back() |= static_cast<uint8_t>(1u << (code & childMask));
+        }
+        codes = parents;
+      }
+
+      return true;
+    }
+
+
+    /**
+    * @brief Voxelizes the triangles of a mesh.
+    * @param mesh           The mesh, its positions indexed by mPosIndices.
+    * @param scale          Scale applied to the positions, to bring them to the coordinates of the octree.
+    * @param root_size      The size of one side of the root bv.
+    * @param levels         The depth of the voxels, their size is root_size >> levels.
+    * @param thread_count   The number of threads to use.
+    * @return bool          False if the levels don't fit the root (nothing is built).
+    */
+    bool sparse_voxel_octree::build(mesh_data const& mesh, float scale, uint32_t root_size, uint32_t levels, uint32_t thread_count)
+    {
+      std::vector<triangle> triangles;
+      triangles.reserve(mesh.mPosIndices.size() / 3);
+      for (size_t i = 0; i + 2 < mesh.mPosIndices.size(); i += 3)
+        triangles.emplace_back(mesh.positions[mesh.mPosIndices[i]] * scale,
+                               mesh.positions[mesh.mPosIndices[i + 1]] * scale,
+                               mesh.positions[mesh.mPosIndices[i + 2]] * scale);
+
+      return build(triangles, root_size, levels, thread_count);
+    }
+
+
+    /**
+    * @brief Releases the nodes, the octree is left empty.
+    */
+    void sparse_voxel_octree::clear()
+    {
+      m_codes.clear();
+      m_masks.clear();
+    }
+
+
+    /**
+    * @brief Finds the codes of the voxels that a range of triangles touch, tested against each voxel of
+    *        their bounds with the separating axis test. The codes are sorted and without repetitions.
+    * @param triangles      The triangles.
+    * @param begin          The first triangle of the range.
+    * @param end            One past the last triangle of the range.
+    * @param codes          Output, the codes of the voxels.
+    */
+    void sparse_voxel_octree::voxelize(std::vector<triangle> const& triangles, size_t begin, size_t end, std::vector<uint32_t>& codes) const
+    {
+      const int dimension = 3;
+
+      int halfSize = static_cast<int>(m_root_size / 2);
+      int voxelSize = static_cast<int>(m_root_size >> m_levels);
+      int voxelsPerSide = 1 << m_levels;
+
+      for (size_t i = begin; i < end; ++i)
+      {
+        triangle const& tri = triangles[i];
+        glm::vec3 triMin = glm::min(tri.mPos1, glm::min(tri.mPos2, tri.mPos3));
+        glm::vec3 triMax = glm::max(tri.mPos1, glm::max(tri.mPos2, tri.mPos3));
+
+        // Range of voxels the bounds of the triangle touch, clamped to the root
+        glm::ivec3 minVoxel;
+        glm::ivec3 maxVoxel;
+        bool outside = false;
+        for (int axis = 0; axis < dimension; ++axis)
+        {
+          minVoxel[axis] = static_cast<int>(glm::floor((triMin[axis] + halfSize) / voxelSize));
+          maxVoxel[axis] = static_cast<int>(glm::floor((triMax[axis] + halfSize) / voxelSize));
+          outside = outside || maxVoxel[axis] < 0 || minVoxel[axis] >= voxelsPerSide;
+          minVoxel[axis] = glm::clamp(minVoxel[axis], 0, voxelsPerSide - 1);
+          maxVoxel[axis] = glm::clamp(maxVoxel[axis], 0, voxelsPerSide - 1);
+        }
+        if (outside)
+          continue;
+
+        for (int z = minVoxel.z; z <= maxVoxel.z; ++z)
+          for (int y = minVoxel.y; y <= maxVoxel.y; ++y)
+            for (int x = minVoxel.x; x <= maxVoxel.x; ++x)
+            {
+              glm::ivec3 voxelMin = glm::ivec3(x, y, z) * voxelSize - halfSize;
+              aabb voxel(glm::vec3(voxelMin), glm::vec3(voxelMin + voxelSize));
+              if (intersection_triangle_aabb(tri, voxel))
+                codes.push_back(compute_locational_code<dimension>(voxelMin, m_root_size, m_levels));
+            }
+      }
+
+      std::sort(codes.begin(), codes.end());
+      codes.erase(std::unique(codes.begin(), codes.end()), codes.end());
+    }
+
+
+    /**
+    * @brief Finds a node by binary search among the nodes of its depth.
+    * @param depth            The depth of the node, less than levels.
+    * @param locational_code  The code of the node.
+    * @return size_t          The position of the node in its depth, or the node count of the depth if it doesn't exist.
+    */
+    size_t sparse_voxel_octree::find(uint32_t depth, uint32_t locational_code) const
+    {
+      std::vector<uint32_t> const& codes = m_codes[depth];
+      auto foundIt = std::lower_bound(codes.begin(), codes.end(), locational_code);
+      if (foundIt == codes.end() || *foundIt != locational_code)
+        return codes.size();
+      return static_cast<size_t>(foundIt - codes.begin());
+    }
+
+
+    /**
+    * @brief Checks whether the voxel of a position is occupied.
+    * @param position     The position, in the coordinates of the octree.
+    * @return bool        Whether some triangle touches its voxel (false outside the root).
+    */
+    bool sparse_voxel_octree::is_occupied(glm::vec3 const& position) const
+    {
+      const int dimension = 3;
+
+      if (empty())
+        return false;
+
+      glm::ivec3 floored(glm::floor(position));
+      int halfSize = static_cast<int>(m_root_size / 2);
+      for (int axis = 0; axis < dimension; ++axis)
+        if (floored[axis] < -halfSize || floored[axis] >= halfSize)
+          return false;
+
+      return is_occupied(compute_locational_code<dimension>(floored, m_root_size, m_levels));
+    }
+
+
+    /**
+    * @brief Checks whether a node has occupied voxels below it (for a voxel, whether it is occupied),
+    *        from the mask of its parent.
+    * @param locational_code  The code of the node, at most levels deep.
+    * @return bool            Whether it is occupied.
+    */
+    bool sparse_voxel_octree::is_occupied(uint32_t locational_code) const
+    {
+      const int dimension = 3;
+      const uint32_t childMask = (1u << dimension) - 1;
+
+      if (empty())
+        return false;
+
+      uint32_t depth = locational_code_depth(locational_code);
+      if (depth == 0)
+        return true;
+      if (depth > m_levels)
+        return false;
+
+      size_t parent = find(depth - 1, locational_code >> dimension);
+      return parent != m_codes[depth - 1].size() && (m_masks[depth - 1][parent] & (1u << (locational_code & childMask)));
+    }
+
+
+    /**
+    * @brief Coarse collision: checks whether bv touches an occupied voxel, visiting only the occupied
+    *        children whose cell intersects bv.
+    * @param bv           The bounding volume to check.
+    * @return bool        True if some occupied voxel intersects bv.
+    */
+    bool sparse_voxel_octree::intersects(aabb const& bv) const
+    {
+      const int dimension = 3;
+      const uint32_t maxChilds = 1u << dimension;
+
+      if (empty())
+        return false;
+
+      // Node and position in its depth
+      std::vector<std::pair<uint32_t, size_t>> toVisit{{1u, 0u}};
+      while (!toVisit.empty())
+      {
+        auto [code, index] = toVisit.back();
+        toVisit.pop_back();
+
+        uint32_t depth = locational_code_depth(code);
+        uint8_t mask = m_masks[depth][index];
+        for (uint32_t i = 0; i < maxChilds; ++i)
+        {
+          uint32_t childCode = (code << dimension) + i;
+          if ((mask & (1u << i)) == 0 || !intersection_aabb_aabb(compute_bv(childCode, m_root_size), bv))
+            continue;
+          if (depth + 1 == m_levels)
+            return true;
+          toVisit.emplace_back(childCode, find(depth + 1, childCode));
+        }
+      }
+      return false;
+    }
+
+
+    /**
+    * @brief Lists the codes of the occupied voxels, sorted.
+    * @return std::vector<uint32_t>   The locational codes of the voxels.
+    */
+    std::vector<uint32_t> sparse_voxel_octree::voxels() const
+    {
+      const int dimension = 3;
+      const uint32_t maxChilds = 1u << dimension;
+
+      std::vector<uint32_t> result;
+      if (empty())
+        return result;
+
+      std::vector<uint32_t> const& parents = m_codes[m_levels - 1];
+      for (size_t i = 0; i < parents.size(); ++i)
+        for (uint32_t octant = 0; octant < maxChilds; ++octant)
+          if (m_masks[m_levels - 1][i] & (1u << octant))
+            result.push_back((parents[i] << dimension) + octant);
+      return result;
+    }
+
+
+    /**
+    * @brief Number of occupied voxels.
+    * @return size_t      The voxel count.
+    */
+    size_t sparse_voxel_octree::voxel_count() const
+    {
+      size_t count = 0;
+      if (!empty())
+        for (uint8_t mask : m_masks[m_levels - 1])
+          count += std::popcount(mask);
+      return count;
+    }
+
+
+    /**
+    * @brief Number of nodes with occupied voxels below them, not counting the voxels.
+    * @return size_t      The node count.
+    */
+    size_t sparse_voxel_octree::node_count() const
+    {
+      size_t count = 0;
+      for (auto const& codes : m_codes)
+        count += codes.size();
+      return count;
+    }
+
+
+    /**
+    * @brief Memory used by the nodes, a code and a mask each.
+    * @return size_t      The size in bytes.
+    */
+    size_t sparse_voxel_octree::memory_bytes() const
+    {
+      return node_count() * (sizeof(uint32_t) + sizeof(uint8_t));
+    }
+}
@@ -0,0 +1,52 @@
+/**
+* @file sparse_voxel_octree.hpp
+* @author Miguel Echeverria , 540000918 , miguel.echeverria@digipen.edu
+* @date 2020/11/07
+* @brief Contains the declaration of the sparse voxel octree, which voxelizes triangle
+*        meshes onto the leaf grid of an octree and stores the occupancy as child masks.
+*
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+
+#pragma once
+#include "octree.hpp"
+
+namespace cs350 {
+    struct mesh_data;
+
+    /**
+     * @brief
+     * 	Occupancy of the cells at the deepest level of an octree (the voxels) that some triangle touches.
+     *  Only the nodes with occupied voxels below them exist, each one as its locational code plus a mask of
+     *  its occupied children, with the nodes of each depth sorted by code. Voxels are not stored, they are
+     *  the bits of the masks of the last depth. The root, levels and codes are the same as the ones of octree.
+     */
+    class sparse_voxel_octree
+    {
+      public:
+        bool build(std::vector<triangle> const& triangles, uint32_t root_size, uint32_t levels, uint32_t thread_count = 1);
+        bool build(mesh_data const& mesh, float scale, uint32_t root_size, uint32_t levels, uint32_t thread_count = 1);
+        void clear();
+
+        [[nodiscard]] bool is_occupied(glm::vec3 const& position) const;
+        [[nodiscard]] bool is_occupied(uint32_t locational_code) const;
+        [[nodiscard]] bool intersects(aabb const& bv) const;
+        [[nodiscard]] std::vector<uint32_t> voxels() const;
+
+        [[nodiscard]] bool     empty() const { return m_codes.empty() || m_codes[0].empty(); }
+        [[nodiscard]] size_t   voxel_count() const;
+        [[nodiscard]] size_t   node_count() const;
+        [[nodiscard]] size_t   memory_bytes() const;
+        [[nodiscard]] uint32_t root_size() const { return m_root_size; }
+        [[nodiscard]] uint32_t levels() const { return m_levels; }
+
+      private:
+        void   voxelize(std::vector<triangle> const& triangles, size_t begin, size_t end, std::vector<uint32_t>& codes) const;
+        size_t find(uint32_t depth, uint32_t locational_code) const;
+
+        std::vector<std::vector<uint32_t>> m_codes;   // For each depth but the last, the nodes with occupied voxels
+        std::vector<std::vector<uint8_t>>  m_masks;   // Their occupied children
+        uint32_t                           m_root_size{0};
+        uint32_t                           m_levels{0};
+    };
+}
@@ -0,0 +1,104 @@
+/**
+* @file spatial_reorder.cpp
+* @author Miguel Echeverria , 540000918 , miguel.echeverria@digipen.edu
+* @date 2020/11/07
+* @brief Contains the computation of the Morton and Hilbert codes of the cells of a grid.
+*
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+
+#include "pch.hpp"
+#include "spatial_reorder.hpp"
+
+namespace cs350 {
+
+    /**
+    * @brief Computes the position of a cell along the Hilbert curve of its grid, with Skilling's method:
+    *        the coordinates are turned into the transposed Hilbert index (undoing the rotations and
+    *        reflections of each level, then Gray coding), whose bits are then interleaved.
+    * @param cell         The coordinates of the cell, in [0, 2^bits) on each axis.
+    * @param bits         The bits of each coordinate, at most 32 / dimension.
+    * @return uint32_t    The Hilbert code, in [0, 2^(bits * dimension)).
+    */
+    template <int dimension>
+    uint32_t hilbert_code(glm::vec<dimension, uint32_t> cell, uint32_t bits)
+    {
+      assert(bits * dimension <= sizeof(uint32_t) * 8);
+      if (bits == 0)
+        return 0u;
+
+      // Inverse undo of the rotations and reflections, from the coarsest level
+      uint32_t highest = 1u << (bits - 1);
+      for (uint32_t q = highest; q > 1; q >>= 1)
+      {
+        uint32_t lowerBits = q - 1;
+        for (int axis = 0; axis < dimension; ++axis)
+        {
+          if (cell[axis] & q)
+            cell[0] ^= lowerBits;
+          else
+          {
+            uint32_t swapped = (cell[0] ^ cell[axis]) & lowerBits;
+            cell[0] ^= swapped;
+            cell[axis] ^= swapped;
+          }
+        }
+      }
+
+      // Gray encode
+      for (int axis = 1; axis < dimension; ++axis)
+        cell[axis] ^= cell[axis - 1];
+      uint32_t flip = 0;
+      for (uint32_t q = highest; q > 1; q >>= 1)
+        if (cell[dimension - 1] & q)
+          flip ^= q - 1;
+      for (int axis = 0; axis < dimension; ++axis)
+        cell[axis] ^= flip;
+
+      // The transposed index holds the bits of each level spread over the axes, the first axis being the highest
+      uint32_t code = 0;
+      for (uint32_t bit = bits; bit-- > 0;)
+        for (int axis = 0; axis < dimension; ++axis)
+          code = (code << 1) | ((cell[axis] >> bit) & 1u);
+      return code;
+    }
+
+
+    /**
+    * @brief Computes the code of a position along a space filling curve over the grid of 2^bits cells per
+    *        side that divides the root. Positions outside the root are clamped to its border cells.
+    * @param position     The position, in the coordinates of the octree.
+    * @param root_size    The size of one side of the root bv.
+    * @param bits         The bits of each coordinate of the grid, at most 32 / dimension.
+    * @param curve        The curve to follow.
+    * @return uint32_t    The code (without sentinel) of the cell of position.
+    */
+    template <int dimension>
+    uint32_t curve_code(glm::vec3 const& position, uint32_t root_size, uint32_t bits, space_filling_curve curve)
+    {
+      float halfSize = static_cast<float>(root_size) * 0.5f;
+      float cellsPerUnit = static_cast<float>(1u << bits) / static_cast<float>(root_size);
+      float lastCell = static_cast<float>((1u << bits) - 1);
+
+      glm::vec<dimension, uint32_t> cell;
+      for (int axis = 0; axis < dimension; ++axis)
+        cell[axis] = static_cast<uint32_t>(glm::clamp(glm::floor((position[axis] + halfSize) * cellsPerUnit), 0.0f, lastCell));
+
+      if (curve == space_filling_curve::hilbert)
+        return hilbert_code<dimension>(cell, bits);
+
+      // Same layout as the locational codes, bit i of an axis goes to bit i * dimension + axis
+      uint32_t code = 0;
+      for (uint32_t i = 0; i < bits; ++i)
+        for (int axis = 0; axis < dimension; ++axis)
+          code |= ((cell[axis] >> i) & 1u) << (i * dimension + axis);
+      return code;
+    }
+
+
+    // Instantiations for octrees and quadtrees
+    template uint32_t hilbert_code<2>(glm::vec<2, uint32_t>, uint32_t);
+    template uint32_t hilbert_code<3>(glm::vec<3, uint32_t>, uint32_t);
+    template uint32_t curve_code<2>(glm::vec3 const&, uint32_t, uint32_t, space_filling_curve);
+    template uint32_t curve_code<3>(glm::vec3 const&, uint32_t, uint32_t, space_filling_curve);
+}
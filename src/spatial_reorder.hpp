@@ -0,0 +1,66 @@
+/**
+* @file spatial_reorder.hpp
+* @author Miguel Echeverria , 540000918 , miguel.echeverria@digipen.edu
+* @date 2020/11/07
+* @brief Contains the space filling curve codes (Morton and Hilbert) and the object arena, which
+*        lays objects out contiguously in the order of a curve so that neighbours share cache lines.
+*
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+
+#pragma once
+#include "octree.hpp"
+#include "radix_sort.hpp"
+
+namespace cs350 {
+
+    /**
+     * @brief
+     *  Order in which the cells of a grid are visited
+     */
+    enum class space_filling_curve
+    {
+        morton,     // Bits of the axes interleaved, the order of the locational codes
+        hilbert     // Consecutive cells are always adjacent, no jumps across the grid
+    };
+
+    template <int dimension = 3>
+    uint32_t hilbert_code(glm::vec<dimension, uint32_t> cell, uint32_t bits);
+    template <int dimension = 3>
+    uint32_t curve_code(glm::vec3 const& position, uint32_t root_size, uint32_t bits, space_filling_curve curve);
+
+    /**
+     * @brief
+     * 	Owns objects that are linked by pointers from elsewhere (octrees), so that they can be moved.
+     *  New objects are allocated one by one, until compact moves every object into a single block
+     *  sorted by a key (usually the curve code of their position) and patches the links to them.
+     * @tparam T
+     *  Must be movable
+     */
+    template <typename T>
+    class object_arena
+    {
+      public:
+        object_arena() = default;
+        object_arena(object_arena const&) = delete;
+        object_arena& operator=(object_arena const&) = delete;
+
+        T*    create();
+        void  destroy();
+        template <typename KeyOf, typename Patch>
+        void  compact(std::vector<T*>& objects, KeyOf key_of, Patch patch);
+        template <typename KeyOf>
+        float disorder(std::vector<T*> const& objects, KeyOf key_of) const;
+
+        [[nodiscard]] bool   in_block(T const* object) const;
+        [[nodiscard]] size_t block_size() const { return m_block.size(); }
+        [[nodiscard]] size_t spilled_count() const { return m_spilled.size(); }
+
+      private:
+        std::vector<T>                  m_block;    // The objects of the last compaction, in key order back then
+        std::vector<std::unique_ptr<T>> m_spilled;  // The objects created since
+        radix_sorter<uint32_t>          m_sorter;
+    };
+}
+
+#include "spatial_reorder.inl"
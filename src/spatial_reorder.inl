@@ -0,0 +1,124 @@
+/**
+* @file spatial_reorder.inl
+* @author Miguel Echeverria , 540000918 , miguel.echeverria@digipen.edu
+* @date 2020/11/07
+* @brief Contains the implementation of the object arena.
+*
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+
+namespace cs350 {
+
+    /**
+    * @brief Allocates a new (default constructed) object, on its own until the next compaction.
+    * @return T*          The object.
+    */
+    template<typename T>
+    T* object_arena<T>::create()
+    {
+      m_spilled.push_back(std::make_unique<T>());
+      return m_spilled.back().get();
+    }
+
+
+    /**
+    * @brief Releases every object.
+    */
+    template<typename T>
+    void object_arena<T>::destroy()
+    {
+      m_block.clear();
+      m_spilled.clear();
+    }
+
+
+    /**
+    * @brief Moves the objects into a single block in increasing key order (ties keep their order), and
+    *        releases the previous memory. The moved objects still hold the old addresses in their links,
+    *        patch is called (before the old objects are released) to fix them and every other link to them.
+    * @param objects      Every object of the arena (the rest are released), replaced by their new addresses.
+    * @param key_of       Callable returning the uint32_t key of an object (given a T const*).
+    * @param patch        Callable taking a remap callable, which returns the new address of an object
+    *                     given its old one (nullptr for nullptr).
+    */
+    template<typename T>
+    template<typename KeyOf, typename Patch>
+    void object_arena<T>::compact(std::vector<T*>& objects, KeyOf key_of, Patch patch)
+    {
+      // Key and position of each object, the sort is stable so ties keep their order
+      std::vector<std::pair<uint32_t, uint32_t>> order(objects.size());
+      for (size_t i = 0; i < objects.size(); ++i)
+        order[i] = {key_of(objects[i]), static_cast<uint32_t>(i)};
+      m_sorter.sort(order, 11);
+
+      std::vector<T> block;
+      block.reserve(objects.size());
+      std::vector<std::pair<T const*, T*>> moved(objects.size());   // Old and new address
+      for (size_t i = 0; i < order.size(); ++i)
+      {
+        T* object = objects[order[i].second];
+        block.push_back(std::move(*object));
+        moved[i] = {object, &block.back()};
+      }
+
+      // Looked up by old address
+      std::sort(moved.begin(), moved.end(), [](auto const& a, auto const& b) { return std::less<T const*>()(a.first, b.first); });
+      auto remap = [&moved](T* object) -> T*
+      {
+        if (object == nullptr)
+          return nullptr;
+        auto foundIt = std::lower_bound(moved.begin(), moved.end(), object, [](auto const& entry, T const* key)
+        {
+          return std::less<T const*>()(entry.first, key);
+        });
+        assert(foundIt != moved.end() && foundIt->first == object);
+        return foundIt->second;
+      };
+      patch(remap);
+
+      for (size_t i = 0; i < objects.size(); ++i)
+        objects[i] = &block[i];
+      m_block.swap(block);
+      m_spilled.clear();
+    }
+
+
+    /**
+    * @brief Measures how far the objects are from the layout of a fresh compaction: the fraction of them
+    *        that were created since, or whose key is smaller than the one of the object before them.
+    * @param objects      Every object of the arena, in the order they are iterated.
+    * @param key_of       Callable returning the uint32_t key of an object (given a T const*).
+    * @return float       The disorder, from 0 (just compacted) to 1.
+    */
+    template<typename T>
+    template<typename KeyOf>
+    float object_arena<T>::disorder(std::vector<T*> const& objects, KeyOf key_of) const
+    {
+      if (objects.empty())
+        return 0.0f;
+
+      size_t outOfOrder = 0;
+      uint32_t previousKey = 0;
+      for (T const* object : objects)
+      {
+        uint32_t key = key_of(object);
+        if (!in_block(object) || key < previousKey)
+          outOfOrder++;
+        previousKey = key;
+      }
+      return static_cast<float>(outOfOrder) / static_cast<float>(objects.size());
+    }
+
+
+    /**
+    * @brief Checks whether an object is in the block of the last compaction.
+    * @param object       The object.
+    * @return bool        False if it was created since.
+    */
+    template<typename T>
+    bool object_arena<T>::in_block(T const* object) const
+    {
+      std::less<T const*> less;
+      return !m_block.empty() && !less(object, m_block.data()) && less(object, m_block.data() + m_block.size());
+    }
+}
@@ -0,0 +1,522 @@
+/**
+* @file static_octree.cpp
+* @author Miguel Echeverria , 540000918 , miguel.echeverria@digipen.edu
+* @date 2020/11/07
+* @brief Contains the implementation of the static octree, its construction and the
+*        saving and memory mapped loading of its files.
+*
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+
+#include "pch.hpp"
+#include "static_octree.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace cs350 {
+
+    namespace {
+        /**
+        * @brief Rounds offset up to the alignment of the widest field in the file (8 bytes).
+        * @param offset       The offset to align.
+        * @return uint64_t    The aligned offset.
+        */
+        uint64_t align_offset(uint64_t offset)
+        {
+          return (offset + 7u) & ~uint64_t(7u);
+        }
+    }
+
+
+    /**
+    * @brief Default constructor, the octree is empty.
+    */
+    static_octree::static_octree() = default;
+
+
+    /**
+    * @brief Releases the memory (or the mapping) of the octree.
+    */
+    static_octree::~static_octree()
+    {
+      clear();
+    }
+
+
+    /**
+    * @brief Move constructor, other is left empty. The owned image keeps its address when moved.
+    * @param other        The octree to move from.
+    */
+    static_octree::static_octree(static_octree&& other) noexcept
+    {
+      *this = std::move(other);
+    }
+
+
+    /**
+    * @brief Move assignment, releases the current content and takes the one of other.
+    * @param other                The octree to move from.
+    * @return static_octree&      This octree.
+    */
+    static_octree& static_octree::operator=(static_octree&& other) noexcept
+    {
+      if (this == &other)
+        return *this;
+
+      clear();
+      m_storage        = std::move(other.m_storage);
+      m_mapping        = std::exchange(other.m_mapping, nullptr);
+      m_mapping_size   = std::exchange(other.m_mapping_size, 0);
+      m_file_handle    = std::exchange(other.m_file_handle, nullptr);
+      m_mapping_handle = std::exchange(other.m_mapping_handle, nullptr);
+      m_header         = std::exchange(other.m_header, nullptr);
+      m_nodes          = std::exchange(other.m_nodes, nullptr);
+      m_indices        = std::exchange(other.m_indices, nullptr);
+      m_bvs            = std::exchange(other.m_bvs, nullptr);
+      other.m_storage.clear();
+      return *this;
+    }
+
+
+    /**
+    * @brief Builds the octree for the given bvs, the index of each object is its position in bvs.
+    * @param bvs          The bounding volumes of the objects.
+    * @param root_size    The size of one side of the root bv.
+    * @param levels       The number of levels of the tree.
+    * @param interval     How the max corner of the bvs is mapped onto the leaf grid.
+    */
+    void static_octree::build(std::vector<aabb> const& bvs, uint32_t root_size, uint32_t levels, cell_interval interval)
+    {
+      std::vector<entry> entries(bvs.size());
+      for (size_t i = 0; i < bvs.size(); ++i)
+        entries[i] = {compute_locational_code(bvs[i], root_size, levels, interval), static_cast<uint32_t>(i), bvs[i]};
+
+      build(entries, root_size, levels, interval);
+    }
+
+
+    /**
+    * @brief Lays out the file image for the given objects: the nodes they are in plus all their ancestors,
+    *        sorted by code, the object indices grouped by node and their bvs.
+    * @param entries      The objects with their locational codes (sorted in place).
+    * @param root_size    The size of one side of the root bv.
+    * @param levels       The number of levels of the tree.
+    * @param interval     How the max corner of the bvs is mapped onto the leaf grid.
+    */
+    void static_octree::build(std::vector<entry>& entries, uint32_t root_size, uint32_t levels, cell_interval interval)
+    {
+      const int dimension = 3;
+
+      clear();
+      std::stable_sort(entries.begin(), entries.end(), [](entry const& lhs, entry const& rhs)
+      {
+        return lhs.locational_code < rhs.locational_code;
+      });
+
+      // Every code with objects, and its ancestors so that the tree can be walked from the root
+      std::vector<uint32_t> codes;
+      for (size_t i = 0; i < entries.size(); ++i)
+      {
+        if (i != 0 && entries[i].locational_code == entries[i - 1].locational_code)
+          continue;
+        for (uint32_t code = entries[i].locational_code; code != 0; code >>= dimension)
+          codes.push_back(code);
+      }
+      std::sort(codes.begin(), codes.end());
+      codes.erase(std::unique(codes.begin(), codes.end()), codes.end());
+
+      // Lay out the sections
+      static_octree_header header;
+      header.root_size      = root_size;
+      header.levels         = levels;
+      header.interval       = static_cast<uint32_t>(interval);
+      header.node_count     = static_cast<uint32_t>(codes.size());
+      header.object_count   = static_cast<uint32_t>(entries.size());
+      header.nodes_offset   = align_offset(sizeof(static_octree_header));
+      header.indices_offset = align_offset(header.nodes_offset + codes.size() * sizeof(static_octree_node));
+      header.bvs_offset     = align_offset(header.indices_offset + entries.size() * sizeof(uint32_t));
+      header.file_size      = align_offset(header.bvs_offset + entries.size() * sizeof(static_octree_bv));
+
+      m_storage.assign(header.file_size / sizeof(uint64_t), 0u);
+      auto* bytes   = reinterpret_cast<char*>(m_storage.data());
+      auto* nodes   = reinterpret_cast<static_octree_node*>(bytes + header.nodes_offset);
+      auto* indices = reinterpret_cast<uint32_t*>(bytes + header.indices_offset);
+      auto* bvs     = reinterpret_cast<static_octree_bv*>(bytes + header.bvs_offset);
+      std::memcpy(bytes, &header, sizeof(header));
+
+      // Nodes and entries are both sorted by code, so the object ranges come from a single pass
+      size_t entryIndex = 0;
+      for (size_t i = 0; i < codes.size(); ++i)
+      {
+        static_octree_node& current = nodes[i];
+        current.locational_code = codes[i];
+        current.children_active = 0;
+        current.first_object    = static_cast<uint32_t>(entryIndex);
+        while (entryIndex < entries.size() && entries[entryIndex].locational_code == codes[i])
+          entryIndex++;
+        current.object_count = static_cast<uint32_t>(entryIndex) - current.first_object;
+
+        if (codes[i] != 1u)
+        {
+          auto parentIt = std::lower_bound(codes.begin(), codes.begin() + i, codes[i] >> dimension);
+          nodes[parentIt - codes.begin()].children_active |= 1u << (codes[i] & ((1u << dimension) - 1u));
+        }
+      }
+
+      for (size_t i = 0; i < entries.size(); ++i)
+      {
+        indices[i] = entries[i].index;
+        for (int axis = 0; axis < dimension; ++axis)
+        {
+          bvs[i].min[axis] = entries[i].bv.mMinPos[axis];
+          bvs[i].max[axis] = entries[i].bv.mMaxPos[axis];
+        }
+      }
+
+      bind(bytes, header.file_size);
+    }
+
+
+    /**
+    * @brief Writes the image of the octree to a file, which load can map later on.
+    * @param path         The path of the file to write.
+    * @return bool        Whether the file could be written.
+    */
+    bool static_octree::save(std::string const& path) const
+    {
+      if (m_header == nullptr)
+        return false;
+
+      std::ofstream file(path, std::ios::binary | std::ios::trunc);
+      if (!file)
+        return false;
+
+      file.write(reinterpret_cast<char const*>(m_header), static_cast<std::streamsize>(m_header->file_size));
+      return static_cast<bool>(file);
+    }
+
+
+    /**
+    * @brief Maps a file written by save and points the octree into it, nothing is copied nor deserialized.
+    * @param path         The path of the file to map.
+    * @return bool        Whether the file could be mapped and is a valid static octree. If not, the octree is empty.
+    */
+    bool static_octree::load(std::string const& path)
+    {
+      clear();
+
+#ifdef _WIN32
+      HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+      if (file == INVALID_HANDLE_VALUE)
+        return false;
+      m_file_handle = file;
+
+      LARGE_INTEGER size;
+      if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+      {
+        clear();
+        return false;
+      }
+
+      m_mapping_handle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      if (m_mapping_handle == nullptr)
+      {
+        clear();
+        return false;
+      }
+
+      m_mapping = MapViewOfFile(m_mapping_handle, FILE_MAP_READ, 0, 0, 0);
+      m_mapping_size = static_cast<size_t>(size.QuadPart);
+#else
+      int file = open(path.c_str(), O_RDONLY);
+      if (file < 0)
+        return false;
+
+      struct stat info;
+      if (fstat(file, &info) != 0 || info.st_size == 0)
+      {
+        close(file);
+        return false;
+      }
+
+      // The mapping stays valid once the descriptor is closed
+      void* mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+      close(file);
+      if (mapping == MAP_FAILED)
+        return false;
+      m_mapping = mapping;
+      m_mapping_size = static_cast<size_t>(info.st_size);
+#endif
+
+      if (m_mapping == nullptr || !bind(m_mapping, m_mapping_size))
+      {
+        std::cout<<"DEBUG : STATIC_OCTREE : INVALID FILE " << path << "\n";
+        clear();
+        return false;
+      }
+
+      return true;
+    }
+
+
+    /**
+    * @brief Releases the memory (or the mapping) of the octree, leaving it empty.
+    */
+    void static_octree::clear()
+    {
+#ifdef _WIN32
+      if (m_mapping != nullptr)
+        UnmapViewOfFile(m_mapping);
+      if (m_mapping_handle != nullptr)
+        CloseHandle(m_mapping_handle);
+      if (m_file_handle != nullptr)
+        CloseHandle(m_file_handle);
+#else
+      if (m_mapping != nullptr)
+        munmap(m_mapping, m_mapping_size);
+#endif
+      m_mapping        = nullptr;
+      m_mapping_size   = 0;
+      m_file_handle    = nullptr;
+      m_mapping_handle = nullptr;
+      m_storage.clear();
+
+      m_header  = nullptr;
+      m_nodes   = nullptr;
+      m_indices = nullptr;
+      m_bvs     = nullptr;
+    }
+
+
+    /**
+    * @brief Finds the node with the given code, with a binary search over the sorted codes.
+    * @param locational_code              The code of the node to find.
+    * @return static_octree_node const*   The node, or nullptr if it doesn't exist.
+    */
+    static_octree_node const* static_octree::find_node(uint32_t locational_code) const
+    {
+      if (m_nodes == nullptr)
+        return nullptr;
+
+      static_octree_node const* last = m_nodes + m_header->node_count;
+      static_octree_node const* found = std::lower_bound(m_nodes, last, locational_code, [](static_octree_node const& current, uint32_t code)
+      {
+        return current.locational_code < code;
+      });
+
+      if (found == last || found->locational_code != locational_code)
+        return nullptr;
+      return found;
+    }
+
+
+    /**
+    * @brief Validates an image of the file and points the sections into it.
+    * @param data         The start of the image, aligned to 8 bytes.
+    * @param size         The size in bytes of the image.
+    * @return bool        Whether the image is a valid static octree of this version.
+    */
+    bool static_octree::bind(void const* data, size_t size)
+    {
+      if (size < sizeof(static_octree_header) || reinterpret_cast<uintptr_t>(data) % alignof(static_octree_header) != 0)
+        return false;
+
+      auto const* header = static_cast<static_octree_header const*>(data);
+      if (header->magic != static_octree_header::magic_value || header->version != static_octree_header::current_version)
+        return false;
+
+      // Every section must be aligned and inside of the image
+      auto fits = [size](uint64_t offset, uint64_t count, uint64_t element)
+      {
+        return offset % 8u == 0 && offset <= size && count <= (size - offset) / element;
+      };
+      if (header->file_size > size ||
+          !fits(header->nodes_offset, header->node_count, sizeof(static_octree_node)) ||
+          !fits(header->indices_offset, header->object_count, sizeof(uint32_t)) ||
+          !fits(header->bvs_offset, header->object_count, sizeof(static_octree_bv)))
+        return false;
+
+      // The codes must fit in 32 bits with their sentinel
+      const int dimension = 3;
+      const uint32_t maxChilds = 1u << dimension;
+      if (header->levels > 31u / dimension || header->interval > static_cast<uint32_t>(cell_interval::half_open))
+        return false;
+
+      // The root must come first for the queries to start from it
+      auto const* bytes = static_cast<char const*>(data);
+      auto const* nodes = reinterpret_cast<static_octree_node const*>(bytes + header->nodes_offset);
+      if (header->node_count != 0 && nodes[0].locational_code != 1u)
+        return false;
+
+      // The codes must be sorted for find_node, the objects of each node inside the sections, and
+      // the children active must exist (the queries follow them without checking)
+      static_octree_node const* last = nodes + header->node_count;
+      for (uint32_t i = 0; i < header->node_count; ++i)
+      {
+        static_octree_node const& current = nodes[i];
+        if ((i != 0 && current.locational_code <= nodes[i - 1].locational_code) ||
+            locational_code_depth(current.locational_code) > header->levels ||
+            static_cast<uint64_t>(current.first_object) + current.object_count > header->object_count ||
+            current.children_active >= (1u << maxChilds))
+          return false;
+
+        if (current.children_active != 0 && locational_code_depth(current.locational_code) == header->levels)
+          return false;
+
+        for (uint32_t child = 0; child < maxChilds; ++child)
+        {
+          if ((current.children_active & (1u << child)) == 0)
+            continue;
+
+          uint32_t childCode = (current.locational_code << dimension) + child;
+          static_octree_node const* found = std::lower_bound(nodes + i + 1, last, childCode, [](static_octree_node const& node, uint32_t code)
+          {
+            return node.locational_code < code;
+          });
+          if (found == last || found->locational_code != childCode)
+            return false;
+        }
+      }
+
+      m_header  = header;
+      m_nodes   = nodes;
+      m_indices = reinterpret_cast<uint32_t const*>(bytes + header->indices_offset);
+      m_bvs     = reinterpret_cast<static_octree_bv const*>(bytes + header->bvs_offset);
+      return true;
+    }
+
+
+    /**
+    * @brief Publishes the given objects as the new snapshot (see the octree overload).
+    * @param bvs          The bounding volumes of the objects, the index of each object is its position in bvs.
+    * @param root_size    The size of one side of the root bv.
+    * @param levels       The number of levels of the tree.
+    * @param interval     How the max corner of the bvs is mapped onto the leaf grid.
+    */
+    void octree_snapshots::publish(std::vector<aabb> const& bvs, uint32_t root_size, uint32_t levels, cell_interval interval)
+    {
+      uint32_t back = begin_publish();
+      m_buffers[back].build(bvs, root_size, levels, interval);
+      end_publish(back);
+    }
+
+
+    /**
+    * @brief Returns the latest published snapshot, which stays valid until the reader is released.
+    *        Never blocks: it retries if the front changes while registering itself.
+    * @return reader      The snapshot, empty if nothing was published yet.
+    */
+    octree_snapshots::reader octree_snapshots::acquire() const
+    {
+      while (true)
+      {
+        uint64_t frame = m_frame.load();
+        if (frame == 0)
+          return reader();
+
+        // Only valid if it is still the latest once registered, the writer may be rebuilding it otherwise
+        uint32_t buffer = static_cast<uint32_t>(frame % 2u);
+        m_readers[buffer].fetch_add(1u);
+        if (m_frame.load() == frame)
+          return reader(&m_buffers[buffer], &m_readers[buffer], frame);
+        m_readers[buffer].fetch_sub(1u);
+      }
+    }
+
+
+    /**
+    * @brief Waits until no reader holds the back buffer, the one that is going to be rebuilt.
+    * @return uint32_t    The index of the back buffer.
+    */
+    uint32_t octree_snapshots::begin_publish()
+    {
+      uint32_t back = static_cast<uint32_t>((m_frame.load() + 1u) % 2u);
+      while (m_readers[back].load() != 0)
+        std::this_thread::yield();
+      return back;
+    }
+
+
+    /**
+    * @brief Makes the back buffer the latest snapshot.
+    * @param back         The index of the buffer that was rebuilt.
+    */
+    void octree_snapshots::end_publish(uint32_t back)
+    {
+      assert(back == (m_frame.load() + 1u) % 2u);
+      m_frame.store(m_frame.load() + 1u);
+    }
+
+
+    /**
+    * @brief Registered reader of a snapshot.
+    * @param octree       The snapshot.
+    * @param readers      The reader count of its buffer (already incremented).
+    * @param frame        The frame it was published on.
+    */
+    octree_snapshots::reader::reader(static_octree const* octree, std::atomic<uint32_t>* readers, uint64_t frame)
+        :   m_octree(octree)
+        ,   m_readers(readers)
+        ,   m_frame(frame)
+    {
+    }
+
+
+    /**
+    * @brief Releases the snapshot.
+    */
+    octree_snapshots::reader::~reader()
+    {
+      release();
+    }
+
+
+    /**
+    * @brief Move constructor, other is left empty.
+    * @param other        The reader to move from.
+    */
+    octree_snapshots::reader::reader(reader&& other) noexcept
+    {
+      *this = std::move(other);
+    }
+
+
+    /**
+    * @brief Move assignment, releases the current snapshot and takes the one of other.
+    * @param other        The reader to move from.
+    * @return reader&     This reader.
+    */
+    octree_snapshots::reader& octree_snapshots::reader::operator=(reader&& other) noexcept
+    {
+      if (this == &other)
+        return *this;
+
+      release();
+      m_octree  = std::exchange(other.m_octree, nullptr);
+      m_readers = std::exchange(other.m_readers, nullptr);
+      m_frame   = std::exchange(other.m_frame, 0);
+      return *this;
+    }
+
+
+    /**
+    * @brief Lets the writer rebuild the snapshot, the reader is left empty.
+    */
+    void octree_snapshots::reader::release()
+    {
+      if (m_readers != nullptr)
+        m_readers->fetch_sub(1u);
+      m_octree  = nullptr;
+      m_readers = nullptr;
+      m_frame   = 0;
+    }
+}
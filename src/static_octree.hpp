@@ -0,0 +1,185 @@
+/**
+* @file static_octree.hpp
+* @author Miguel Echeverria , 540000918 , miguel.echeverria@digipen.edu
+* @date 2020/11/07
+* @brief Contains the declaration of the static (linear, immutable) octree, and its binary
+*        file format, which can be memory mapped and queried without deserializing.
+*
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+
+#pragma once
+#include "octree.hpp"
+
+namespace cs350 {
+
+    /**
+     * @brief
+     *  Fixed size header at the start of a static octree file. Sections are located through byte offsets
+     *  from the start of the file, so the file can be mapped at any address. Values are little endian.
+     */
+    struct static_octree_header
+    {
+        static constexpr uint32_t magic_value   = 0x54434F53u;  // "SOCT"
+        static constexpr uint32_t current_version = 1u;
+
+        uint32_t magic{magic_value};
+        uint32_t version{current_version};
+        uint32_t root_size{0};
+        uint32_t levels{0};
+        uint32_t interval{0};           // cell_interval
+        uint32_t node_count{0};
+        uint32_t object_count{0};
+        uint32_t reserved{0};
+        uint64_t nodes_offset{0};       // static_octree_node[node_count], sorted by locational code
+        uint64_t indices_offset{0};     // uint32_t[object_count], the index of each object, grouped by node
+        uint64_t bvs_offset{0};         // static_octree_bv[object_count], in the same order as the indices
+        uint64_t file_size{0};
+    };
+
+    /**
+     * @brief
+     *  Node of a static octree, its objects are [first_object, first_object + object_count) in the indices
+     */
+    struct static_octree_node
+    {
+        uint32_t locational_code;
+        uint32_t children_active;
+        uint32_t first_object;
+        uint32_t object_count;
+    };
+
+    /**
+     * @brief
+     *  Bounding volume of an object as stored in the file
+     */
+    struct static_octree_bv
+    {
+        float min[3];
+        float max[3];
+    };
+
+    /**
+     * @brief
+     * 	Linear octree that can't be modified once built. Nodes are sorted by locational code and the objects
+     *  are stored as indices (into whatever container the user has) along with a copy of their bvs.
+     *  Its memory is a single block with the layout of the file, either owned or memory mapped.
+     */
+    class static_octree
+    {
+      public:
+        static_octree();
+        ~static_octree();
+        static_octree(static_octree&& other) noexcept;
+        static_octree& operator=(static_octree&& other) noexcept;
+        static_octree(static_octree const&) = delete;
+        static_octree& operator=(static_octree const&) = delete;
+
+        void build(std::vector<aabb> const& bvs, uint32_t root_size, uint32_t levels, cell_interval interval = cell_interval::closed);
+        template <typename T, typename IndexOf>
+        void build(octree<T> const& tree, IndexOf index_of);
+        template <typename T, typename ObjectAt>
+        void restore(octree<T>& tree, ObjectAt object_at) const;
+
+        bool save(std::string const& path) const;
+        bool load(std::string const& path);
+        void clear();
+
+        static_octree_node const* find_node(uint32_t locational_code) const;
+        template <typename F>
+        void query(aabb const& bv, F&& function) const;
+        template <typename F>
+        float raycast(ray const& r, F&& intersect, uint32_t* hit_index = nullptr) const;
+
+        [[nodiscard]] bool                      empty() const { return m_header == nullptr; }
+        [[nodiscard]] bool                      mapped() const { return m_mapping != nullptr; }
+        [[nodiscard]] uint32_t                  root_size() const { return m_header ? m_header->root_size : 0u; }
+        [[nodiscard]] uint32_t                  levels() const { return m_header ? m_header->levels : 0u; }
+        [[nodiscard]] cell_interval             interval() const { return m_header ? static_cast<cell_interval>(m_header->interval) : cell_interval::closed; }
+        [[nodiscard]] uint32_t                  node_count() const { return m_header ? m_header->node_count : 0u; }
+        [[nodiscard]] uint32_t                  object_count() const { return m_header ? m_header->object_count : 0u; }
+        [[nodiscard]] static_octree_node const* nodes() const { return m_nodes; }
+        [[nodiscard]] uint32_t const*           object_indices() const { return m_indices; }
+        [[nodiscard]] static_octree_bv const*   object_bvs() const { return m_bvs; }
+
+      private:
+        // Object index and locational code, sorted to group the objects by node
+        struct entry
+        {
+            uint32_t locational_code;
+            uint32_t index;
+            aabb     bv;
+        };
+
+        void build(std::vector<entry>& entries, uint32_t root_size, uint32_t levels, cell_interval interval);
+        bool bind(void const* data, size_t size);
+
+        std::vector<uint64_t>       m_storage;          // Owned image of the file (when not mapped)
+        void*                       m_mapping{nullptr}; // Mapped image of the file
+        size_t                      m_mapping_size{0};
+        void*                       m_file_handle{nullptr};     // Only used on Windows
+        void*                       m_mapping_handle{nullptr};
+
+        static_octree_header const* m_header{nullptr};
+        static_octree_node const*   m_nodes{nullptr};
+        uint32_t const*             m_indices{nullptr};
+        static_octree_bv const*     m_bvs{nullptr};
+    };
+
+    /**
+     * @brief
+     *  Double buffered static octrees, so that readers can query the frame N snapshot without locks while the
+     *  writer builds frame N + 1. Publishing is an atomic store of the frame number, and the two images are
+     *  reused across frames, so the memory is bounded by two snapshots.
+     */
+    class octree_snapshots
+    {
+      public:
+        /**
+         * @brief
+         *  Keeps a snapshot alive (the writer won't overwrite it) while it exists
+         */
+        class reader
+        {
+          public:
+            reader() = default;
+            ~reader();
+            reader(reader&& other) noexcept;
+            reader& operator=(reader&& other) noexcept;
+            reader(reader const&) = delete;
+            reader& operator=(reader const&) = delete;
+
+            void release();
+
+            [[nodiscard]] explicit operator bool() const { return m_octree != nullptr; }
+            [[nodiscard]] static_octree const& operator*() const { return *m_octree; }
+            [[nodiscard]] static_octree const* operator->() const { return m_octree; }
+            [[nodiscard]] uint64_t frame() const { return m_frame; }
+
+          private:
+            friend class octree_snapshots;
+            reader(static_octree const* octree, std::atomic<uint32_t>* readers, uint64_t frame);
+
+            static_octree const*   m_octree{nullptr};
+            std::atomic<uint32_t>* m_readers{nullptr};
+            uint64_t               m_frame{0};
+        };
+
+        template <typename T, typename IndexOf>
+        void   publish(octree<T> const& tree, IndexOf index_of);
+        void   publish(std::vector<aabb> const& bvs, uint32_t root_size, uint32_t levels, cell_interval interval = cell_interval::closed);
+        reader acquire() const;
+
+        [[nodiscard]] uint64_t frame() const { return m_frame.load(std::memory_order_acquire); }
+
+      private:
+        uint32_t begin_publish();
+        void     end_publish(uint32_t back);
+
+        static_octree                      m_buffers[2];   // Frame f is in m_buffers[f % 2]
+        mutable std::atomic<uint32_t>      m_readers[2]{};
+        std::atomic<uint64_t>              m_frame{0};     // 0 until the first publish
+    };
+}
+
+#include "static_octree.inl"
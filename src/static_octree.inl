@@ -0,0 +1,220 @@
+/**
+* @file static_octree.inl
+* @author Miguel Echeverria , 540000918 , miguel.echeverria@digipen.edu
+* @date 2020/11/07
+* @brief Contains the template functions of the static octree.
+*
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+
+namespace cs350 {
+
+    /**
+    * @brief Builds the static octree from the current state of a dynamic one, with the same
+    *        root size, levels and interval, keeping every object in the node it is in.
+    * @param tree          The octree to copy.
+    * @param index_of      Callable returning the uint32_t index of an object (given a T const*).
+    */
+    template<typename T, typename IndexOf>
+    void static_octree::build(octree<T> const& tree, IndexOf index_of)
+    {
+      std::vector<entry> entries;
+      for (auto const& [code, current] : tree.get_map())
+      {
+        for (T const* object = current->first; object != nullptr; object = object->octree_next_object)
+        {
+          // Multi-cell objects are stored once, in the node that contains their whole bv
+          uint32_t objectCode = tree.multi_cell_objects() != 0 ? common_locational_code(code, tree.locational_code(object->bv_world)) : code;
+          entries.push_back({objectCode, static_cast<uint32_t>(index_of(object)), object->bv_world});
+        }
+      }
+
+      build(entries, tree.root_size(), tree.levels(), tree.interval());
+    }
+
+
+    /**
+    * @brief Replaces the content of a dynamic octree with this one. The objects are placed directly in their
+    *        stored nodes, without computing their locational codes again.
+    * @param tree          The octree to fill.
+    * @param object_at     Callable returning the T* of an object index (the inverse of the index_of used to build).
+    */
+    template<typename T, typename ObjectAt>
+    void static_octree::restore(octree<T>& tree, ObjectAt object_at) const
+    {
+      // The objects that were in the tree don't belong to any node anymore
+      for (auto const& [code, current] : tree.get_map())
+      {
+        for (T* object = current->first; object != nullptr; object = object->octree_next_object)
+          object->octree_node = nullptr;
+      }
+      tree.destroy();
+      tree.set_interval(interval());
+      tree.set_root_size(root_size());
+      tree.set_levels(levels());
+
+      for (uint32_t i = 0; i < node_count(); ++i)
+      {
+        static_octree_node const& current = m_nodes[i];
+        if (current.object_count == 0)
+          continue;
+
+        typename octree<T>::node* target = tree.create_node(current.locational_code);
+
+        // Push them backwards so the lists keep the stored order
+        for (uint32_t j = current.object_count; j-- > 0;)
+        {
+          T* object = object_at(m_indices[current.first_object + j]);
+          target->push_front(object);
+          object->octree_node = target;
+        }
+      }
+    }
+
+
+    /**
+    * @brief Calls function with the index of every object whose bv intersects bv.
+    * @param bv            The volume to query.
+    * @param function      Callable taking the uint32_t index of an object.
+    */
+    template<typename F>
+    void static_octree::query(aabb const& bv, F&& function) const
+    {
+      const int dimension = 3;
+      const uint32_t maxChilds = 1u << dimension;
+
+      if (node_count() == 0)
+        return;
+
+      // The root (code 1) is the smallest code, and holds the objects outside of it as well
+      std::vector<static_octree_node const*> toVisit;
+      toVisit.push_back(&m_nodes[0]);
+
+      while (!toVisit.empty())
+      {
+        static_octree_node const* current = toVisit.back();
+        toVisit.pop_back();
+
+        for (uint32_t i = current->first_object; i < current->first_object + current->object_count; ++i)
+        {
+          static_octree_bv const& objectBV = m_bvs[i];
+          aabb stored({objectBV.min[0], objectBV.min[1], objectBV.min[2]}, {objectBV.max[0], objectBV.max[1], objectBV.max[2]});
+          if (intersection_aabb_aabb(bv, stored))
+            function(m_indices[i]);
+        }
+
+        for (uint32_t i = 0; i < maxChilds; ++i)
+        {
+          if ((current->children_active & (1u << i)) == 0)
+            continue;
+
+          // Objects may overhang their cell by less than a unit (half open cells), so test a grown cell
+          uint32_t childCode = (current->locational_code << dimension) + i;
+          aabb cell = compute_bv(childCode, root_size());
+          cell.mMinPos -= glm::vec3(1.0f);
+          cell.mMaxPos += glm::vec3(1.0f);
+          if (!intersection_aabb_aabb(bv, cell))
+            continue;
+
+          // bind checks that the children exist
+          static_octree_node const* child = find_node(childCode);
+          assert(child != nullptr);
+          if (child != nullptr)
+            toVisit.push_back(child);
+        }
+      }
+    }
+
+
+    /**
+    * @brief Finds the closest object hit by a ray. Nodes are visited front to back by the t at which the ray
+    *        enters their (grown) cell, and the ones entered after the closest hit so far are skipped. Objects
+    *        whose stored bv the ray hits before the closest hit are given to intersect for the exact test.
+    * @param r             The ray.
+    * @param intersect     Callable taking the uint32_t index of an object, returning the float t at which the
+    *                      ray hits it (negative if it doesn't).
+    * @param hit_index     Output (if not nullptr), the index of the object hit.
+    * @return float        The t of the closest hit, -1 if nothing is hit.
+    */
+    template<typename F>
+    float static_octree::raycast(ray const& r, F&& intersect, uint32_t* hit_index) const
+    {
+      const int dimension = 3;
+      const uint32_t maxChilds = 1u << dimension;
+
+      float closest = -1.0f;
+      if (node_count() == 0)
+        return closest;
+
+      // Node and the t at which the ray enters it, the closest ones on top
+      std::vector<std::pair<static_octree_node const*, float>> toVisit{{&m_nodes[0], 0.0f}};
+      std::pair<static_octree_node const*, float> children[maxChilds];
+      while (!toVisit.empty())
+      {
+        auto [current, entry] = toVisit.back();
+        toVisit.pop_back();
+        if (closest >= 0.0f && entry > closest)
+          continue;
+
+        for (uint32_t i = current->first_object; i < current->first_object + current->object_count; ++i)
+        {
+          static_octree_bv const& objectBV = m_bvs[i];
+          aabb stored({objectBV.min[0], objectBV.min[1], objectBV.min[2]}, {objectBV.max[0], objectBV.max[1], objectBV.max[2]});
+          float boxT = intersection_ray_aabb(r, stored);
+          if (boxT < 0.0f || (closest >= 0.0f && boxT > closest))
+            continue;
+
+          float t = intersect(m_indices[i]);
+          if (t >= 0.0f && (closest < 0.0f || t < closest))
+          {
+            closest = t;
+            if (hit_index != nullptr)
+              *hit_index = m_indices[i];
+          }
+        }
+
+        uint32_t childCount = 0;
+        for (uint32_t i = 0; i < maxChilds; ++i)
+        {
+          if ((current->children_active & (1u << i)) == 0)
+            continue;
+
+          // Objects may overhang their cell by less than a unit (half open cells), so test a grown cell
+          uint32_t childCode = (current->locational_code << dimension) + i;
+          aabb cell = compute_bv(childCode, root_size());
+          cell.mMinPos -= glm::vec3(1.0f);
+          cell.mMaxPos += glm::vec3(1.0f);
+          float t = intersection_ray_aabb(r, cell);
+          if (t < 0.0f || (closest >= 0.0f && t > closest))
+            continue;
+
+          // bind checks that the children exist
+          static_octree_node const* child = find_node(childCode);
+          assert(child != nullptr);
+          if (child != nullptr)
+            children[childCount++] = {child, t};
+        }
+
+        // Farthest pushed first, so the closest child is visited next
+        std::sort(children, children + childCount, [](auto const& lhs, auto const& rhs) { return lhs.second > rhs.second; });
+        toVisit.insert(toVisit.end(), children, children + childCount);
+      }
+
+      return closest;
+    }
+
+
+    /**
+    * @brief Publishes the current state of a dynamic octree as the new snapshot. Only one thread may publish,
+    *        and it waits for the readers of the snapshot before the current one to release it.
+    * @param tree          The octree to copy.
+    * @param index_of      Callable returning the uint32_t index of an object (given a T const*).
+    */
+    template<typename T, typename IndexOf>
+    void octree_snapshots::publish(octree<T> const& tree, IndexOf index_of)
+    {
+      uint32_t back = begin_publish();
+      m_buffers[back].build(tree, index_of);
+      end_publish(back);
+    }
+}
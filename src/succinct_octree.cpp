@@ -0,0 +1,457 @@
+/**
+* @file succinct_octree.cpp
+* @author Miguel Echeverria , 540000918 , miguel.echeverria@digipen.edu
+* @date 2020/11/07
+* @brief Contains the implementation of the rank/select bit vector and of the navigation,
+*        saving and loading of the succinct octree.
+*
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+
+#include "pch.hpp"
+#include "succinct_octree.hpp"
+
+namespace cs350 {
+
+    namespace {
+        /**
+         * @brief
+         *  Fixed size header at the start of a succinct octree file, followed by the words of the children
+         *  bits, the words of the has-objects bits, the object offsets and the object indices.
+         */
+        struct succinct_octree_header
+        {
+            static constexpr uint32_t magic_value     = 0x43435553u;  // "SUCC"
+            static constexpr uint32_t current_version = 1u;
+
+            uint32_t magic{magic_value};
+            uint32_t version{current_version};
+            uint32_t root_size{0};
+            uint32_t levels{0};
+            uint32_t interval{0};
+            uint32_t node_count{0};
+            uint32_t offset_count{0};
+            uint32_t index_count{0};
+        };
+
+        /**
+        * @brief Writes the content of a vector to a binary stream.
+        * @param os           The stream.
+        * @param values       The values to write.
+        */
+        template <typename V>
+        void write_vector(std::ostream& os, std::vector<V> const& values)
+        {
+          os.write(reinterpret_cast<char const*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(V)));
+        }
+
+        /**
+        * @brief Reads a number of values from a binary stream.
+        * @param is           The stream.
+        * @param count        The number of values to read.
+        * @return std::vector The values read (check the stream for errors).
+        */
+        template <typename V>
+        std::vector<V> read_vector(std::istream& is, size_t count)
+        {
+          std::vector<V> values(count);
+          is.read(reinterpret_cast<char*>(values.data()), static_cast<std::streamsize>(count * sizeof(V)));
+          return values;
+        }
+    }
+
+
+    /**
+    * @brief Appends a bit (build_index must be called before querying).
+    * @param bit          The value of the bit.
+    */
+    void rank_select_bits::push_back(bool bit)
+    {
+      if (m_size % 64 == 0)
+        m_words.push_back(0u);
+      if (bit)
+        m_words.back() |= uint64_t(1u) << (m_size % 64);
+      m_size++;
+    }
+
+
+    /**
+    * @brief Replaces the bits (and builds their index).
+    * @param words        The bits, 64 per word, the lowest first.
+    * @param size         The number of bits.
+    */
+    void rank_select_bits::assign(std::vector<uint64_t> words, size_t size)
+    {
+      m_words = std::move(words);
+      m_size = size;
+      build_index();
+    }
+
+
+    /**
+    * @brief Computes the rank and select directories of the current bits.
+    */
+    void rank_select_bits::build_index()
+    {
+      const size_t wordsPerBlock = block_bits / 64;
+      size_t blockCount = (m_words.size() + wordsPerBlock - 1) / wordsPerBlock;
+
+      m_block_ranks.assign(blockCount + 1, 0u);
+      m_select_samples.clear();
+      m_ones = 0;
+      for (size_t block = 0; block < blockCount; ++block)
+      {
+        m_block_ranks[block] = static_cast<uint32_t>(m_ones);
+        for (size_t word = block * wordsPerBlock; word < glm::min(m_words.size(), (block + 1) * wordsPerBlock); ++word)
+          m_ones += static_cast<size_t>(std::popcount(m_words[word]));
+
+        // The block of every block_bits-th one
+        while (m_select_samples.size() * block_bits < m_ones)
+          m_select_samples.push_back(static_cast<uint32_t>(block));
+      }
+      m_block_ranks[blockCount] = static_cast<uint32_t>(m_ones);
+    }
+
+
+    /**
+    * @brief Releases the bits and their index.
+    */
+    void rank_select_bits::clear()
+    {
+      m_words.clear();
+      m_block_ranks.clear();
+      m_select_samples.clear();
+      m_size = 0;
+      m_ones = 0;
+    }
+
+
+    /**
+    * @brief Counts the ones before a position.
+    * @param position     The position, up to size().
+    * @return size_t      The ones in [0, position).
+    */
+    size_t rank_select_bits::rank1(size_t position) const
+    {
+      assert(position <= m_size);
+
+      const size_t wordsPerBlock = block_bits / 64;
+      size_t rank = m_block_ranks[position / block_bits];
+      size_t lastWord = position / 64;
+      for (size_t word = position / block_bits * wordsPerBlock; word < lastWord; ++word)
+        rank += static_cast<size_t>(std::popcount(m_words[word]));
+      if (position % 64 != 0)
+        rank += static_cast<size_t>(std::popcount(m_words[lastWord] & ((uint64_t(1u) << (position % 64)) - 1u)));
+      return rank;
+    }
+
+
+    /**
+    * @brief Finds the position of a one.
+    * @param k            The number of ones before it, less than ones().
+    * @return size_t      Its position.
+    */
+    size_t rank_select_bits::select1(size_t k) const
+    {
+      assert(k < m_ones);
+
+      const size_t wordsPerBlock = block_bits / 64;
+      size_t block = m_select_samples[k / block_bits];
+      while (m_block_ranks[block + 1] <= k)
+        block++;
+
+      size_t remaining = k - m_block_ranks[block];
+      size_t word = block * wordsPerBlock;
+      while (static_cast<size_t>(std::popcount(m_words[word])) <= remaining)
+      {
+        remaining -= static_cast<size_t>(std::popcount(m_words[word]));
+        word++;
+      }
+
+      // Drop the lower ones of the word until the one we look for is the lowest
+      uint64_t bits = m_words[word];
+      for (size_t i = 0; i < remaining; ++i)
+        bits &= bits - 1u;
+      return word * 64 + static_cast<size_t>(std::countr_zero(bits));
+    }
+
+
+    /**
+    * @brief Computes the memory used by the bits and their index.
+    * @return size_t      The size in bytes.
+    */
+    size_t rank_select_bits::memory_bytes() const
+    {
+      return m_words.size() * sizeof(uint64_t) + (m_block_ranks.size() + m_select_samples.size()) * sizeof(uint32_t);
+    }
+
+
+    /**
+    * @brief Releases the encoding, the octree is left empty.
+    */
+    void succinct_octree::clear()
+    {
+      m_children.clear();
+      m_has_objects.clear();
+      m_object_offsets.clear();
+      m_indices.clear();
+      m_level_starts.clear();
+      m_node_count = 0;
+    }
+
+
+    /**
+    * @brief Builds the rank/select directories and finds where each level starts.
+    */
+    void succinct_octree::build_index()
+    {
+      m_children.build_index();
+      m_has_objects.build_index();
+
+      // The nodes of a level are the children of the previous one
+      m_level_starts.assign(1, 0u);
+      uint32_t levelBegin = 0;
+      uint32_t levelEnd = m_node_count != 0 ? 1u : 0u;
+      while (levelBegin < levelEnd && levelEnd <= m_node_count)
+      {
+        m_level_starts.push_back(levelEnd);
+        levelBegin = levelEnd;
+        levelEnd = static_cast<uint32_t>(m_children.rank1(8u * static_cast<size_t>(levelEnd))) + 1u;
+      }
+    }
+
+
+    /**
+    * @brief Saves the encoding to a binary file.
+    * @param path         The path of the file.
+    * @return bool        False if it is empty or the file couldn't be written.
+    */
+    bool succinct_octree::save(std::string const& path) const
+    {
+      if (empty())
+        return false;
+
+      std::ofstream file(path, std::ios::binary | std::ios::trunc);
+      if (!file)
+        return false;
+
+      succinct_octree_header header;
+      header.root_size = m_root_size;
+      header.levels = m_levels;
+      header.interval = static_cast<uint32_t>(m_interval);
+      header.node_count = m_node_count;
+      header.offset_count = static_cast<uint32_t>(m_object_offsets.size());
+      header.index_count = static_cast<uint32_t>(m_indices.size());
+      file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+      write_vector(file, m_children.words());
+      write_vector(file, m_has_objects.words());
+      write_vector(file, m_object_offsets);
+      write_vector(file, m_indices);
+      return static_cast<bool>(file);
+    }
+
+
+    /**
+    * @brief Loads an encoding saved with save, and checks that it is consistent.
+    * @param path         The path of the file.
+    * @return bool        False if the file couldn't be read or is not a valid encoding (the octree is left empty).
+    */
+    bool succinct_octree::load(std::string const& path)
+    {
+      clear();
+
+      std::ifstream file(path, std::ios::binary);
+      if (!file)
+        return false;
+
+      succinct_octree_header header;
+      file.read(reinterpret_cast<char*>(&header), sizeof(header));
+      bool valid = file && header.magic == succinct_octree_header::magic_value && header.version == succinct_octree_header::current_version &&
+                   header.node_count != 0 && header.levels <= (sizeof(uint32_t) * 8 - 1) / 3 &&
+                   header.interval <= static_cast<uint32_t>(cell_interval::half_open);
+      if (valid)
+      {
+        size_t childBits = 8u * static_cast<size_t>(header.node_count);
+        auto childWords = read_vector<uint64_t>(file, (childBits + 63) / 64);
+        auto objectWords = read_vector<uint64_t>(file, (static_cast<size_t>(header.node_count) + 63) / 64);
+        m_object_offsets = read_vector<uint32_t>(file, header.offset_count);
+        m_indices = read_vector<uint32_t>(file, header.index_count);
+        valid = static_cast<bool>(file);
+
+        // The bits past the last node must be clear, or they would count as ones
+        auto paddingClear = [](std::vector<uint64_t> const& words, size_t bits)
+        {
+          return bits % 64 == 0 || words.empty() || (words.back() >> (bits % 64)) == 0;
+        };
+        valid = valid && paddingClear(childWords, childBits) && paddingClear(objectWords, header.node_count);
+
+        if (valid)
+        {
+          m_root_size = header.root_size;
+          m_levels = header.levels;
+          m_interval = static_cast<cell_interval>(header.interval);
+          m_node_count = header.node_count;
+          m_children.assign(std::move(childWords), childBits);
+          m_has_objects.assign(std::move(objectWords), header.node_count);
+          build_index();
+
+          // Every node but the root is the child of one, no node is deeper than the levels (their codes
+          // wouldn't fit), and each node with objects has a range of them
+          valid = m_children.ones() + 1 == m_node_count && m_has_objects.ones() + 1 == m_object_offsets.size() &&
+                  m_level_starts.back() == m_node_count && m_level_starts.size() <= m_levels + 2 &&
+                  m_object_offsets.back() == m_indices.size() &&
+                  std::is_sorted(m_object_offsets.begin(), m_object_offsets.end());
+        }
+      }
+
+      if (!valid)
+      {
+        std::cout<<"DEBUG : SUCCINCT_OCTREE : INVALID FILE " << path << "\n";
+        clear();
+        return false;
+      }
+      return true;
+    }
+
+
+    /**
+    * @brief Finds the node of a locational code, following its octants from the root.
+    * @param locational_code      The code of the node.
+    * @return uint32_t            The index of the node, or npos if it doesn't exist.
+    */
+    uint32_t succinct_octree::find_node(uint32_t locational_code) const
+    {
+      const int dimension = 3;
+
+      uint32_t depth = locational_code_depth(locational_code);
+      if (empty() || (locational_code >> (dimension * depth)) != 1u)
+        return npos;
+
+      uint32_t current = 0;
+      for (uint32_t level = depth; level > 0 && current != npos; --level)
+        current = child(current, (locational_code >> (dimension * (level - 1))) & 7u);
+      return current;
+    }
+
+
+    /**
+    * @brief Reads the children_active mask of a node.
+    * @param node         The index of the node.
+    * @return uint8_t     The mask, bit k is set if it has a child in octant k.
+    */
+    uint8_t succinct_octree::children_active(uint32_t node) const
+    {
+      assert(node < m_node_count);
+      return static_cast<uint8_t>(m_children.words()[node / 8] >> (8u * (node % 8)));
+    }
+
+
+    /**
+    * @brief Finds a child of a node.
+    * @param node         The index of the node.
+    * @param octant       The octant of the child.
+    * @return uint32_t    The index of the child, or npos if it doesn't exist.
+    */
+    uint32_t succinct_octree::child(uint32_t node, uint32_t octant) const
+    {
+      size_t position = 8u * static_cast<size_t>(node) + octant;
+      if (!m_children.get(position))
+        return npos;
+      return static_cast<uint32_t>(m_children.rank1(position)) + 1u;
+    }
+
+
+    /**
+    * @brief Finds the parent of a node.
+    * @param node         The index of the node.
+    * @return uint32_t    The index of its parent, or npos for the root.
+    */
+    uint32_t succinct_octree::parent(uint32_t node) const
+    {
+      if (node == 0 || node >= m_node_count)
+        return npos;
+      return static_cast<uint32_t>(m_children.select1(node - 1u) / 8u);
+    }
+
+
+    /**
+    * @brief Finds the depth of a node from the level it is in.
+    * @param node         The index of the node.
+    * @return uint32_t    Its depth.
+    */
+    uint32_t succinct_octree::depth(uint32_t node) const
+    {
+      assert(node < m_node_count);
+      auto levelIt = std::upper_bound(m_level_starts.begin(), m_level_starts.end(), node);
+      return static_cast<uint32_t>(levelIt - m_level_starts.begin()) - 1u;
+    }
+
+
+    /**
+    * @brief Computes the locational code of a node from the octants on its path to the root.
+    * @param node         The index of the node.
+    * @return uint32_t    Its locational code.
+    */
+    uint32_t succinct_octree::locational_code(uint32_t node) const
+    {
+      const int dimension = 3;
+
+      uint32_t code = 0;
+      uint32_t shift = 0;
+      while (node != 0)
+      {
+        size_t position = m_children.select1(node - 1u);
+        code |= static_cast<uint32_t>(position % 8u) << shift;
+        shift += dimension;
+        node = static_cast<uint32_t>(position / 8u);
+      }
+      return code | (1u << shift);
+    }
+
+
+    /**
+    * @brief Counts the objects of a node.
+    * @param node         The index of the node.
+    * @return uint32_t    The number of objects in it.
+    */
+    uint32_t succinct_octree::object_count(uint32_t node) const
+    {
+      if (!m_has_objects.get(node))
+        return 0;
+      size_t withObjects = m_has_objects.rank1(node);
+      return m_object_offsets[withObjects + 1] - m_object_offsets[withObjects];
+    }
+
+
+    /**
+    * @brief Finds the object indices of a node.
+    * @param node               The index of the node.
+    * @return uint32_t const*   Its object_count(node) indices.
+    */
+    uint32_t const* succinct_octree::objects(uint32_t node) const
+    {
+      if (!m_has_objects.get(node))
+        return nullptr;
+      return m_indices.data() + m_object_offsets[m_has_objects.rank1(node)];
+    }
+
+
+    /**
+    * @brief Computes the memory of the tree structure: the children bits and their index.
+    * @return size_t      The size in bytes.
+    */
+    size_t succinct_octree::topology_bytes() const
+    {
+      return m_children.memory_bytes() + m_level_starts.size() * sizeof(uint32_t);
+    }
+
+
+    /**
+    * @brief Computes the memory of the objects: the has-objects bits, the offsets and the indices.
+    * @return size_t      The size in bytes.
+    */
+    size_t succinct_octree::payload_bytes() const
+    {
+      return m_has_objects.memory_bytes() + (m_object_offsets.size() + m_indices.size()) * sizeof(uint32_t);
+    }
+}
@@ -0,0 +1,104 @@
+/**
+* @file succinct_octree.hpp
+* @author Miguel Echeverria , 540000918 , miguel.echeverria@digipen.edu
+* @date 2020/11/07
+* @brief Contains the declaration of the succinct octree, a pointerless encoding of the
+*        children_active masks in level order, navigated with rank and select.
+*
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+
+#pragma once
+#include "octree.hpp"
+
+namespace cs350 {
+
+    /**
+     * @brief
+     *  Bit vector with constant time rank (ones before a position) and select (position of the k-th one).
+     *  Rank uses the count of ones before every block of 512 bits plus the popcounts inside the block,
+     *  select the block of every 512-th one, so both add about 7% to the bits.
+     */
+    class rank_select_bits
+    {
+      public:
+        void   push_back(bool bit);
+        void   build_index();
+        void   clear();
+
+        [[nodiscard]] bool   get(size_t position) const { return (m_words[position / 64] >> (position % 64)) & 1u; }
+        [[nodiscard]] size_t rank1(size_t position) const;
+        [[nodiscard]] size_t select1(size_t k) const;
+        [[nodiscard]] size_t size() const { return m_size; }
+        [[nodiscard]] size_t ones() const { return m_ones; }
+        [[nodiscard]] size_t memory_bytes() const;
+
+        [[nodiscard]] std::vector<uint64_t> const& words() const { return m_words; }
+        void assign(std::vector<uint64_t> words, size_t size);
+
+      private:
+        static constexpr size_t block_bits = 512;
+
+        std::vector<uint64_t> m_words;
+        std::vector<uint32_t> m_block_ranks;     // Ones before each block
+        std::vector<uint32_t> m_select_samples;  // Block of the (i * block_bits)-th one
+        size_t                m_size{0};
+        size_t                m_ones{0};
+    };
+
+    /**
+     * @brief
+     * 	Static octree that only stores the children_active mask of each node, in level order (breadth first,
+     *  children in octant order) as a bit vector of 8 bits per node. Nodes are identified by their index in
+     *  that order: child k of node i is node rank1(8 * i + k) + 1 if its bit is set, and the parent of node j
+     *  is select1(j - 1) / 8. Locational codes are not stored, they are the path of octants from the root.
+     *  The payload is the indices of the objects of each node (a bit per node says which ones have objects).
+     */
+    class succinct_octree
+    {
+      public:
+        static constexpr uint32_t npos = std::numeric_limits<uint32_t>::max();
+
+        template <typename T, typename IndexOf>
+        void build(octree<T> const& tree, IndexOf index_of);
+        void clear();
+
+        bool save(std::string const& path) const;
+        bool load(std::string const& path);
+
+        [[nodiscard]] uint32_t find_node(uint32_t locational_code) const;
+        [[nodiscard]] uint8_t  children_active(uint32_t node) const;
+        [[nodiscard]] uint32_t child(uint32_t node, uint32_t octant) const;
+        [[nodiscard]] uint32_t parent(uint32_t node) const;
+        [[nodiscard]] uint32_t depth(uint32_t node) const;
+        [[nodiscard]] uint32_t locational_code(uint32_t node) const;
+        [[nodiscard]] uint32_t object_count(uint32_t node) const;
+        [[nodiscard]] uint32_t const* objects(uint32_t node) const;
+
+        template <typename F>
+        void query(aabb const& bv, F&& function) const;
+
+        [[nodiscard]] bool          empty() const { return m_node_count == 0; }
+        [[nodiscard]] uint32_t      node_count() const { return m_node_count; }
+        [[nodiscard]] uint32_t      root_size() const { return m_root_size; }
+        [[nodiscard]] uint32_t      levels() const { return m_levels; }
+        [[nodiscard]] cell_interval interval() const { return m_interval; }
+        [[nodiscard]] size_t        topology_bytes() const;
+        [[nodiscard]] size_t        payload_bytes() const;
+
+      private:
+        void build_index();
+
+        rank_select_bits      m_children;       // 8 bits per node, its children_active mask
+        rank_select_bits      m_has_objects;    // 1 bit per node
+        std::vector<uint32_t> m_object_offsets; // For the nodes with objects (in order), where their indices start
+        std::vector<uint32_t> m_indices;        // Object indices, grouped by node
+        std::vector<uint32_t> m_level_starts;   // First node of each depth, and the node count at the end
+        uint32_t              m_node_count{0};
+        uint32_t              m_root_size{0};
+        uint32_t              m_levels{0};
+        cell_interval         m_interval{cell_interval::closed};
+    };
+}
+
+#include "succinct_octree.inl"
@@ -0,0 +1,105 @@
+/**
+* @file succinct_octree.inl
+* @author Miguel Echeverria , 540000918 , miguel.echeverria@digipen.edu
+* @date 2020/11/07
+* @brief Contains the template functions of the succinct octree.
+*
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+
+namespace cs350 {
+
+    /**
+    * @brief Encodes the current state of a dynamic octree, with the same root size, levels and interval.
+    *        Multi-cell objects are stored once, in the node that contains their whole bv.
+    * @param tree          The octree to encode.
+    * @param index_of      Callable returning the uint32_t index of an object (given a T const*).
+    */
+    template<typename T, typename IndexOf>
+    void succinct_octree::build(octree<T> const& tree, IndexOf index_of)
+    {
+      const int dimension = 3;
+      const uint32_t maxChilds = 1u << dimension;
+
+      clear();
+      m_root_size = tree.root_size();
+      m_levels = tree.levels();
+      m_interval = tree.interval();
+      if (tree.find_node(1u) == nullptr)
+        return;
+
+      std::unordered_map<uint32_t, std::vector<uint32_t>> objectsOf;
+      for (auto const& [code, current] : tree.get_map())
+      {
+        for (T const* object = current->first; object != nullptr; object = object->octree_next_object)
+        {
+          uint32_t objectCode = tree.multi_cell_objects() != 0 ? common_locational_code(code, tree.locational_code(object->bv_world)) : code;
+          objectsOf[objectCode].push_back(static_cast<uint32_t>(index_of(object)));
+        }
+      }
+
+      // Breadth first, so the nodes of each level are contiguous and sorted by code
+      std::vector<uint32_t> codes{1u};
+      for (size_t i = 0; i < codes.size(); ++i)
+      {
+        auto const* current = tree.find_node(codes[i]);
+        for (uint32_t octant = 0; octant < maxChilds; ++octant)
+        {
+          bool active = current->children_active & (1u << octant);
+          m_children.push_back(active);
+          if (active)
+            codes.push_back((codes[i] << dimension) + octant);
+        }
+
+        auto foundIt = objectsOf.find(codes[i]);
+        m_has_objects.push_back(foundIt != objectsOf.end());
+        if (foundIt != objectsOf.end())
+        {
+          m_object_offsets.push_back(static_cast<uint32_t>(m_indices.size()));
+          m_indices.insert(m_indices.end(), foundIt->second.begin(), foundIt->second.end());
+        }
+      }
+      m_object_offsets.push_back(static_cast<uint32_t>(m_indices.size()));
+      m_node_count = static_cast<uint32_t>(codes.size());
+      build_index();
+    }
+
+
+    /**
+    * @brief Calls function with the index of every object in the nodes whose cell intersects bv (the root is
+    *        always visited, it holds the objects outside it). Bvs are not stored, so these are candidates.
+    * @param bv           The bounding volume to query.
+    * @param function     Callable taking a uint32_t index.
+    */
+    template<typename F>
+    void succinct_octree::query(aabb const& bv, F&& function) const
+    {
+      const int dimension = 3;
+      const uint32_t maxChilds = 1u << dimension;
+
+      if (empty())
+        return;
+
+      // Node and locational code, the code gives the cell
+      std::vector<std::pair<uint32_t, uint32_t>> toVisit{{0u, 1u}};
+      while (!toVisit.empty())
+      {
+        auto [current, code] = toVisit.back();
+        toVisit.pop_back();
+
+        uint32_t const* indices = objects(current);
+        for (uint32_t i = 0, count = object_count(current); i < count; ++i)
+          function(indices[i]);
+
+        uint8_t children = children_active(current);
+        for (uint32_t octant = 0; octant < maxChilds; ++octant)
+        {
+          if ((children & (1u << octant)) == 0)
+            continue;
+          uint32_t childCode = (code << dimension) + octant;
+          if (intersection_aabb_aabb(compute_bv(childCode, m_root_size), bv))
+            toVisit.emplace_back(child(current, octant), childCode);
+        }
+      }
+    }
+}
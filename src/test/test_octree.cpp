@@ -1,8 +1,95 @@
 #include "pch.hpp"
 #include "test_common.hpp"
 #include "octree.hpp"
+#include "static_octree.hpp"
+#include "size_class_broadphase.hpp"
+#include "compressed_octree.hpp"
+#include "succinct_octree.hpp"
+#include "morton_index.hpp"
+#include "sparse_voxel_octree.hpp"
+#include "triangle_octree.hpp"
+#include "spatial_reorder.hpp"
+#include "radix_sort.hpp"
+#include "bvh_tree.hpp"
+#include "mesh_data.hpp"
+#include <random>
 using namespace cs350;
 
+namespace {
+    /**
+     * @brief
+     *  Minimal object that can be stored in an octree
+     */
+    struct test_object
+    {
+        aabb bv_world;
+
+        octree<test_object>::node* octree_node{nullptr};
+        test_object*               octree_next_object{nullptr};
+        test_object*               octree_prev_object{nullptr};
+    };
+
+    /**
+     * @brief
+     *  Minimal object that can be stored in a quadtree
+     */
+    struct test_object_2d
+    {
+        aabb bv_world;
+
+        octree<test_object_2d, 2>::node* octree_node{nullptr};
+        test_object_2d*                  octree_next_object{nullptr};
+        test_object_2d*                  octree_prev_object{nullptr};
+    };
+
+    /**
+     * @brief
+     *  Creates a test object with the given bv
+     */
+    test_object make_object(glm::vec3 const& min, glm::vec3 const& max)
+    {
+        test_object object;
+        object.bv_world = aabb(min, max);
+        return object;
+    }
+
+    /**
+     * @brief
+     *  Checks that the object counts of every node match its list and that nodes link to their parents
+     */
+    void check_consistency(octree<test_object> const& tree)
+    {
+        for (auto const& [code, node] : tree.get_map()) {
+            uint32_t count = 0;
+            for (auto* obj = node->first; obj != nullptr; obj = obj->octree_next_object) {
+                ASSERT_EQ(obj->octree_node, node);
+                count++;
+            }
+            ASSERT_EQ(count, node->object_count);
+            ASSERT_EQ(node->depth, locational_code_depth(code));
+            if (code > 1) {
+                auto const* parent = tree.find_node(code >> 3);
+                ASSERT_NE(parent, nullptr);
+                ASSERT_TRUE(parent->children_active & (1u << (code & 7u)));
+            }
+        }
+
+        // The per level lists hold every node exactly once
+        size_t listed = 0;
+        for (uint32_t level = 0; level <= octree<test_object>::max_depth; ++level) {
+            uint32_t count = 0;
+            tree.for_each_node_at_level(level, [&](octree<test_object>::node const* node) {
+                ASSERT_EQ(node->depth, level);
+                ASSERT_EQ(tree.find_node(node->locational_code), node);
+                count++;
+            });
+            ASSERT_EQ(count, tree.node_count_at_level(level));
+            listed += count;
+        }
+        ASSERT_EQ(listed, tree.get_map().size());
+    }
+}
+
 TEST(quadtree, location_root_only)
 {
     uint32_t root_size = 4;
@@ -104,6 +191,22 @@ TEST(octree, location_bv)
     ASSERT_EQ(compute_locational_code(aabb({-63, -60, -63}, {-62,-52,-62}), root_size, 2), 0b1000000);
 }
 
+TEST(octree, location_bv_half_open)
+{
+    uint32_t root_size = 128;
+    // Touching the max boundary of a leaf (size 32) only promotes the object with closed cells
+    ASSERT_EQ(compute_locational_code(aabb({-64, -64, -64}, {-32, -32, -32}), root_size, 2, cell_interval::closed), 0b1000);
+    ASSERT_EQ(compute_locational_code(aabb({-64, -64, -64}, {-32, -32, -32}), root_size, 2, cell_interval::half_open), 0b1000000);
+    ASSERT_EQ(compute_locational_code(aabb({-34, -60, -60}, {-32.5f, -50, -50}), root_size, 2, cell_interval::half_open), 0b1000000);
+    ASSERT_EQ(compute_locational_code(aabb({0, 0, 0}, {64, 64, 64}), root_size, 2, cell_interval::half_open), 0b1111);
+
+    // Crossing a boundary still promotes the object
+    ASSERT_EQ(compute_locational_code(aabb({-34, -60, -60}, {-31.5f, -50, -50}), root_size, 2, cell_interval::half_open), 0b1000);
+
+    // Degenerate (point) bvs on a boundary belong to the cell that starts there
+    ASSERT_EQ(compute_locational_code(aabb({0, 0, 0}, {0, 0, 0}), root_size, 2, cell_interval::half_open), 0b1111000);
+}
+
 TEST(octree, bv)
 {
     aabb bv{};
@@ -130,4 +233,1966 @@ TEST(octree, bv)
     bv = compute_bv(0b1010100, 128);
     ASSERT_NEAR(bv.mMinPos, glm::vec3(-64, 0, -32), 1e-1f);
     ASSERT_NEAR(bv.mMaxPos, glm::vec3(-32, 32, 0), 1e-1f);
-}
\ No newline at end of file
+}
+
+TEST(octree, erase_keeps_parent_with_objects)
+{
+    octree<test_object> tree;
+    tree.set_root_size(128);
+    tree.set_levels(3);
+
+    auto big   = make_object({-10, -10, -10}, {10, 10, 10});  // Straddles the root center
+    auto small = make_object({-60, -60, -60}, {-59, -59, -59});
+    tree.insert(&big);
+    tree.insert(&small);
+    ASSERT_EQ(big.octree_node->locational_code, 0b1u);
+
+    // The root still holds big, so it must survive the deletion of the chain of small
+    tree.erase(&small);
+    ASSERT_EQ(small.octree_node, nullptr);
+    ASSERT_EQ(tree.get_map().size(), 1u);
+    ASSERT_EQ(tree.find_node(0b1u), big.octree_node);
+    ASSERT_EQ(big.octree_node->children_active, 0);
+    check_consistency(tree);
+}
+
+TEST(octree, adaptive_split_and_merge)
+{
+    octree<test_object> tree;
+    tree.set_root_size(128);
+    tree.set_levels(6);
+    tree.set_adaptive(true);
+    tree.set_thresholds(4, 3);
+
+    // A single object stays in the root, regardless of the maximum depth
+    auto lonely = make_object({40, 40, 40}, {41, 41, 41});
+    tree.insert(&lonely);
+    ASSERT_EQ(lonely.octree_node->locational_code, 0b1u);
+    ASSERT_EQ(tree.get_map().size(), 1u);
+
+    // A dense cluster forces splits until nodes hold at most the threshold
+    std::vector<test_object> cluster;
+    cluster.reserve(32);
+    for (int i = 0; i < 32; ++i) {
+        float x = -40.0f + static_cast<float>(i % 4) * 2.0f;
+        float y = -40.0f + static_cast<float>(i / 4 % 4) * 2.0f;
+        float z = -40.0f + static_cast<float>(i / 16) * 2.0f;
+        cluster.push_back(make_object({x, y, z}, {x + 0.5f, y + 0.5f, z + 0.5f}));
+    }
+    for (auto& obj : cluster) {
+        tree.insert(&obj);
+    }
+    check_consistency(tree);
+    for (auto const& [code, node] : tree.get_map()) {
+        if (locational_code_depth(code) < tree.levels() && node->children_active == 0) {
+            ASSERT_LE(node->object_count, tree.split_threshold());
+        }
+    }
+
+    // The sparse region is not subdivided: lonely sits in a shallow node
+    ASSERT_LE(locational_code_depth(lonely.octree_node->locational_code), 1u);
+
+    // Removing most of the cluster merges the nodes back
+    for (size_t i = 1; i < cluster.size(); ++i) {
+        tree.erase(&cluster[i]);
+    }
+    check_consistency(tree);
+    ASSERT_EQ(tree.get_map().size(), 1u);
+    ASSERT_EQ(cluster[0].octree_node, lonely.octree_node);
+}
+
+TEST(octree, adaptive_relocate)
+{
+    octree<test_object> tree;
+    tree.set_root_size(128);
+    tree.set_levels(5);
+    tree.set_adaptive(true);
+    tree.set_thresholds(2, 1);
+
+    std::vector<test_object> objects;
+    for (int i = 0; i < 8; ++i) {
+        float p = -50.0f + static_cast<float>(i) * 3.0f;
+        objects.push_back(make_object({p, p, p}, {p + 1, p + 1, p + 1}));
+    }
+    for (auto& obj : objects) {
+        tree.insert(&obj);
+    }
+
+    // Move everything to the opposite corner, one object at a time
+    for (auto& obj : objects) {
+        obj.bv_world.mMinPos += glm::vec3(80.0f);
+        obj.bv_world.mMaxPos += glm::vec3(80.0f);
+        tree.relocate(&obj);
+        check_consistency(tree);
+    }
+    for (auto& obj : objects) {
+        aabb cell = compute_bv(obj.octree_node->locational_code, tree.root_size());
+        ASSERT_TRUE(intersection_aabb_aabb(cell, obj.bv_world));
+        ASSERT_GE(obj.bv_world.mMinPos.x, cell.mMinPos.x);
+        ASSERT_LE(obj.bv_world.mMaxPos.x, cell.mMaxPos.x);
+    }
+}
+
+
+TEST(octree, auto_tune)
+{
+    // Small objects spread over [-50, 50]: the root must contain them and deeper trees must pay off
+    std::vector<test_object> objects;
+    for (int x = -48; x <= 48; x += 8) {
+        for (int z = -48; z <= 48; z += 8) {
+            float fx = static_cast<float>(x);
+            float fz = static_cast<float>(z);
+            objects.push_back(make_object({fx + 0.25f, 0.25f, fz + 0.25f}, {fx + 0.75f, 0.75f, fz + 0.75f}));
+        }
+    }
+    std::vector<test_object*> pointers;
+    for (auto& obj : objects) {
+        pointers.push_back(&obj);
+    }
+
+    octree<test_object> tree;
+    tree.set_root_size(1024);
+    tree.set_levels(1);
+    auto const& tuning = tree.auto_tune(pointers.begin(), pointers.end());
+
+    ASSERT_EQ(tuning.root_size, 128u);
+    ASSERT_EQ(tuning.sampled_objects, objects.size());
+    ASSERT_EQ(tuning.predicted_checks_per_level.size(), 7u);
+    ASSERT_LT(tuning.predicted_checks, tuning.current_checks);
+    ASSERT_EQ(tuning.predicted_checks, 0u);
+
+    // Shallower choices predict more checks
+    for (uint32_t levels = 1; levels < tuning.levels; ++levels) {
+        ASSERT_GT(tuning.predicted_checks_per_level[levels - 1], tuning.predicted_checks);
+    }
+
+    // The tuning doesn't modify the tree
+    ASSERT_EQ(tree.root_size(), 1024u);
+    ASSERT_EQ(tree.levels(), 1u);
+}
+
+
+TEST(octree, relevel_in_place)
+{
+    std::vector<test_object> objects;
+    for (int i = 0; i < 64; ++i) {
+        float x = -60.0f + static_cast<float>(i % 8) * 15.0f;
+        float y = -60.0f + static_cast<float>(i / 8) * 15.0f;
+        objects.push_back(make_object({x, y, 3.0f}, {x + 1.5f, y + 1.5f, 4.5f}));
+    }
+
+    octree<test_object> tree;
+    tree.set_root_size(128);
+    tree.set_levels(5);
+    for (auto& obj : objects) {
+        tree.insert(&obj);
+    }
+
+    // Every object must end up where a fresh insertion would put it
+    auto check_placement = [&]() {
+        check_consistency(tree);
+        for (auto& obj : objects) {
+            ASSERT_EQ(obj.octree_node->locational_code, tree.locational_code(obj.bv_world));
+        }
+    };
+
+    // Collapse, with a zero budget so that each call processes a single node
+    tree.set_levels(2);
+    ASSERT_TRUE(tree.relevel_pending());
+    int calls = 0;
+    while (!tree.relevel(0)) {
+        check_consistency(tree);
+        calls++;
+    }
+    ASSERT_GT(calls, 1);
+    check_placement();
+    for (auto const& [code, node] : tree.get_map()) {
+        ASSERT_LE(locational_code_depth(code), 2u);
+    }
+
+    // Push down, objects moving in the middle of the re-leveling
+    tree.set_levels(4);
+    tree.relevel(0);
+    for (auto& obj : objects) {
+        obj.bv_world.mMinPos.z -= 10.0f;
+        obj.bv_world.mMaxPos.z -= 10.0f;
+        tree.relocate(&obj);
+    }
+    while (!tree.relevel(0)) {
+        check_consistency(tree);
+    }
+    check_placement();
+
+    // Changing the levels twice before finishing
+    tree.set_levels(1);
+    tree.relevel(0);
+    tree.set_levels(6);
+    tree.relevel(std::numeric_limits<uint32_t>::max());
+    check_placement();
+
+    // Changing the root relocates everything right away
+    tree.set_root_size(256);
+    ASSERT_FALSE(tree.relevel_pending());
+    check_placement();
+}
+
+
+TEST(octree, relocate_skips_objects_inside_their_cell)
+{
+    for (auto interval : {cell_interval::closed, cell_interval::half_open}) {
+        octree<test_object> tree;
+        tree.set_root_size(128);
+        tree.set_levels(4);
+        tree.set_interval(interval);
+
+        std::vector<test_object> objects;
+        for (int i = 0; i < 100; ++i) {
+            float p = -55.0f + static_cast<float>(i) * 1.1f;
+            objects.push_back(make_object({p, -p, p * 0.5f}, {p + 2.5f, -p + 2.5f, p * 0.5f + 2.5f}));
+        }
+        for (auto& obj : objects) {
+            tree.insert(&obj);
+        }
+
+        // Small steps, the fast path must agree with the locational code every frame
+        for (int frame = 0; frame < 40; ++frame) {
+            tree.reset_counters();
+            for (auto& obj : objects) {
+                glm::vec3 step(0.3f, 0.1f, -0.2f);
+                obj.bv_world.mMinPos += step;
+                obj.bv_world.mMaxPos += step;
+                tree.relocate(&obj);
+                ASSERT_EQ(obj.octree_node->locational_code, tree.locational_code(obj.bv_world));
+            }
+            ASSERT_EQ(tree.counters().relocations, objects.size());
+        }
+        ASSERT_GT(tree.counters().skipped_relocations, objects.size() / 2);
+        check_consistency(tree);
+    }
+}
+
+
+TEST(octree, for_each_node_at_level)
+{
+    octree<test_object> tree;
+    tree.set_root_size(1024);
+    tree.set_levels(10);
+
+    auto a = make_object({-499.8f, -499.8f, -499.8f}, {-499.2f, -499.2f, -499.2f});
+    auto b = make_object({400.2f, 400.2f, 400.2f}, {400.8f, 400.8f, 400.8f});
+    tree.insert(&a);
+    tree.insert(&b);
+
+    // Two chains of 10 nodes sharing the root
+    ASSERT_EQ(tree.node_count_at_level(0), 1u);
+    for (uint32_t level = 1; level < 10; ++level) {
+        ASSERT_EQ(tree.node_count_at_level(level), 2u);
+    }
+    ASSERT_EQ(tree.node_count_at_level(10), 0u);
+    std::vector<uint32_t> leaves;
+    tree.for_each_node_at_level(9, [&](octree<test_object>::node* node) { leaves.push_back(node->locational_code); });
+    std::sort(leaves.begin(), leaves.end());
+    std::vector<uint32_t> expected = {a.octree_node->locational_code, b.octree_node->locational_code};
+    std::sort(expected.begin(), expected.end());
+    ASSERT_EQ(leaves, expected);
+    check_consistency(tree);
+
+    tree.erase(&a);
+    for (uint32_t level = 1; level < 10; ++level) {
+        ASSERT_EQ(tree.node_count_at_level(level), 1u);
+    }
+    check_consistency(tree);
+
+    tree.destroy();
+    ASSERT_EQ(tree.node_count_at_level(0), 0u);
+    tree.for_each_node_at_level(9, [](octree<test_object>::node*) { FAIL(); });
+}
+
+TEST(octree, stats)
+{
+    octree<test_object> tree;
+    tree.set_root_size(128);
+    tree.set_levels(3);
+
+    auto a = make_object({-50, -50, -50}, {-49, -49, -49});
+    auto b = make_object({-51, -51, -51}, {-50.5f, -50.5f, -50.5f});
+    auto c = make_object({-10, -10, -10}, {10, 10, 10});
+    tree.insert(&a);
+    tree.insert(&b);
+    tree.insert(&c);
+
+    auto stats = tree.stats();
+    ASSERT_EQ(stats.nodes_per_level, (std::vector<uint32_t>{1, 1, 1, 1}));
+    ASSERT_EQ(stats.objects_per_level, (std::vector<uint32_t>{1, 0, 0, 2}));
+    ASSERT_EQ(stats.node_count, 4u);
+    ASSERT_EQ(stats.object_count, 3u);
+    ASSERT_EQ(stats.max_objects_per_node, 2u);
+    ASSERT_FLOAT_EQ(stats.mean_objects_per_node, 0.75f);
+    ASSERT_GE(stats.max_probe_length, 1u);
+    ASSERT_GE(stats.mean_probe_length, 1.0f);
+    ASSERT_GT(stats.memory_bytes, 4 * sizeof(octree<test_object>::node));
+    ASSERT_EQ(stats.counters.nodes_created, 4u);
+
+    // Move a to the other side of the root
+    tree.reset_counters();
+    a.bv_world = aabb({50, 50, 50}, {51, 51, 51});
+    tree.relocate(&a);
+    stats = tree.stats();
+    ASSERT_EQ(stats.counters.relocations, 1u);
+    ASSERT_EQ(stats.counters.reinsertions, 1u);
+    ASSERT_EQ(stats.counters.nodes_created, 3u);
+    ASSERT_EQ(stats.counters.nodes_deleted, 0u);
+
+    auto json = to_json(stats);
+    ASSERT_EQ(json.front(), '{');
+    ASSERT_EQ(json.back(), '}');
+    ASSERT_NE(json.find("\"nodes_per_level\":[1,2,2,2]"), std::string::npos);
+    ASSERT_NE(json.find("\"objects_per_level\":[1,0,0,2]"), std::string::npos);
+    ASSERT_NE(json.find("\"reinsertions\":1"), std::string::npos);
+}
+
+
+TEST(static_octree, query_matches_brute_force)
+{
+    std::mt19937                          generator(7);
+    std::uniform_real_distribution<float> position(-70.0f, 70.0f);
+    std::uniform_real_distribution<float> size(0.1f, 8.0f);
+    std::vector<aabb>                     bvs;
+    for (int i = 0; i < 500; ++i) {
+        glm::vec3 min(position(generator), position(generator), position(generator));
+        bvs.emplace_back(min, min + glm::vec3(size(generator)));
+    }
+
+    static_octree tree;
+    tree.build(bvs, 128, 4, cell_interval::half_open);
+    ASSERT_EQ(tree.object_count(), 500u);
+    ASSERT_EQ(tree.nodes()[0].locational_code, 1u);
+
+    // Every node can be reached from its parent
+    for (uint32_t i = 1; i < tree.node_count(); ++i) {
+        auto const& current = tree.nodes()[i];
+        auto const* parent  = tree.find_node(current.locational_code >> 3);
+        ASSERT_NE(parent, nullptr);
+        ASSERT_TRUE(parent->children_active & (1u << (current.locational_code & 7u)));
+    }
+
+    auto check_queries = [&bvs](static_octree const& queried) {
+        for (int q = 0; q < 20; ++q) {
+            glm::vec3 min(-80.0f + q * 7.0f, -30.0f + q, -10.0f);
+            aabb      query(min, min + glm::vec3(15.0f + q));
+
+            std::vector<uint32_t> found;
+            queried.query(query, [&found](uint32_t index) { found.push_back(index); });
+            std::sort(found.begin(), found.end());
+
+            std::vector<uint32_t> expected;
+            for (uint32_t i = 0; i < bvs.size(); ++i) {
+                if (intersection_aabb_aabb(query, bvs[i])) {
+                    expected.push_back(i);
+                }
+            }
+            ASSERT_EQ(found, expected);
+        }
+    };
+    check_queries(tree);
+
+    // Round trip through a mapped file
+    std::string path = testing::TempDir() + "static_octree_test.bin";
+    ASSERT_TRUE(tree.save(path));
+    static_octree loaded;
+    ASSERT_TRUE(loaded.load(path));
+    ASSERT_TRUE(loaded.mapped());
+    ASSERT_EQ(loaded.node_count(), tree.node_count());
+    ASSERT_EQ(loaded.object_count(), tree.object_count());
+    ASSERT_EQ(loaded.levels(), 4u);
+    ASSERT_EQ(loaded.interval(), cell_interval::half_open);
+    check_queries(loaded);
+
+    // A moved octree keeps pointing into the same mapping
+    static_octree moved(std::move(loaded));
+    ASSERT_TRUE(loaded.empty());
+    check_queries(moved);
+    moved.clear();
+    std::remove(path.c_str());
+}
+
+TEST(static_octree, rejects_invalid_files)
+{
+    std::string path = testing::TempDir() + "static_octree_invalid.bin";
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << "not an octree, but long enough to hold a whole header of a static octree file";
+    }
+    static_octree loaded;
+    ASSERT_FALSE(loaded.load(path));
+    ASSERT_TRUE(loaded.empty());
+    ASSERT_FALSE(loaded.load(path + ".missing"));
+    std::remove(path.c_str());
+}
+
+TEST(static_octree, rejects_corrupt_nodes)
+{
+    // Objects in a single octant of the root, so most of its children bits are clear
+    std::vector<aabb> bvs;
+    for (int i = 0; i < 40; ++i) {
+        glm::vec3 min(5.0f + (i % 5) * 10.0f, 5.0f + (i / 5) * 6.0f, 5.0f + (i % 3) * 15.0f);
+        bvs.emplace_back(min, min + glm::vec3(1.0f + (i % 4) * 4.0f));
+    }
+    static_octree saved;
+    saved.build(bvs, 128, 4);
+    std::string path = testing::TempDir() + "static_octree_corrupt.bin";
+    ASSERT_TRUE(saved.save(path));
+
+    std::vector<char> image;
+    {
+        std::ifstream file(path, std::ios::binary);
+        image.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    static_octree_header header;
+    std::memcpy(&header, image.data(), sizeof(header));
+    ASSERT_GT(header.node_count, 2u);
+
+    // Writes a copy of the image changed by corrupt, and checks that it can't be loaded
+    auto rejects = [&](auto corrupt) {
+        std::vector<char> copy = image;
+        static_octree_header copyHeader;
+        std::memcpy(&copyHeader, copy.data(), sizeof(copyHeader));
+        std::vector<static_octree_node> nodes(copyHeader.node_count);
+        std::memcpy(nodes.data(), copy.data() + copyHeader.nodes_offset, nodes.size() * sizeof(static_octree_node));
+        corrupt(copyHeader, nodes);
+        std::memcpy(copy.data(), &copyHeader, sizeof(copyHeader));
+        std::memcpy(copy.data() + copyHeader.nodes_offset, nodes.data(), nodes.size() * sizeof(static_octree_node));
+        {
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            file.write(copy.data(), static_cast<std::streamsize>(copy.size()));
+        }
+        static_octree loaded;
+        bool accepted = loaded.load(path);
+        return !accepted && loaded.empty();
+    };
+
+    ASSERT_FALSE(rejects([](static_octree_header&, std::vector<static_octree_node>&) {}));
+    ASSERT_TRUE(rejects([](static_octree_header&, std::vector<static_octree_node>& nodes) {
+        nodes.back().object_count += 1000;
+    }));
+    ASSERT_TRUE(rejects([](static_octree_header&, std::vector<static_octree_node>& nodes) {
+        nodes.back().first_object = std::numeric_limits<uint32_t>::max();
+    }));
+    ASSERT_TRUE(rejects([](static_octree_header&, std::vector<static_octree_node>& nodes) {
+        std::swap(nodes[1].locational_code, nodes[2].locational_code);
+    }));
+    ASSERT_TRUE(rejects([](static_octree_header&, std::vector<static_octree_node>& nodes) {
+        // A child bit of the root without its node
+        ASSERT_NE(nodes[0].children_active, 0xffu);
+        uint32_t missing = 0;
+        while (nodes[0].children_active & (1u << missing)) {
+            missing++;
+        }
+        nodes[0].children_active |= 1u << missing;
+    }));
+    ASSERT_TRUE(rejects([](static_octree_header& corrupt, std::vector<static_octree_node>&) {
+        corrupt.levels = 11;
+    }));
+    ASSERT_TRUE(rejects([](static_octree_header& corrupt, std::vector<static_octree_node>&) {
+        corrupt.levels = 0;
+    }));
+    std::remove(path.c_str());
+}
+
+TEST(static_octree, round_trip_dynamic_octree)
+{
+    std::vector<test_object> objects;
+    for (int i = 0; i < 64; ++i) {
+        glm::vec3 min(-60.0f + (i % 8) * 15.0f, -60.0f + (i / 8) * 15.0f, (i % 3) * 10.0f + 0.5f);
+        objects.push_back(make_object(min, min + glm::vec3(1.0f + (i % 5) * 3.0f)));
+    }
+
+    octree<test_object> tree;
+    tree.set_root_size(128);
+    tree.set_levels(4);
+    for (auto& object : objects) {
+        tree.insert(&object);
+    }
+
+    static_octree saved;
+    saved.build(tree, [&objects](test_object const* object) { return object - objects.data(); });
+    ASSERT_EQ(saved.object_count(), objects.size());
+
+    std::vector<uint32_t> codes;
+    for (auto const& object : objects) {
+        codes.push_back(object.octree_node->locational_code);
+    }
+
+    octree<test_object> restored;
+    restored.set_root_size(16);
+    saved.restore(restored, [&objects](uint32_t index) { return &objects[index]; });
+    ASSERT_EQ(restored.root_size(), 128u);
+    ASSERT_EQ(restored.levels(), 4u);
+    ASSERT_EQ(restored.get_map().size(), tree.get_map().size());
+    for (size_t i = 0; i < objects.size(); ++i) {
+        ASSERT_EQ(objects[i].octree_node->locational_code, codes[i]);
+        ASSERT_EQ(restored.find_node(codes[i]), objects[i].octree_node);
+    }
+    check_consistency(restored);
+}
+
+TEST(octree, concurrent_relocate)
+{
+    std::mt19937                          generator(3);
+    std::uniform_real_distribution<float> position(-60.0f, 60.0f);
+    std::vector<test_object>              objects(4000);
+    for (auto& object : objects) {
+        glm::vec3 min(position(generator), position(generator), position(generator));
+        object.bv_world = aabb(min, min + glm::vec3(1.5f));
+    }
+
+    octree<test_object> tree;
+    tree.set_root_size(128);
+    tree.set_levels(5);
+    tree.set_concurrent(true);
+
+    // Insert and then move every object a few times, each thread owning a strided subset
+    const unsigned threadCount = 4;
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&objects, &tree, t, threadCount]() {
+            for (int step = 0; step < 4; ++step) {
+                for (size_t i = t; i < objects.size(); i += threadCount) {
+                    if (step != 0) {
+                        float offset = (i % 2 == 0 ? 7.0f : -7.0f) * (step % 2 == 0 ? 1.0f : -1.0f);
+                        objects[i].bv_world.mMinPos += glm::vec3(offset, 0.0f, 0.0f);
+                        objects[i].bv_world.mMaxPos += glm::vec3(offset, 0.0f, 0.0f);
+                    }
+                    tree.relocate(&objects[i]);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    ASSERT_EQ(tree.counters().relocations, 3 * objects.size());
+    tree.flush_deletes();
+    ASSERT_FALSE(tree.deletes_pending());
+    check_consistency(tree);
+
+    // The same nodes as inserting them sequentially, and no empty leaves left behind
+    octree<test_object>      expected;
+    std::vector<test_object> copies(objects.size());
+    expected.set_root_size(128);
+    expected.set_levels(5);
+    for (size_t i = 0; i < objects.size(); ++i) {
+        ASSERT_EQ(objects[i].octree_node->locational_code, tree.locational_code(objects[i].bv_world));
+        copies[i].bv_world = objects[i].bv_world;
+        expected.insert(&copies[i]);
+    }
+    ASSERT_EQ(tree.get_map().size(), expected.get_map().size());
+
+    tree.set_concurrent(false);
+}
+
+TEST(static_octree, snapshots_are_stable_while_read)
+{
+    octree_snapshots snapshots;
+    ASSERT_FALSE(snapshots.acquire());
+
+    // Every object of frame f is at z = f % 32, a reader must never see two frames mixed
+    auto make_frame = [](uint64_t frame) {
+        std::vector<aabb> bvs;
+        for (int i = 0; i < 300; ++i) {
+            glm::vec3 min(-50.0f + (i % 20) * 5.0f, -50.0f + (i / 20) * 5.0f, static_cast<float>(frame % 32));
+            bvs.emplace_back(min, min + glm::vec3(0.5f + (frame % 3)));
+        }
+        return bvs;
+    };
+
+    const uint64_t    frames = 200;
+    std::atomic<bool> done{false};
+    std::atomic<int>  readsDone{0};
+    std::thread       readerThread([&]() {
+        uint64_t lastFrame = 0;
+        while (!done.load()) {
+            auto snapshot = snapshots.acquire();
+            if (!snapshot) {
+                continue;
+            }
+            ASSERT_GE(snapshot.frame(), lastFrame);
+            lastFrame = snapshot.frame();
+
+            float z     = static_cast<float>(snapshot.frame() % 32);
+            int   found = 0;
+            snapshot->query(aabb({-100, -100, -100}, {100, 100, 100}), [&found](uint32_t) { found++; });
+            ASSERT_EQ(found, 300);
+            for (uint32_t i = 0; i < snapshot->object_count(); ++i) {
+                ASSERT_EQ(snapshot->object_bvs()[i].min[2], z);
+            }
+            readsDone++;
+        }
+    });
+
+    for (uint64_t frame = 1; frame <= frames; ++frame) {
+        snapshots.publish(make_frame(frame), 128, 4);
+        ASSERT_EQ(snapshots.frame(), frame);
+    }
+    while (readsDone.load() == 0) {
+        std::this_thread::yield();
+    }
+    done = true;
+    readerThread.join();
+
+    auto last = snapshots.acquire();
+    ASSERT_EQ(last.frame(), frames);
+    ASSERT_EQ(last->object_count(), 300u);
+}
+
+TEST(octree, node_retention)
+{
+    octree<test_object> tree;
+    tree.set_root_size(128);
+    tree.set_levels(4);
+    tree.set_node_retention(3, std::numeric_limits<size_t>::max());
+
+    // An object oscillating across the root center, and one that stays
+    auto left   = aabb({-21, 5.5f, 5.5f}, {-20, 6.5f, 6.5f});
+    auto right  = aabb({20, 5.5f, 5.5f}, {21, 6.5f, 6.5f});
+    auto moving = make_object(left.mMinPos, left.mMaxPos);
+    auto still  = make_object({40.5f, 40.5f, 40.5f}, {41, 41, 41});
+    tree.insert(&moving);
+    tree.insert(&still);
+    tree.end_frame();
+    size_t nodes = tree.get_map().size();
+
+    tree.reset_counters();
+    for (int frame = 0; frame < 20; ++frame) {
+        moving.bv_world = frame % 2 == 0 ? right : left;
+        tree.relocate(&moving);
+        tree.end_frame();
+    }
+    // Both chains are created once and then reused
+    ASSERT_EQ(tree.counters().nodes_deleted, 0u);
+    ASSERT_EQ(tree.get_map().size(), nodes + 3);
+    ASSERT_EQ(tree.retained_nodes(), 1u);
+    check_consistency(tree);
+
+    // Once it stops, the empty chain is released at the end of the third frame it has been empty for
+    tree.end_frame();
+    ASSERT_EQ(tree.get_map().size(), nodes + 3);
+    tree.end_frame();
+    ASSERT_EQ(tree.get_map().size(), nodes);
+    ASSERT_EQ(tree.counters().nodes_deleted, 3u);
+    ASSERT_EQ(tree.retained_nodes(), 0u);
+    check_consistency(tree);
+
+    // A budget of a single node releases the oldest ones first
+    tree.set_node_retention(100, sizeof(octree<test_object>::node));
+    auto a = make_object({-60.5f, -60.5f, -60.5f}, {-60, -60, -60});
+    auto b = make_object({-40.5f, -60.5f, -60.5f}, {-40, -60, -60});
+    tree.insert(&a);
+    tree.insert(&b);
+    tree.erase(&a);
+    tree.erase(&b);
+    ASSERT_EQ(tree.retained_nodes(), 2u);
+    tree.end_frame();
+    ASSERT_EQ(tree.retained_nodes(), 1u);
+    ASSERT_EQ(tree.find_node(tree.locational_code(a.bv_world)), nullptr);
+    ASSERT_NE(tree.find_node(tree.locational_code(b.bv_world)), nullptr);
+
+    // Disabling it releases everything
+    tree.set_node_retention(0, 0);
+    ASSERT_EQ(tree.retained_nodes(), 0u);
+    ASSERT_EQ(tree.find_node(tree.locational_code(b.bv_world)), nullptr);
+    check_consistency(tree);
+}
+
+TEST(octree, multi_cell_pairs_match_brute_force)
+{
+    std::mt19937                          generator(11);
+    std::uniform_real_distribution<float> position(-60.0f, 60.0f);
+    std::uniform_real_distribution<float> smallSize(0.3f, 3.0f);
+    std::uniform_real_distribution<float> bigSize(10.0f, 25.0f);
+    std::vector<test_object>              objects(600);
+    auto randomize = [&]() {
+        for (size_t i = 0; i < objects.size(); ++i) {
+            glm::vec3 min(position(generator), position(generator), position(generator));
+            float     size = i % 20 == 0 ? bigSize(generator) : smallSize(generator);
+            objects[i].bv_world = aabb(min, glm::min(min + glm::vec3(size), glm::vec3(63.0f)));
+        }
+    };
+    randomize();
+
+    octree<test_object> tree;
+    tree.set_root_size(128);
+    tree.set_levels(5);
+    for (auto& object : objects) {
+        tree.insert(&object);
+    }
+
+    // Every overlapping pair is reported, and no candidate pair more than once
+    size_t candidateCount = 0;
+    auto   check_pairs    = [&]() {
+        std::vector<std::pair<test_object const*, test_object const*>> candidates;
+        tree.for_each_pair([&candidates](test_object const* a, test_object const* b) {
+            candidates.emplace_back(std::min(a, b), std::max(a, b));
+        });
+        std::sort(candidates.begin(), candidates.end());
+        ASSERT_EQ(std::adjacent_find(candidates.begin(), candidates.end()), candidates.end());
+
+        std::vector<std::pair<test_object const*, test_object const*>> overlapping;
+        for (auto const& pair : candidates) {
+            if (intersection_aabb_aabb(pair.first->bv_world, pair.second->bv_world)) {
+                overlapping.push_back(pair);
+            }
+        }
+        std::vector<std::pair<test_object const*, test_object const*>> expected;
+        for (size_t i = 0; i < objects.size(); ++i) {
+            for (size_t j = i + 1; j < objects.size(); ++j) {
+                if (intersection_aabb_aabb(objects[i].bv_world, objects[j].bv_world)) {
+                    expected.emplace_back(std::min(&objects[i], &objects[j]), std::max(&objects[i], &objects[j]));
+                }
+            }
+        }
+        std::sort(expected.begin(), expected.end());
+        ASSERT_EQ(overlapping, expected);
+        candidateCount = candidates.size();
+    };
+    check_pairs();
+    size_t singleCell = candidateCount;
+
+    tree.set_multi_cell(3, 8);
+    ASSERT_GT(tree.multi_cell_objects(), 0u);
+    check_consistency(tree);
+    check_pairs();
+    ASSERT_LT(candidateCount, singleCell);
+
+    // Moving everything keeps the references right
+    randomize();
+    for (auto& object : objects) {
+        tree.relocate(&object);
+    }
+    check_consistency(tree);
+    check_pairs();
+
+    // Changing the levels moves the multi-cell depth
+    tree.set_levels(2);
+    tree.relevel(std::numeric_limits<uint32_t>::max());
+    check_consistency(tree);
+    check_pairs();
+
+    // The concurrent mode puts them back in a single node before the parallel relocations
+    ASSERT_GT(tree.multi_cell_objects(), 0u);
+    tree.set_concurrent(true);
+    ASSERT_EQ(tree.multi_cell_objects(), 0u);
+    randomize();
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 2; ++t) {
+        threads.emplace_back([&objects, &tree, t]() {
+            for (size_t i = t; i < objects.size(); i += 2) {
+                tree.relocate(&objects[i]);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    tree.set_concurrent(false);
+    ASSERT_EQ(tree.multi_cell_objects(), 0u);
+    check_consistency(tree);
+    check_pairs();
+
+    for (auto& object : objects) {
+        tree.erase(&object);
+    }
+    ASSERT_EQ(tree.multi_cell_objects(), 0u);
+    ASSERT_TRUE(tree.get_map().empty());
+}
+
+TEST(octree, query_matches_brute_force)
+{
+    std::mt19937                          generator(13);
+    std::uniform_real_distribution<float> position(-70.0f, 70.0f);
+    std::uniform_real_distribution<float> size(0.3f, 20.0f);
+    std::vector<test_object>              objects(500);
+    for (auto& object : objects) {
+        glm::vec3 min(position(generator), position(generator), position(generator));
+        object.bv_world = aabb(min, min + glm::vec3(size(generator)));
+    }
+
+    octree<test_object> tree;
+    tree.set_root_size(128);
+    tree.set_levels(5);
+    for (auto& object : objects) {
+        tree.insert(&object);
+    }
+
+    // Each object is reported once, also the multi-cell ones and the ones outside the root
+    auto check_queries = [&]() {
+        for (int i = 0; i < 50; ++i) {
+            glm::vec3 min(position(generator), position(generator), position(generator));
+            aabb      bv(min, min + glm::vec3(size(generator)));
+
+            std::vector<test_object const*> found;
+            tree.query(bv, [&found](test_object const* object) { found.push_back(object); });
+            std::sort(found.begin(), found.end());
+            ASSERT_EQ(std::adjacent_find(found.begin(), found.end()), found.end());
+
+            std::vector<test_object const*> expected;
+            for (auto const& object : objects) {
+                if (intersection_aabb_aabb(object.bv_world, bv)) {
+                    expected.push_back(&object);
+                }
+            }
+            ASSERT_EQ(found, expected);
+
+            // The candidates hold them, each once
+            std::vector<test_object const*> candidates;
+            tree.query_cells(bv, [&candidates](test_object const* object) { candidates.push_back(object); });
+            std::sort(candidates.begin(), candidates.end());
+            ASSERT_EQ(std::adjacent_find(candidates.begin(), candidates.end()), candidates.end());
+            ASSERT_TRUE(std::includes(candidates.begin(), candidates.end(), found.begin(), found.end()));
+        }
+    };
+    check_queries();
+    tree.set_multi_cell(3, 27);
+    ASSERT_GT(tree.multi_cell_objects(), 0u);
+    check_queries();
+
+    size_t visited = 0;
+    tree.for_each_object([&visited](test_object const*) { visited++; });
+    ASSERT_EQ(visited, objects.size());
+}
+
+TEST(size_class_broadphase, pairs_match_brute_force)
+{
+    std::mt19937                          generator(17);
+    std::uniform_real_distribution<float> position(-60.0f, 60.0f);
+    std::uniform_real_distribution<float> smallSize(0.3f, 2.0f);
+    std::uniform_real_distribution<float> bigSize(6.0f, 30.0f);
+    std::vector<test_object>              objects(600);
+    auto randomize = [&]() {
+        for (size_t i = 0; i < objects.size(); ++i) {
+            glm::vec3 min(position(generator), position(generator), position(generator));
+            float     size = i % 15 == 0 ? bigSize(generator) : smallSize(generator);
+            objects[i].bv_world = aabb(min, min + glm::vec3(size));
+        }
+    };
+    randomize();
+
+    size_class_broadphase<test_object> broadphase;
+    broadphase.set_classes(128, {2.0f, 8.0f}, 6);
+    ASSERT_EQ(broadphase.class_count(), 3u);
+    ASSERT_GT(broadphase.tree(0).levels(), broadphase.tree(1).levels());
+    ASSERT_GT(broadphase.tree(1).levels(), broadphase.tree(2).levels());
+    for (auto& object : objects) {
+        broadphase.insert(&object);
+    }
+
+    // Every overlapping pair is reported, and no pair more than once
+    auto check_pairs = [&]() {
+        std::vector<std::pair<test_object const*, test_object const*>> overlapping;
+        broadphase.for_each_pair([&overlapping](test_object const* a, test_object const* b) {
+            if (intersection_aabb_aabb(a->bv_world, b->bv_world)) {
+                overlapping.emplace_back(std::min(a, b), std::max(a, b));
+            }
+        });
+        std::sort(overlapping.begin(), overlapping.end());
+        ASSERT_EQ(std::adjacent_find(overlapping.begin(), overlapping.end()), overlapping.end());
+
+        std::vector<std::pair<test_object const*, test_object const*>> expected;
+        for (size_t i = 0; i < objects.size(); ++i) {
+            for (size_t j = i + 1; j < objects.size(); ++j) {
+                if (intersection_aabb_aabb(objects[i].bv_world, objects[j].bv_world)) {
+                    expected.emplace_back(std::min(&objects[i], &objects[j]), std::max(&objects[i], &objects[j]));
+                }
+            }
+        }
+        std::sort(expected.begin(), expected.end());
+        ASSERT_EQ(overlapping, expected);
+    };
+    check_pairs();
+
+    // Objects that change size move to another class
+    randomize();
+    for (auto& object : objects) {
+        broadphase.relocate(&object);
+    }
+    for (size_t i = 0; i < broadphase.class_count(); ++i) {
+        check_consistency(broadphase.tree(i));
+    }
+    check_pairs();
+
+    for (auto& object : objects) {
+        broadphase.erase(&object);
+    }
+    ASSERT_EQ(broadphase.object_count(), 0u);
+    for (size_t i = 0; i < broadphase.class_count(); ++i) {
+        ASSERT_TRUE(broadphase.tree(i).get_map().empty());
+    }
+}
+
+TEST(octree, spatial_join_matches_brute_force)
+{
+    std::mt19937                          generator(19);
+    std::uniform_real_distribution<float> position(-70.0f, 70.0f);
+    std::uniform_real_distribution<float> smallSize(0.3f, 3.0f);
+    std::uniform_real_distribution<float> bigSize(8.0f, 25.0f);
+    std::vector<test_object>              staticObjects(400);
+    std::vector<test_object>              dynamicObjects(400);
+    auto randomize = [&](std::vector<test_object>& objects) {
+        for (size_t i = 0; i < objects.size(); ++i) {
+            glm::vec3 min(position(generator), position(generator), position(generator));
+            float     size = i % 25 == 0 ? bigSize(generator) : smallSize(generator);
+            objects[i].bv_world = aabb(min, min + glm::vec3(size));
+        }
+    };
+    randomize(staticObjects);
+    randomize(dynamicObjects);
+
+    // Different levels, and multi-cell objects in one of them
+    octree<test_object> staticTree;
+    staticTree.set_root_size(128);
+    staticTree.set_levels(4);
+    staticTree.set_multi_cell(2, 8);
+    octree<test_object> dynamicTree;
+    dynamicTree.set_root_size(128);
+    dynamicTree.set_levels(6);
+    for (auto& object : staticObjects) {
+        staticTree.insert(&object);
+    }
+    for (auto& object : dynamicObjects) {
+        dynamicTree.insert(&object);
+    }
+    ASSERT_GT(staticTree.multi_cell_objects(), 0u);
+
+    // Every overlapping static-dynamic pair, no pair twice and none within a tree
+    auto check_join = [&]() {
+        std::vector<std::pair<test_object const*, test_object const*>> candidates;
+        ASSERT_TRUE(spatial_join(staticTree, dynamicTree, [&candidates](test_object const* a, test_object const* b) {
+            candidates.emplace_back(a, b);
+        }));
+        std::sort(candidates.begin(), candidates.end());
+        ASSERT_EQ(std::adjacent_find(candidates.begin(), candidates.end()), candidates.end());
+
+        std::vector<std::pair<test_object const*, test_object const*>> overlapping;
+        for (auto const& pair : candidates) {
+            ASSERT_GE(pair.first, &staticObjects.front());
+            ASSERT_LE(pair.first, &staticObjects.back());
+            ASSERT_GE(pair.second, &dynamicObjects.front());
+            ASSERT_LE(pair.second, &dynamicObjects.back());
+            if (intersection_aabb_aabb(pair.first->bv_world, pair.second->bv_world)) {
+                overlapping.push_back(pair);
+            }
+        }
+        std::vector<std::pair<test_object const*, test_object const*>> expected;
+        for (auto const& a : staticObjects) {
+            for (auto const& b : dynamicObjects) {
+                if (intersection_aabb_aabb(a.bv_world, b.bv_world)) {
+                    expected.emplace_back(&a, &b);
+                }
+            }
+        }
+        std::sort(expected.begin(), expected.end());
+        ASSERT_EQ(overlapping, expected);
+    };
+    check_join();
+
+    randomize(dynamicObjects);
+    for (auto& object : dynamicObjects) {
+        dynamicTree.relocate(&object);
+    }
+    check_join();
+    dynamicTree.set_multi_cell(3, 27);
+    check_join();
+
+    // Cells of different roots don't match
+    octree<test_object> otherTree;
+    otherTree.set_root_size(256);
+    otherTree.set_levels(4);
+    ASSERT_FALSE(spatial_join(staticTree, otherTree, [](test_object const*, test_object const*) {}));
+}
+
+TEST(compressed_octree, matches_octree_in_sparse_scenes)
+{
+    // A few small clusters far apart, deep trees
+    std::mt19937                          generator(23);
+    std::uniform_real_distribution<float> cluster(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> offset(0.0f, 4.0f);
+    std::uniform_real_distribution<float> size(0.2f, 1.0f);
+    std::vector<glm::vec3>                centers(6);
+    std::vector<test_object>              objects(300);
+    auto randomize = [&]() {
+        for (auto& center : centers) {
+            center = glm::vec3(cluster(generator), cluster(generator), cluster(generator));
+        }
+        for (size_t i = 0; i < objects.size(); ++i) {
+            glm::vec3 min = centers[i % centers.size()] + glm::vec3(offset(generator), offset(generator), offset(generator));
+            objects[i].bv_world = aabb(min, min + glm::vec3(size(generator)));
+        }
+    };
+    randomize();
+
+    compressed_octree<test_object> tree;
+    tree.set_root_size(256);
+    tree.set_levels(7);
+    std::vector<test_object> copies = objects;
+    octree<test_object>      reference;
+    reference.set_root_size(256);
+    reference.set_levels(7);
+    for (size_t i = 0; i < objects.size(); ++i) {
+        tree.insert(&objects[i]);
+        reference.insert(&copies[i]);
+    }
+
+    auto check = [&]() {
+        // Same locational codes, and only the nodes with objects or branching exist
+        for (size_t i = 0; i < objects.size(); ++i) {
+            ASSERT_EQ(objects[i].octree_node->locational_code, tree.locational_code(objects[i].bv_world));
+            ASSERT_EQ(tree.find_node(objects[i].octree_node->locational_code), objects[i].octree_node);
+            ASSERT_EQ(tree.find_deepest(objects[i].octree_node->locational_code), objects[i].octree_node);
+        }
+        for (auto const& [code, current] : tree.get_map()) {
+            int children = 0;
+            for (auto const* child : current->children) {
+                if (child != nullptr) {
+                    children++;
+                    ASSERT_EQ(child->parent, current);
+                    ASSERT_TRUE(is_locational_code_prefix(code, child->locational_code));
+                }
+            }
+            ASSERT_TRUE(current == tree.root() || current->first != nullptr || children >= 2);
+        }
+
+        // Same pairs and query results as brute force
+        std::vector<std::pair<test_object const*, test_object const*>> overlapping;
+        tree.for_each_pair([&overlapping](test_object const* a, test_object const* b) {
+            if (intersection_aabb_aabb(a->bv_world, b->bv_world)) {
+                overlapping.emplace_back(std::min(a, b), std::max(a, b));
+            }
+        });
+        std::sort(overlapping.begin(), overlapping.end());
+        ASSERT_EQ(std::adjacent_find(overlapping.begin(), overlapping.end()), overlapping.end());
+        std::vector<std::pair<test_object const*, test_object const*>> expected;
+        for (size_t i = 0; i < objects.size(); ++i) {
+            for (size_t j = i + 1; j < objects.size(); ++j) {
+                if (intersection_aabb_aabb(objects[i].bv_world, objects[j].bv_world)) {
+                    expected.emplace_back(std::min(&objects[i], &objects[j]), std::max(&objects[i], &objects[j]));
+                }
+            }
+        }
+        std::sort(expected.begin(), expected.end());
+        ASSERT_EQ(overlapping, expected);
+
+        std::vector<test_object const*> found;
+        aabb                            queryBV(centers[0] - glm::vec3(2.0f), centers[0] + glm::vec3(3.0f));
+        tree.query(queryBV, [&found](test_object const* object) { found.push_back(object); });
+        std::sort(found.begin(), found.end());
+        std::vector<test_object const*> expectedFound;
+        for (auto const& object : objects) {
+            if (intersection_aabb_aabb(object.bv_world, queryBV)) {
+                expectedFound.push_back(&object);
+            }
+        }
+        ASSERT_EQ(found, expectedFound);
+    };
+    check();
+    for (size_t i = 0; i < objects.size(); ++i) {
+        ASSERT_EQ(objects[i].octree_node->locational_code, copies[i].octree_node->locational_code);
+    }
+    ASSERT_LT(tree.get_map().size(), reference.get_map().size());
+    ASSERT_LT(tree.max_path_length(), tree.levels());
+
+    randomize();
+    for (auto& object : objects) {
+        tree.relocate(&object);
+    }
+    check();
+    tree.set_levels(5);
+    check();
+
+    for (auto& object : objects) {
+        tree.erase(&object);
+    }
+    ASSERT_TRUE(tree.get_map().empty());
+    ASSERT_EQ(tree.root(), nullptr);
+}
+
+TEST(succinct_octree, navigation_matches_octree)
+{
+    std::mt19937                          generator(29);
+    std::uniform_real_distribution<float> position(-140.0f, 140.0f);
+    std::uniform_real_distribution<float> size(0.2f, 6.0f);
+    std::vector<test_object>              objects(3000);
+    for (auto& object : objects) {
+        glm::vec3 min(position(generator), position(generator), position(generator));
+        object.bv_world = aabb(min, min + glm::vec3(size(generator)));
+    }
+
+    octree<test_object> tree;
+    tree.set_root_size(256);
+    tree.set_levels(6);
+    for (auto& object : objects) {
+        tree.insert(&object);
+    }
+    auto index_of = [&objects](test_object const* object) { return static_cast<uint32_t>(object - objects.data()); };
+
+    succinct_octree encoded;
+    encoded.build(tree, index_of);
+    ASSERT_EQ(encoded.node_count(), tree.get_map().size());
+
+    // Every node is found by its code, with the same children and objects, and the navigation is consistent
+    auto check = [&](succinct_octree const& succinct) {
+        for (auto const& [code, current] : tree.get_map()) {
+            uint32_t node = succinct.find_node(code);
+            ASSERT_NE(node, succinct_octree::npos);
+            ASSERT_EQ(succinct.locational_code(node), code);
+            ASSERT_EQ(succinct.depth(node), current->depth);
+            ASSERT_EQ(succinct.children_active(node), current->children_active);
+            for (uint32_t octant = 0; octant < 8; ++octant) {
+                uint32_t child = succinct.child(node, octant);
+                ASSERT_EQ(child != succinct_octree::npos, (current->children_active & (1u << octant)) != 0);
+                if (child != succinct_octree::npos) {
+                    ASSERT_EQ(succinct.parent(child), node);
+                } else {
+                    ASSERT_EQ(succinct.find_node((code << 3) + octant), succinct_octree::npos);
+                }
+            }
+
+            std::vector<uint32_t> expected;
+            for (auto const* object = current->first; object != nullptr; object = object->octree_next_object) {
+                expected.push_back(index_of(object));
+            }
+            std::vector<uint32_t> stored(succinct.objects(node), succinct.objects(node) + succinct.object_count(node));
+            std::sort(expected.begin(), expected.end());
+            std::sort(stored.begin(), stored.end());
+            ASSERT_EQ(stored, expected);
+        }
+        ASSERT_EQ(succinct.parent(0), succinct_octree::npos);
+        ASSERT_EQ(succinct.find_node(0), succinct_octree::npos);
+
+        // The query candidates contain every overlapping object
+        aabb                  queryBV(glm::vec3(20.0f, 5.0f, 3.0f), glm::vec3(45.0f, 30.0f, 40.0f));
+        std::vector<uint32_t> candidates;
+        succinct.query(queryBV, [&candidates](uint32_t index) { candidates.push_back(index); });
+        std::sort(candidates.begin(), candidates.end());
+        ASSERT_EQ(std::adjacent_find(candidates.begin(), candidates.end()), candidates.end());
+        for (auto const& object : objects) {
+            if (intersection_aabb_aabb(object.bv_world, queryBV)) {
+                ASSERT_TRUE(std::binary_search(candidates.begin(), candidates.end(), index_of(&object)));
+            }
+        }
+        ASSERT_LT(candidates.size(), objects.size() / 2);
+    };
+    check(encoded);
+
+    // About 8 bits per node for the structure
+    ASSERT_LT(encoded.topology_bytes() * 8, encoded.node_count() * 10u);
+
+    // Round trip through a file, and corrupted files are rejected
+    std::string path = testing::TempDir() + "succinct_octree_test.bin";
+    ASSERT_TRUE(encoded.save(path));
+    succinct_octree loaded;
+    ASSERT_TRUE(loaded.load(path));
+    ASSERT_EQ(loaded.node_count(), encoded.node_count());
+    check(loaded);
+
+    // Overwrites part of a fresh copy of the file, which must then be rejected
+    auto rejects = [&](std::streamoff offset, auto value) {
+        EXPECT_TRUE(encoded.save(path));
+        {
+            std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+            file.seekp(offset);
+            file.write(reinterpret_cast<char const*>(&value), sizeof(value));
+        }
+        return !loaded.load(path) && loaded.empty();
+    };
+    ASSERT_TRUE(rejects(32 + 8 * 10, uint64_t(0)));
+
+    // Header: levels at 12, interval at 16, then the children words from 32 and the has objects words
+    uint32_t nodeCount = encoded.node_count();
+    ASSERT_NE(nodeCount % 64, 0u);
+    std::streamoff objectWords = 32 + 8 * static_cast<std::streamoff>((nodeCount + 7) / 8);
+    std::streamoff lastObjectWord = objectWords + 8 * static_cast<std::streamoff>((nodeCount + 63) / 64 - 1);
+    uint64_t lastWord = 0;
+    ASSERT_TRUE(encoded.save(path));
+    {
+        std::ifstream file(path, std::ios::binary);
+        file.seekg(lastObjectWord);
+        file.read(reinterpret_cast<char*>(&lastWord), sizeof(lastWord));
+    }
+    // A padding bit set instead of a node's one, the counts still match
+    ASSERT_NE(lastWord, 0u);
+    ASSERT_TRUE(rejects(lastObjectWord, (lastWord & (lastWord - 1)) | (uint64_t(1) << 63)));
+    ASSERT_TRUE(rejects(16, uint32_t(7)));                                  // Unknown interval
+    ASSERT_GT(encoded.levels(), 1u);
+    ASSERT_TRUE(rejects(12, uint32_t(1)));                                  // Nodes deeper than the levels
+    std::remove(path.c_str());
+}
+
+TEST(morton_index, bigmin_litmax_match_brute_force)
+{
+    // Every code of a 3 level grid between the corners of random boxes
+    std::mt19937                       generator(23);
+    std::uniform_int_distribution<int> cell(-4, 3);
+    const uint32_t                     depth = 3;
+    auto code_of = [](glm::ivec3 position) { return compute_locational_code<3>(position, 8, 3) ^ (1u << 9); };
+    for (int i = 0; i < 40; ++i) {
+        glm::ivec3 a(cell(generator), cell(generator), cell(generator));
+        glm::ivec3 b(cell(generator), cell(generator), cell(generator));
+        uint32_t   minCode = code_of(glm::min(a, b));
+        uint32_t   maxCode = code_of(glm::max(a, b));
+        for (uint32_t code = minCode; code <= maxCode; ++code) {
+            if (morton_in_box(code, minCode, maxCode)) {
+                continue;
+            }
+            uint32_t expectedBigmin = code + 1;
+            while (!morton_in_box(expectedBigmin, minCode, maxCode)) {
+                expectedBigmin++;
+            }
+            uint32_t expectedLitmax = code - 1;
+            while (!morton_in_box(expectedLitmax, minCode, maxCode)) {
+                expectedLitmax--;
+            }
+            ASSERT_EQ(morton_bigmin(code, minCode, maxCode, depth * 3), expectedBigmin);
+            ASSERT_EQ(morton_litmax(code, minCode, maxCode, depth * 3), expectedLitmax);
+        }
+    }
+}
+
+TEST(morton_index, query_matches_brute_force)
+{
+    std::mt19937                          generator(29);
+    std::uniform_real_distribution<float> position(-70.0f, 70.0f);
+    std::uniform_real_distribution<float> size(0.3f, 12.0f);
+    std::vector<aabb>                     bvs(2000);
+    for (auto& bv : bvs) {
+        glm::vec3 min(position(generator), position(generator), position(generator));
+        bv = aabb(min, min + glm::vec3(size(generator)));
+    }
+
+    for (cell_interval interval : {cell_interval::closed, cell_interval::half_open}) {
+        morton_index index;
+        index.build(bvs, 128, 6, interval);
+        ASSERT_EQ(index.size(), bvs.size());
+
+        // Thick boxes and slabs
+        for (int i = 0; i < 60; ++i) {
+            glm::vec3 min(position(generator), position(generator), position(generator));
+            glm::vec3 extent(size(generator) * 2.0f);
+            if (i % 2 == 1) {
+                extent[i % 3] = 0.5f;
+                extent[(i + 1) % 3] = 140.0f;
+                min[(i + 1) % 3] = -70.0f;
+            }
+            aabb bv(min, min + extent);
+
+            std::vector<uint32_t> found;
+            index.query(bv, [&found](uint32_t object) { found.push_back(object); });
+            std::sort(found.begin(), found.end());
+
+            std::vector<uint32_t> expected;
+            for (uint32_t j = 0; j < bvs.size(); ++j) {
+                if (intersection_aabb_aabb(bvs[j], bv)) {
+                    expected.push_back(j);
+                }
+            }
+            ASSERT_EQ(found, expected);
+        }
+    }
+}
+
+TEST(octree, barnes_hut_matches_direct_sum)
+{
+    std::mt19937                          generator(31);
+    std::uniform_real_distribution<float> position(-60.0f, 60.0f);
+    std::vector<test_object>              objects(1500);
+    std::vector<test_object*>             pointers;
+    for (auto& object : objects) {
+        glm::vec3 min(position(generator), position(generator), position(generator));
+        object.bv_world = aabb(min, min + glm::vec3(1.0f));
+        pointers.push_back(&object);
+    }
+    // Some of them outside the root
+    objects[0].bv_world = aabb(glm::vec3(90.0f), glm::vec3(91.0f));
+
+    octree<test_object> tree;
+    tree.set_root_size(128);
+    tree.set_levels(5);
+    for (auto& object : objects) {
+        tree.insert(&object);
+    }
+
+    auto mass_of = [&objects](test_object const* object) { return 1.0f + static_cast<float>((object - objects.data()) % 3); };
+    std::vector<glm::vec3> expected(objects.size(), glm::vec3(0.0f));
+    for (size_t i = 0; i < objects.size(); ++i) {
+        glm::vec3 position = (objects[i].bv_world.mMinPos + objects[i].bv_world.mMaxPos) * 0.5f;
+        for (size_t j = 0; j < objects.size(); ++j) {
+            if (i != j) {
+                glm::vec3 toCenter   = (objects[j].bv_world.mMinPos + objects[j].bv_world.mMaxPos) * 0.5f - position;
+                float     distanceSq = glm::dot(toCenter, toCenter) + 0.01f;
+                expected[i] += toCenter * (mass_of(&objects[j]) / (distanceSq * glm::sqrt(distanceSq)));
+            }
+        }
+    }
+
+    // Opening every node is the direct sum
+    std::vector<glm::vec3> exact;
+    compute_gravity(tree, pointers, mass_of, exact, 0.0f, 1.0f, 0.1f);
+    ASSERT_EQ(tree.find_aggregate(1u)->mass, 3000.0f);
+    for (size_t i = 0; i < objects.size(); ++i) {
+        ASSERT_LT(glm::length(exact[i] - expected[i]), 1e-3f * glm::length(expected[i]) + 1e-6f);
+    }
+
+    // The approximation stays close, and is the same with several threads
+    std::vector<glm::vec3> approximated;
+    std::vector<glm::vec3> parallel;
+    compute_gravity(tree, pointers, mass_of, approximated, 0.5f, 1.0f, 0.1f);
+    compute_gravity(tree, pointers, mass_of, parallel, 0.5f, 1.0f, 0.1f, 4);
+    ASSERT_EQ(approximated, parallel);
+    float totalError = 0.0f;
+    for (size_t i = 0; i < objects.size(); ++i) {
+        totalError += glm::length(approximated[i] - expected[i]) / glm::length(expected[i]);
+    }
+    ASSERT_LT(totalError / static_cast<float>(objects.size()), 0.02f);
+
+    // The aggregates are updated after objects move, leave and come back, also in concurrent mode
+    auto check_aggregates = [&](octree<test_object>& checked, size_t erasedBegin, size_t erasedEnd) {
+        ASSERT_FALSE(checked.aggregates_fresh());
+        size_t staleMasses = 0;
+        checked.for_each_mass(nullptr, glm::vec3(0.0f), 0.5f, mass_of, [&staleMasses](float, glm::vec3 const&) { staleMasses++; });
+        ASSERT_EQ(staleMasses, 0u);
+        checked.compute_aggregates(mass_of);
+        ASSERT_TRUE(checked.aggregates_fresh());
+        for (auto const& [code, current] : checked.get_map()) {
+            auto const* aggregate = checked.find_aggregate(code);
+            ASSERT_NE(aggregate, nullptr);
+            float     mass = 0.0f;
+            glm::vec3 weightedPosition(0.0f);
+            for (size_t i = 0; i < objects.size(); ++i) {
+                if ((i < erasedBegin || i >= erasedEnd) && is_locational_code_prefix(code, objects[i].octree_node->locational_code)) {
+                    mass += mass_of(&objects[i]);
+                    weightedPosition += mass_of(&objects[i]) * (objects[i].bv_world.mMinPos + objects[i].bv_world.mMaxPos) * 0.5f;
+                }
+            }
+            ASSERT_NEAR(aggregate->mass, mass, 1e-3f * mass);
+            if (mass > 0.0f) {
+                ASSERT_LT(glm::length(aggregate->center_of_mass - weightedPosition / mass), 1e-3f);
+            }
+        }
+    };
+    for (size_t i = 0; i < objects.size(); i += 7) {
+        objects[i].bv_world.mMinPos += glm::vec3(i % 2 == 0 ? 0.3f : 25.0f);
+        objects[i].bv_world.mMaxPos += glm::vec3(i % 2 == 0 ? 0.3f : 25.0f);
+        tree.relocate(&objects[i]);
+    }
+    for (size_t i = 100; i < 400; ++i) {
+        tree.erase(&objects[i]);
+    }
+    check_aggregates(tree, 100, 400);
+    for (size_t i = 100; i < 400; ++i) {
+        tree.insert(&objects[i]);
+    }
+    check_aggregates(tree, 0, 0);
+
+    tree.set_concurrent(true);
+    for (size_t i = 0; i < objects.size(); i += 5) {
+        objects[i].bv_world.mMinPos -= glm::vec3(9.0f);
+        objects[i].bv_world.mMaxPos -= glm::vec3(9.0f);
+        tree.relocate(&objects[i]);
+    }
+    tree.set_concurrent(false);
+    check_aggregates(tree, 0, 0);
+
+    // Restoring a static image fills the nodes without insert
+    static_octree image;
+    image.build(tree, [&objects](test_object const* object) { return object - objects.data(); });
+    octree<test_object> restored;
+    image.restore(restored, [&objects](uint32_t index) { return &objects[index]; });
+    check_aggregates(restored, 0, 0);
+}
+
+TEST(geometry, triangle_aabb)
+{
+    aabb box(glm::vec3(0.0f), glm::vec3(1.0f));
+
+    // Inside, crossing a face and touching a corner
+    ASSERT_TRUE(intersection_triangle_aabb(triangle({0.2f, 0.2f, 0.5f}, {0.8f, 0.2f, 0.5f}, {0.5f, 0.8f, 0.5f}), box));
+    ASSERT_TRUE(intersection_triangle_aabb(triangle({-1.0f, 0.5f, 0.5f}, {0.5f, 0.5f, 0.5f}, {-1.0f, 0.9f, 0.5f}), box));
+    ASSERT_TRUE(intersection_triangle_aabb(triangle({1.0f, 1.0f, 1.0f}, {2.0f, 1.0f, 1.0f}, {1.0f, 2.0f, 1.0f}), box));
+    // A big triangle through the box, with every vertex outside
+    ASSERT_TRUE(intersection_triangle_aabb(triangle({-10.0f, -10.0f, 0.5f}, {10.0f, -10.0f, 0.5f}, {0.0f, 10.0f, 0.5f}), box));
+
+    // Separated by an axis of the box, by the plane of the triangle and by an edge cross product
+    ASSERT_FALSE(intersection_triangle_aabb(triangle({2.0f, 0.0f, 0.0f}, {3.0f, 0.0f, 0.0f}, {2.0f, 1.0f, 0.0f}), box));
+    ASSERT_FALSE(intersection_triangle_aabb(triangle({1.0f, 1.0f, 2.2f}, {2.2f, 1.0f, 1.0f}, {1.0f, 2.2f, 1.0f}), box));
+    ASSERT_FALSE(intersection_triangle_aabb(triangle({-0.3f, 0.6f, 0.1f}, {0.8f, 0.9f, -0.8f}, {-1.0f, 1.5f, -0.2f}), box));
+}
+
+TEST(sparse_voxel_octree, occupancy_matches_brute_force)
+{
+    std::mt19937                          generator(37);
+    std::uniform_real_distribution<float> position(-18.0f, 18.0f);
+    std::uniform_real_distribution<float> offset(-4.0f, 4.0f);
+    std::vector<triangle>                 triangles;
+    for (int i = 0; i < 200; ++i) {
+        glm::vec3 a(position(generator), position(generator), position(generator));
+        triangles.emplace_back(a, a + glm::vec3(offset(generator), offset(generator), offset(generator)),
+                               a + glm::vec3(offset(generator), offset(generator), offset(generator)));
+    }
+
+    sparse_voxel_octree voxels;
+    ASSERT_FALSE(voxels.build(triangles, 32, 6));
+    ASSERT_TRUE(voxels.build(triangles, 32, 4));
+
+    // Every voxel of the grid against every triangle
+    std::vector<uint32_t> expected;
+    for (int z = -16; z < 16; z += 2) {
+        for (int y = -16; y < 16; y += 2) {
+            for (int x = -16; x < 16; x += 2) {
+                aabb voxel(glm::vec3(x, y, z), glm::vec3(x + 2, y + 2, z + 2));
+                bool occupied = std::any_of(triangles.begin(), triangles.end(), [&voxel](triangle const& tri) { return intersection_triangle_aabb(tri, voxel); });
+                ASSERT_EQ(voxels.is_occupied(glm::vec3(x + 1, y + 1, z + 1)), occupied);
+                if (occupied) {
+                    expected.push_back(compute_locational_code<3>(glm::ivec3(x, y, z), 32, 4));
+                }
+            }
+        }
+    }
+    std::sort(expected.begin(), expected.end());
+    ASSERT_EQ(voxels.voxels(), expected);
+    ASSERT_EQ(voxels.voxel_count(), expected.size());
+    ASSERT_FALSE(voxels.is_occupied(glm::vec3(40.0f)));
+
+    // The same with several threads
+    sparse_voxel_octree parallel;
+    parallel.build(triangles, 32, 4, 3);
+    ASSERT_EQ(parallel.voxels(), expected);
+
+    // Coarse collision
+    for (int i = 0; i < 100; ++i) {
+        glm::vec3 min(position(generator), position(generator), position(generator));
+        aabb      bv(min, min + glm::vec3(1.5f));
+        bool      touches = std::any_of(expected.begin(), expected.end(), [&bv](uint32_t code) { return intersection_aabb_aabb(compute_bv(code, 32), bv); });
+        ASSERT_EQ(voxels.intersects(bv), touches);
+    }
+
+    // A mesh, scaled to the octree
+    mesh_data quad;
+    quad.positions   = {{-1.0f, 0.1f, -1.0f}, {1.0f, 0.1f, -1.0f}, {1.0f, 0.1f, 1.0f}, {-1.0f, 0.1f, 1.0f}};
+    quad.mPosIndices = {0, 1, 2, 0, 2, 3};
+    sparse_voxel_octree floor;
+    floor.build(quad, 7.9f, 32, 4);
+    ASSERT_EQ(floor.voxel_count(), 64u);
+    ASSERT_TRUE(floor.is_occupied(glm::vec3(-7.0f, 0.5f, 7.0f)));
+    ASSERT_FALSE(floor.is_occupied(glm::vec3(-9.0f, 0.5f, 7.0f)));
+}
+
+TEST(triangle_octree, queries_match_brute_force)
+{
+    std::mt19937                          generator(41);
+    std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+    std::uniform_real_distribution<float> offset(-6.0f, 6.0f);
+    std::vector<triangle>                 triangles;
+    for (int i = 0; i < 1000; ++i) {
+        glm::vec3 a(position(generator), position(generator), position(generator));
+        triangles.emplace_back(a, a + glm::vec3(offset(generator), offset(generator), offset(generator)),
+                               a + glm::vec3(offset(generator), offset(generator), offset(generator)));
+    }
+    // Large axis aligned ones, like the floors and walls of a building
+    triangles.emplace_back(glm::vec3(-60.0f, -20.0f, -60.0f), glm::vec3(60.0f, -20.0f, -60.0f), glm::vec3(60.0f, -20.0f, 60.0f));
+    triangles.emplace_back(glm::vec3(-60.0f, -20.0f, -60.0f), glm::vec3(60.0f, -20.0f, 60.0f), glm::vec3(-60.0f, -20.0f, 60.0f));
+    triangles.emplace_back(glm::vec3(30.0f, -60.0f, -60.0f), glm::vec3(30.0f, 60.0f, -60.0f), glm::vec3(30.0f, 60.0f, 60.0f));
+
+    triangle_octree tree;
+    tree.build(triangles, 128, 5);
+
+    for (int i = 0; i < 200; ++i) {
+        glm::vec3 origin(position(generator), position(generator), position(generator));
+        glm::vec3 dir(offset(generator), offset(generator), offset(generator));
+        ray       r(origin, dir);
+
+        float    expected = -1.0f;
+        for (auto const& tri : triangles) {
+            float t = intersection_ray_triangle(r, tri);
+            if (t >= 0.0f && (expected < 0.0f || t < expected)) {
+                expected = t;
+            }
+        }
+        uint32_t hit = 0;
+        float    t   = tree.raycast(r, &hit);
+        ASSERT_EQ(t, expected);
+        if (t >= 0.0f) {
+            ASSERT_EQ(intersection_ray_triangle(r, triangles[hit]), t);
+        }
+    }
+
+    for (int i = 0; i < 100; ++i) {
+        glm::vec3 min(position(generator), position(generator), position(generator));
+        aabb      bv(min, min + glm::vec3(8.0f));
+
+        std::vector<uint32_t> found;
+        tree.query(bv, found);
+        std::sort(found.begin(), found.end());
+
+        std::vector<uint32_t> expected;
+        for (uint32_t j = 0; j < triangles.size(); ++j) {
+            if (intersection_triangle_aabb(triangles[j], bv)) {
+                expected.push_back(j);
+            }
+        }
+        ASSERT_EQ(found, expected);
+    }
+}
+
+TEST(static_octree, raycast_after_malformed_child_mask)
+{
+    std::vector<aabb> bvs;
+    for (int i = 0; i < 30; ++i) {
+        glm::vec3 min(4.0f + (i % 6) * 9.0f, 4.0f + (i / 6) * 9.0f, 20.0f);
+        bvs.emplace_back(min, min + glm::vec3(2.0f));
+    }
+    static_octree built;
+    built.build(bvs, 128, 4, cell_interval::half_open);
+    std::string path = testing::TempDir() + "static_octree_malformed.bin";
+    ASSERT_TRUE(built.save(path));
+
+    static_octree loaded;
+    ASSERT_TRUE(loaded.load(path));
+    ray r(glm::vec3(5.0f, 5.0f, -50.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    auto hit_box = [&bvs, &r](uint32_t index) { return intersection_ray_aabb(r, bvs[index]); };
+    ASSERT_EQ(loaded.raycast(r, hit_box), built.raycast(r, hit_box));
+    ASSERT_GE(loaded.raycast(r, hit_box), 0.0f);
+
+    // Sets a children bit of the root whose node doesn't exist
+    static_octree_header header;
+    static_octree_node   root;
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        file.seekg(static_cast<std::streamoff>(header.nodes_offset));
+        file.read(reinterpret_cast<char*>(&root), sizeof(root));
+        ASSERT_NE(root.children_active, 0xffu);
+        uint32_t missing = 0;
+        while (root.children_active & (1u << missing)) {
+            missing++;
+        }
+        root.children_active |= 1u << missing;
+        file.seekp(static_cast<std::streamoff>(header.nodes_offset));
+        file.write(reinterpret_cast<char const*>(&root), sizeof(root));
+    }
+    ASSERT_FALSE(loaded.load(path));
+    ASSERT_TRUE(loaded.empty());
+    ASSERT_EQ(loaded.raycast(r, hit_box), -1.0f);
+    std::remove(path.c_str());
+}
+
+TEST(quadtree, queries_and_pairs_match_brute_force)
+{
+    std::mt19937                          generator(29);
+    std::uniform_real_distribution<float> position(-60.0f, 60.0f);
+    std::uniform_real_distribution<float> height(-500.0f, 500.0f);
+    std::uniform_real_distribution<float> size(0.3f, 12.0f);
+    std::vector<test_object_2d>           objects(500);
+
+    // z is arbitrary, a quadtree must ignore it
+    auto randomBV = [&]() {
+        glm::vec3 min(position(generator), position(generator), height(generator));
+        return aabb(min, min + glm::vec3(size(generator), size(generator), 1.0f));
+    };
+    auto overlap2d = [](aabb const& a, aabb const& b) {
+        return a.mMinPos.x <= b.mMaxPos.x && b.mMinPos.x <= a.mMaxPos.x && a.mMinPos.y <= b.mMaxPos.y && b.mMinPos.y <= a.mMaxPos.y;
+    };
+    for (auto& object : objects) {
+        object.bv_world = randomBV();
+    }
+
+    octree<test_object_2d, 2> tree;
+    tree.set_root_size(128);
+    tree.set_levels(6);
+    for (auto& object : objects) {
+        tree.insert(&object);
+    }
+    ASSERT_EQ(compute_locational_code<2>(aabb({-63.5f, -63.5f, 300.0f}, {-63.2f, -63.2f, 301.0f}), 128, 6), 1u << 12);
+
+    auto check = [&]() {
+        // Codes use 2 bits per level and nodes have at most 4 children
+        ASSERT_EQ((octree<test_object_2d, 2>::max_depth), 15u);
+        for (auto const& [code, node] : tree.get_map()) {
+            ASSERT_EQ(node->depth, locational_code_depth<2>(code));
+            ASSERT_LT(node->children_active, 16u);
+            if (code > 1) {
+                auto const* parent = tree.find_node(code >> 2);
+                ASSERT_NE(parent, nullptr);
+                ASSERT_TRUE(parent->children_active & (1u << (code & 3u)));
+            }
+        }
+
+        for (int i = 0; i < 30; ++i) {
+            aabb bv = randomBV();
+            std::vector<test_object_2d const*> found;
+            tree.query(bv, [&found](test_object_2d const* object) { found.push_back(object); });
+            std::sort(found.begin(), found.end());
+            ASSERT_EQ(std::adjacent_find(found.begin(), found.end()), found.end());
+
+            std::vector<test_object_2d const*> expected;
+            for (auto const& object : objects) {
+                if (overlap2d(object.bv_world, bv)) {
+                    expected.push_back(&object);
+                }
+            }
+            ASSERT_EQ(found, expected);
+        }
+
+        std::vector<std::pair<test_object_2d const*, test_object_2d const*>> candidates;
+        tree.for_each_pair([&candidates](test_object_2d const* a, test_object_2d const* b) {
+            candidates.emplace_back(std::min(a, b), std::max(a, b));
+        });
+        std::sort(candidates.begin(), candidates.end());
+        ASSERT_EQ(std::adjacent_find(candidates.begin(), candidates.end()), candidates.end());
+        candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [&](auto const& pair) {
+            return !overlap2d(pair.first->bv_world, pair.second->bv_world);
+        }), candidates.end());
+
+        std::vector<std::pair<test_object_2d const*, test_object_2d const*>> expected;
+        for (size_t i = 0; i < objects.size(); ++i) {
+            for (size_t j = i + 1; j < objects.size(); ++j) {
+                if (overlap2d(objects[i].bv_world, objects[j].bv_world)) {
+                    expected.emplace_back(std::min(&objects[i], &objects[j]), std::max(&objects[i], &objects[j]));
+                }
+            }
+        }
+        std::sort(expected.begin(), expected.end());
+        ASSERT_EQ(candidates, expected);
+    };
+    check();
+
+    tree.set_multi_cell(3, 4);
+    ASSERT_GT(tree.multi_cell_objects(), 0u);
+    check();
+
+    for (auto& object : objects) {
+        object.bv_world = randomBV();
+        tree.relocate(&object);
+    }
+    check();
+
+    for (auto& object : objects) {
+        tree.erase(&object);
+    }
+    ASSERT_TRUE(tree.get_map().empty());
+}
+
+TEST(spatial_reorder, hilbert_visits_adjacent_cells)
+{
+    // Every cell gets a code, and consecutive codes are adjacent cells (an unset code would be a jump from 0)
+    const uint32_t bits = 3;
+    std::vector<glm::uvec2> cells2d(1u << (2 * bits));
+    for (uint32_t x = 0; x < (1u << bits); ++x) {
+        for (uint32_t y = 0; y < (1u << bits); ++y) {
+            uint32_t code = hilbert_code<2>(glm::uvec2(x, y), bits);
+            ASSERT_LT(code, cells2d.size());
+            cells2d[code] = glm::uvec2(x + 1, y + 1);
+        }
+    }
+    for (size_t i = 1; i < cells2d.size(); ++i) {
+        glm::ivec2 step = glm::abs(glm::ivec2(cells2d[i]) - glm::ivec2(cells2d[i - 1]));
+        ASSERT_EQ(step.x + step.y, 1);
+    }
+
+    std::vector<glm::uvec3> cells3d(1u << (3 * bits));
+    for (uint32_t x = 0; x < (1u << bits); ++x) {
+        for (uint32_t y = 0; y < (1u << bits); ++y) {
+            for (uint32_t z = 0; z < (1u << bits); ++z) {
+                uint32_t code = hilbert_code<3>(glm::uvec3(x, y, z), bits);
+                ASSERT_LT(code, cells3d.size());
+                cells3d[code] = glm::uvec3(x + 1, y + 1, z + 1);
+            }
+        }
+    }
+    for (size_t i = 1; i < cells3d.size(); ++i) {
+        glm::ivec3 step = glm::abs(glm::ivec3(cells3d[i]) - glm::ivec3(cells3d[i - 1]));
+        ASSERT_EQ(step.x + step.y + step.z, 1);
+    }
+
+    // The Morton order is the one of the locational codes
+    ASSERT_EQ(curve_code<3>(glm::vec3(-63.5f, 10.5f, 40.2f), 128, 5, space_filling_curve::morton),
+              compute_locational_code<3>({-64, 8, 40}, 128, 5) ^ (1u << 15));
+}
+
+TEST(spatial_reorder, compaction_keeps_the_octree_links)
+{
+    std::mt19937                          generator(31);
+    std::uniform_real_distribution<float> position(-60.0f, 60.0f);
+    std::uniform_real_distribution<float> size(0.3f, 14.0f);
+
+    object_arena<test_object> arena;
+    std::vector<test_object*> objects;
+    octree<test_object>       tree;
+    tree.set_root_size(128);
+    tree.set_levels(5);
+    tree.set_multi_cell(3, 8);
+    for (int i = 0; i < 400; ++i) {
+        glm::vec3    min(position(generator), position(generator), position(generator));
+        test_object* object = arena.create();
+        object->bv_world    = aabb(min, min + glm::vec3(size(generator)));
+        objects.push_back(object);
+        tree.insert(object);
+    }
+    ASSERT_GT(tree.multi_cell_objects(), 0u);
+
+    auto key_of = [](test_object const* object) {
+        return curve_code<3>((object->bv_world.mMinPos + object->bv_world.mMaxPos) * 0.5f, 128, 10, space_filling_curve::hilbert);
+    };
+    auto query_all = [&](aabb const& bv) {
+        std::vector<glm::vec3> found;
+        tree.query(bv, [&found](test_object const* object) { found.push_back(object->bv_world.mMinPos); });
+        std::sort(found.begin(), found.end(), [](glm::vec3 const& a, glm::vec3 const& b) { return a.x < b.x; });
+        return found;
+    };
+    aabb queryBV({-30.0f, -30.0f, -30.0f}, {20.0f, 25.0f, 30.0f});
+    auto before = query_all(queryBV);
+    ASSERT_EQ(arena.disorder(objects, key_of), 1.0f);
+
+    arena.compact(objects, key_of, [&tree](auto remap) { tree.remap_objects(remap); });
+    ASSERT_EQ(arena.block_size(), objects.size());
+    ASSERT_EQ(arena.spilled_count(), 0u);
+    ASSERT_EQ(arena.disorder(objects, key_of), 0.0f);
+    for (size_t i = 0; i < objects.size(); ++i) {
+        ASSERT_TRUE(arena.in_block(objects[i]));
+        if (i > 0) {
+            ASSERT_EQ(objects[i], objects[i - 1] + 1);
+            ASSERT_LE(key_of(objects[i - 1]), key_of(objects[i]));
+        }
+    }
+
+    // The tree only knows the new addresses
+    check_consistency(tree);
+    ASSERT_EQ(query_all(queryBV), before);
+    size_t visited = 0;
+    tree.for_each_object([&](test_object const* object) {
+        ASSERT_TRUE(arena.in_block(object));
+        visited++;
+    });
+    ASSERT_EQ(visited, objects.size());
+    for (auto* object : objects) {
+        object->bv_world.mMinPos += glm::vec3(1.5f);
+        object->bv_world.mMaxPos += glm::vec3(1.5f);
+        tree.relocate(object);
+    }
+    check_consistency(tree);
+    for (auto* object : objects) {
+        tree.erase(object);
+    }
+    ASSERT_TRUE(tree.get_map().empty());
+}
+
+TEST(radix_sort, matches_stable_sort)
+{
+    std::mt19937_64 generator(37);
+
+    // Both key widths and digit sizes, one and several threads, and the scratch buffer reused across sizes
+    auto check = [&](auto& sorter, auto keyMask, size_t count, uint32_t digitBits, uint32_t threads) {
+        using entry = typename std::remove_reference_t<decltype(sorter)>::entry;
+        std::vector<entry> entries(count);
+        for (size_t i = 0; i < count; ++i) {
+            entries[i] = {static_cast<decltype(keyMask)>(generator()) & keyMask, static_cast<uint32_t>(i)};
+        }
+        std::vector<entry> expected = entries;
+        std::stable_sort(expected.begin(), expected.end(), [](entry const& a, entry const& b) { return a.first < b.first; });
+        sorter.sort(entries, digitBits, threads);
+        ASSERT_EQ(entries, expected);
+    };
+
+    radix_sorter<uint32_t> sorter32;
+    radix_sorter<uint64_t> sorter64;
+    for (uint32_t threads : {1u, 3u}) {
+        for (uint32_t digitBits : {8u, 11u}) {
+            check(sorter32, 0xffffffffu, 20000, digitBits, threads);
+            check(sorter32, 0x3fffffffu, 777, digitBits, threads);   // A 10 level locational code without sentinel
+            check(sorter32, 0x000000ffu, 5000, digitBits, threads);  // Many ties
+            check(sorter64, ~uint64_t(0), 12345, digitBits, threads);
+            check(sorter64, uint64_t(0x7fffffffffffffff), 3, digitBits, threads);
+        }
+    }
+
+    // Equal codes skip every pass, and empty or single entries are left as they are
+    std::vector<std::pair<uint32_t, uint32_t>> same{{7, 2}, {7, 0}, {7, 1}};
+    sorter32.sort(same, 8, 2);
+    ASSERT_EQ(same, (std::vector<std::pair<uint32_t, uint32_t>>{{7, 2}, {7, 0}, {7, 1}}));
+    std::vector<std::pair<uint32_t, uint32_t>> empty;
+    sorter32.sort(empty);
+    ASSERT_TRUE(empty.empty());
+}
+
+TEST(bvh_tree, sah_binned_matches_brute_force)
+{
+    std::mt19937                          generator(49);
+    std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+    std::uniform_real_distribution<float> offset(-4.0f, 4.0f);
+    mesh_data                             mesh;
+    for (unsigned i = 0; i < 2000; ++i) {
+        // Clustered, so that the centroid mean is a poor split
+        glm::vec3 a(position(generator), position(generator), position(generator));
+        if (i % 4 != 0) {
+            a *= 0.1f;
+        }
+        mesh.positions.push_back(a);
+        mesh.positions.push_back(a + glm::vec3(offset(generator), offset(generator), offset(generator)));
+        mesh.positions.push_back(a + glm::vec3(offset(generator), offset(generator), offset(generator)));
+        mesh.mPosIndices.insert(mesh.mPosIndices.end(), {i * 3, i * 3 + 1, i * 3 + 2});
+    }
+
+    bvh_tree topDown;
+    topDown.construct_bvh(mesh, bvh_construction_method::top_down);
+    bvh_tree sah;
+    sah.set_sah_binned_parameters(16, 4);
+    sah.construct_bvh(mesh, bvh_construction_method::sah_binned);
+    ASSERT_LT(sah.sah_cost(), topDown.sah_cost());
+
+    // Every triangle in a single leaf, of at most 4 triangles
+    std::vector<unsigned>          leafIndices;
+    std::vector<bvh_node const*>   stack{sah.get_root()};
+    while (!stack.empty()) {
+        bvh_node const* node = stack.back();
+        stack.pop_back();
+        if (node->mNodeType == tree_node_type::leaf) {
+            ASSERT_LE(node->mIndices.size(), 12u);
+            leafIndices.insert(leafIndices.end(), node->mIndices.begin(), node->mIndices.end());
+        } else {
+            stack.push_back(node->mLeft);
+            stack.push_back(node->mRight);
+        }
+    }
+    std::sort(leafIndices.begin(), leafIndices.end());
+    ASSERT_EQ(leafIndices.size(), mesh.mPosIndices.size());
+    ASSERT_TRUE(std::equal(leafIndices.begin(), leafIndices.end(), mesh.mPosIndices.begin()));
+
+    auto triangleAt = [&mesh](unsigned i) {
+        return triangle(mesh.positions[i * 3], mesh.positions[i * 3 + 1], mesh.positions[i * 3 + 2]);
+    };
+    for (int i = 0; i < 200; ++i) {
+        glm::vec3 origin(position(generator), position(generator), position(generator));
+        ray       r(origin, -origin + glm::vec3(offset(generator), offset(generator), offset(generator)));
+
+        float expected = -1.0f;
+        for (unsigned j = 0; j < 2000; ++j) {
+            float t = intersection_ray_triangle(r, triangleAt(j));
+            if (t >= 0.0f && (expected < 0.0f || t < expected)) {
+                expected = t;
+            }
+        }
+        ASSERT_EQ(sah.raycast(mesh.positions, r), expected);
+        ASSERT_EQ(topDown.raycast(mesh.positions, r), expected);
+    }
+
+    for (int i = 0; i < 100; ++i) {
+        glm::vec3 min = glm::vec3(position(generator), position(generator), position(generator)) * 0.2f;
+        aabb      bv(min, min + glm::vec3(4.0f));
+
+        std::vector<unsigned> expected;
+        for (unsigned j = 0; j < 2000; ++j) {
+            if (intersection_triangle_aabb(triangleAt(j), bv)) {
+                expected.insert(expected.end(), {j * 3, j * 3 + 1, j * 3 + 2});
+            }
+        }
+        std::vector<unsigned> found;
+        sah.query(mesh.positions, bv, found);
+        std::sort(found.begin(), found.end());
+        ASSERT_EQ(found, expected);
+    }
+}
+
+TEST(bvh_tree, top_down_keeps_triangles_it_cannot_split)
+{
+    // Two copies of the same triangle, their centroids can't be separated
+    mesh_data mesh;
+    mesh.positions   = {glm::vec3(-1.0f, -1.0f, 0.0f), glm::vec3(1.0f, -1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)};
+    mesh.mPosIndices = {0, 1, 2, 2, 1, 0};
+
+    bvh_tree tree;
+    tree.construct_bvh(mesh, bvh_construction_method::top_down);
+    ASSERT_FALSE(tree.is_empty());
+    ASSERT_EQ(tree.get_root()->mNodeType, tree_node_type::leaf);
+    ASSERT_EQ(tree.get_root()->mIndices, mesh.mPosIndices);
+
+    ray r(glm::vec3(0.0f, 0.0f, -5.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    ASSERT_FLOAT_EQ(tree.raycast(mesh.positions, r), 5.0f);
+    std::vector<unsigned> found;
+    tree.query(mesh.positions, aabb(glm::vec3(-0.1f), glm::vec3(0.1f)), found);
+    ASSERT_EQ(found.size(), 6u);
+}
+
+TEST(bvh_tree, linear_layout_matches_tree)
+{
+    std::mt19937                          generator(50);
+    std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+    std::uniform_real_distribution<float> offset(-4.0f, 4.0f);
+    mesh_data                             mesh;
+    for (unsigned i = 0; i < 1500; ++i) {
+        glm::vec3 a(position(generator), position(generator), position(generator));
+        mesh.positions.push_back(a);
+        mesh.positions.push_back(a + glm::vec3(offset(generator), offset(generator), offset(generator)));
+        mesh.positions.push_back(a + glm::vec3(offset(generator), offset(generator), offset(generator)));
+        mesh.mPosIndices.insert(mesh.mPosIndices.end(), {i * 3, i * 3 + 1, i * 3 + 2});
+    }
+
+    bvh_tree topDown;
+    topDown.construct_bvh(mesh, bvh_construction_method::top_down);
+    topDown.flatten();
+    bvh_tree bottomUp;
+    mesh_data small = mesh;
+    small.mPosIndices.resize(300);
+    bottomUp.construct_bvh(small, bvh_construction_method::bottom_up);
+    bottomUp.flatten();
+    bvh_tree direct;
+    direct.construct_linear_bvh(mesh);
+    ASSERT_TRUE(direct.is_empty());
+
+    // Depth first, the left child of an internal node follows it and every triangle is in a leaf
+    for (bvh_tree const* tree : {&topDown, &bottomUp, &direct}) {
+        auto const& nodes = tree->get_linear_nodes();
+        ASSERT_FALSE(nodes.empty());
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(nodes.data()) % 32, 0u);
+        unsigned leafTriangles = 0;
+        for (unsigned i = 0; i < nodes.size(); ++i) {
+            if (nodes[i].mCount != 0) {
+                ASSERT_EQ(nodes[i].mOffset, leafTriangles);
+                leafTriangles += nodes[i].mCount;
+            } else {
+                ASSERT_GT(nodes[i].mOffset, i + 1);
+                ASSERT_LT(nodes[i].mOffset, nodes.size());
+            }
+        }
+        std::vector<unsigned> indices = tree->get_linear_indices();
+        ASSERT_EQ(indices.size(), leafTriangles * 3);
+        std::sort(indices.begin(), indices.end());
+        ASSERT_TRUE(std::equal(indices.begin(), indices.end(), mesh.mPosIndices.begin()));
+    }
+
+    for (int i = 0; i < 200; ++i) {
+        glm::vec3 origin(position(generator), position(generator), position(generator));
+        ray       r(origin, glm::vec3(offset(generator), offset(generator), offset(generator)));
+        float     expected = topDown.raycast(mesh.positions, r);
+        ASSERT_EQ(topDown.linear_raycast(mesh.positions, r), expected);
+        ASSERT_EQ(direct.linear_raycast(mesh.positions, r), expected);
+        ASSERT_EQ(bottomUp.linear_raycast(mesh.positions, r), bottomUp.raycast(mesh.positions, r));
+    }
+
+    for (int i = 0; i < 100; ++i) {
+        glm::vec3 min(position(generator), position(generator), position(generator));
+        aabb      bv(min, min + glm::vec3(8.0f));
+
+        std::vector<unsigned> expected;
+        topDown.query(mesh.positions, bv, expected);
+        std::sort(expected.begin(), expected.end());
+        std::vector<unsigned> found;
+        topDown.linear_query(mesh.positions, bv, found);
+        std::sort(found.begin(), found.end());
+        ASSERT_EQ(found, expected);
+        direct.linear_query(mesh.positions, bv, found);
+        std::sort(found.begin(), found.end());
+        ASSERT_EQ(found, expected);
+    }
+
+    // Rebuilding drops the flattened tree
+    topDown.construct_bvh(mesh, bvh_construction_method::sah_binned);
+    ASSERT_TRUE(topDown.get_linear_nodes().empty());
+}
@@ -0,0 +1,98 @@
+/**
+* @file triangle_octree.cpp
+* @author Miguel Echeverria , 540000918 , miguel.echeverria@digipen.edu
+* @date 2020/11/07
+* @brief Contains the construction and the queries of the triangle octree.
+*
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+
+#include "pch.hpp"
+#include "triangle_octree.hpp"
+#include "mesh_data.hpp"
+
+namespace cs350 {
+
+    /**
+    * @brief Builds the octree for the given triangles, each one keyed on the locational code of its bv.
+    * @param triangles    The triangles, in the coordinates of the octree.
+    * @param root_size    The size of one side of the root bv.
+    * @param levels       The number of levels of the tree.
+    * @param interval     How the max corner of the bvs is mapped onto the leaf grid.
+    */
+    void triangle_octree::build(std::vector<triangle> triangles, uint32_t root_size, uint32_t levels, cell_interval interval)
+    {
+      m_triangles = std::move(triangles);
+
+      std::vector<aabb> bvs(m_triangles.size());
+      for (size_t i = 0; i < m_triangles.size(); ++i)
+      {
+        triangle const& tri = m_triangles[i];
+        bvs[i] = aabb(glm::min(tri.mPos1, glm::min(tri.mPos2, tri.mPos3)), glm::max(tri.mPos1, glm::max(tri.mPos2, tri.mPos3)));
+      }
+
+      m_tree.build(bvs, root_size, levels, interval);
+    }
+
+
+    /**
+    * @brief Builds the octree for the triangles of a mesh.
+    * @param mesh         The mesh, its positions indexed by mPosIndices.
+    * @param scale        Scale applied to the positions, to bring them to the coordinates of the octree.
+    * @param root_size    The size of one side of the root bv.
+    * @param levels       The number of levels of the tree.
+    * @param interval     How the max corner of the bvs is mapped onto the leaf grid.
+    */
+    void triangle_octree::build(mesh_data const& mesh, float scale, uint32_t root_size, uint32_t levels, cell_interval interval)
+    {
+      std::vector<triangle> triangles;
+      triangles.reserve(mesh.mPosIndices.size() / 3);
+      for (size_t i = 0; i + 2 < mesh.mPosIndices.size(); i += 3)
+        triangles.emplace_back(mesh.positions[mesh.mPosIndices[i]] * scale,
+                               mesh.positions[mesh.mPosIndices[i + 1]] * scale,
+                               mesh.positions[mesh.mPosIndices[i + 2]] * scale);
+
+      build(std::move(triangles), root_size, levels, interval);
+    }
+
+
+    /**
+    * @brief Releases the triangles and the tree.
+    */
+    void triangle_octree::clear()
+    {
+      m_triangles.clear();
+      m_tree.clear();
+    }
+
+
+    /**
+    * @brief Finds the closest triangle hit by a ray.
+    * @param r              The ray.
+    * @param hit_triangle   Output (if not nullptr), the index of the triangle hit.
+    * @return float         The t of the closest hit, -1 if no triangle is hit.
+    */
+    float triangle_octree::raycast(ray const& r, uint32_t* hit_triangle) const
+    {
+      return m_tree.raycast(r, [this, &r](uint32_t index)
+      {
+        return intersection_ray_triangle(r, m_triangles[index]);
+      }, hit_triangle);
+    }
+
+
+    /**
+    * @brief Finds the triangles that intersect bv (with the separating axis test).
+    * @param bv           The bounding volume to query.
+    * @param result       Output, the indices of the triangles (in no particular order).
+    */
+    void triangle_octree::query(aabb const& bv, std::vector<uint32_t>& result) const
+    {
+      result.clear();
+      m_tree.query(bv, [this, &bv, &result](uint32_t index)
+      {
+        if (intersection_triangle_aabb(m_triangles[index], bv))
+          result.push_back(index);
+      });
+    }
+}
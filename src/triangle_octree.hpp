@@ -0,0 +1,43 @@
+/**
+* @file triangle_octree.hpp
+* @author Miguel Echeverria , 540000918 , miguel.echeverria@digipen.edu
+* @date 2020/11/07
+* @brief Contains the declaration of the triangle octree, a static octree of the triangles
+*        of a mesh that answers ray and overlap queries.
+*
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+
+#pragma once
+#include "static_octree.hpp"
+
+namespace cs350 {
+    struct mesh_data;
+
+    /**
+     * @brief
+     * 	The triangles of a static mesh in a static_octree, each one in the node of the locational code of its
+     *  bv. Unlike bvh_tree, the nodes don't own index vectors: the triangle indices and bvs are in the single
+     *  block of the static octree. Large triangles (like the walls and floors of architectural meshes) stay
+     *  in shallow nodes instead of being split or making their nodes large. Cells are half open by default,
+     *  mesh coordinates aren't integers and a closed max corner moves up the triangles ending just before a boundary.
+     */
+    class triangle_octree
+    {
+      public:
+        void build(std::vector<triangle> triangles, uint32_t root_size, uint32_t levels, cell_interval interval = cell_interval::half_open);
+        void build(mesh_data const& mesh, float scale, uint32_t root_size, uint32_t levels, cell_interval interval = cell_interval::half_open);
+        void clear();
+
+        float raycast(ray const& r, uint32_t* hit_triangle = nullptr) const;
+        void  query(aabb const& bv, std::vector<uint32_t>& result) const;
+
+        [[nodiscard]] bool                         empty() const { return m_triangles.empty(); }
+        [[nodiscard]] std::vector<triangle> const& triangles() const { return m_triangles; }
+        [[nodiscard]] static_octree const&         tree() const { return m_tree; }
+
+      private:
+        std::vector<triangle> m_triangles;
+        static_octree         m_tree;     // Its object indices are indices into m_triangles
+    };
+}